@@ -42,3 +42,21 @@ import os
 
 import udt4_ext
 from   udt4_ext import *
+
+
+def perfmon_dtype():
+    """
+    Return the numpy structured dtype matching UDT::TRACEINFO, for use with
+    Socket.perfmon_into().
+    """
+    import numpy
+    return numpy.dtype(udt4_ext.perfmon_layout())
+
+
+def perfmon_record_dtype():
+    """
+    Return the numpy structured dtype of the records filled by
+    Epoll.perfmon_all(): descriptor, status and every TRACEINFO field.
+    """
+    import numpy
+    return numpy.dtype(udt4_ext.perfmon_record_layout())
@@ -0,0 +1,168 @@
+"""
+:module: prefork.py
+
+--------------------------------------------------------------------------------
+Pre-fork multi-process UDT server sharing one UDP port.
+--------------------------------------------------------------------------------
+The supervisor creates one SO_REUSEPORT UDP socket per worker, then forks the
+workers. Each worker starts its own UDT instance and attaches its listener to
+its UDP socket through Socket.bind_to_udp(), so that connection handling
+scales with the number of cores instead of being capped by one interpreter.
+
+An optional BPF program selects the worker from the peer's address and port,
+keeping every packet of a UDT connection on the worker that accepted it.
+
+UDT must not be used in the supervisor before serve_forever() is called: UDT's
+threads do not survive fork().
+
+    def handler(client, address):
+        data = client.recv(1024)
+        ...
+
+    server = PreforkServer(('0.0.0.0', 9000), handler, workers=4)
+    server.serve_forever()
+--------------------------------------------------------------------------------
+"""
+
+import os
+import signal
+import errno
+
+from . import udt4_ext
+
+
+class PreforkServer(object):
+    """
+    Supervisor of a pool of forked UDT server processes.
+
+    :param address:     (ip, port) tuple to serve on.
+    :param handler:     callable(client, address) run in the worker for every
+                        accepted connection.
+    :param workers:     number of worker processes (default: CPU count).
+    :param backlog:     listen backlog of each worker.
+    :param pin:         whether to attach the connection-pinning BPF program.
+    :param worker_init: optional callable(index) run in each worker before
+                        it starts accepting connections.
+    """
+
+    def __init__(self, address, handler, workers = None, backlog = 1024,
+                 pin = True, worker_init = None):
+        if workers is None:
+            import multiprocessing
+            workers = multiprocessing.cpu_count()
+
+        self.address     = address
+        self.handler     = handler
+        self.workers     = workers
+        self.backlog     = backlog
+        self.pin         = pin
+        self.worker_init = worker_init
+
+        self._sockets    = []
+        self._pids       = {}
+        self._running    = False
+
+    def serve_forever(self):
+        """
+        Create the UDP sockets, fork the workers and respawn them when they
+        die, until shutdown() is called or the supervisor is signalled.
+        """
+        ip, port = self.address
+
+        # The supervisor keeps every socket open so that the SO_REUSEPORT
+        # group (and the BPF worker indices) survive worker restarts
+        for i in range(self.workers):
+            self._sockets.append(udt4_ext.reuseport_socket(ip, port))
+            if port == 0:
+                port = self.port()
+
+        if self.pin:
+            udt4_ext.attach_reuseport_bpf(self._sockets[0], self.workers)
+
+        self._running = True
+        signal.signal(signal.SIGTERM, self._on_signal)
+        signal.signal(signal.SIGINT, self._on_signal)
+
+        for i in range(self.workers):
+            self._spawn(i)
+
+        while self._running or self._pids:
+            try:
+                pid, status = os.wait()
+            except OSError as e:
+                if e.errno == errno.EINTR:
+                    continue
+                if e.errno == errno.ECHILD:
+                    break
+                raise
+
+            index = self._pids.pop(pid, None)
+            if index is not None and self._running:
+                self._spawn(index)
+
+        for fd in self._sockets:
+            os.close(fd)
+        self._sockets = []
+
+    def shutdown(self):
+        """
+        Stop respawning workers and terminate the running ones.
+        """
+        self._running = False
+        for pid in list(self._pids):
+            try:
+                os.kill(pid, signal.SIGTERM)
+            except OSError:
+                pass
+
+    def port(self):
+        """
+        Return the UDP port served by the workers.
+        """
+        import socket
+        sock = socket.fromfd(self._sockets[0], socket.AF_INET,
+                             socket.SOCK_DGRAM)
+        try:
+            return sock.getsockname()[1]
+        finally:
+            sock.close()
+
+    def _on_signal(self, signum, frame):
+        self.shutdown()
+
+    def _spawn(self, index):
+        pid = os.fork()
+        if pid:
+            self._pids[pid] = index
+            return
+
+        # Worker process: never return into the supervisor's loop
+        code = 0
+        try:
+            self._serve(index)
+        except BaseException:
+            import traceback
+            traceback.print_exc()
+            code = 1
+        os._exit(code)
+
+    def _serve(self, index):
+        signal.signal(signal.SIGTERM, signal.SIG_DFL)
+        signal.signal(signal.SIGINT, signal.SIG_DFL)
+
+        for i, fd in enumerate(self._sockets):
+            if i != index:
+                os.close(fd)
+
+        udt4_ext.startup()
+
+        if self.worker_init is not None:
+            self.worker_init(index)
+
+        listener = udt4_ext.Socket()
+        listener.bind_to_udp(self._sockets[index])
+        listener.listen(self.backlog)
+
+        while True:
+            client, address = listener.accept()
+            self.handler(client, address)
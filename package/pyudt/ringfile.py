@@ -0,0 +1,212 @@
+"""
+:module: ringfile.py
+
+--------------------------------------------------------------------------------
+Reader for the perfmon ring files written by udt4_ext.Sampler.
+--------------------------------------------------------------------------------
+The file is self-describing: its header lists the name, numpy type string and
+offset of every field of a record, so it can be read on another host or after
+the writing process exited. Readers never lock the file; records that are
+being written or were overwritten while being read are skipped.
+
+    reader = RingReader('/var/run/udt.ring')
+    for record in reader.records():
+        print(record['timestamp_us'], record['descriptor'], record['msRTT'])
+
+Command line:
+
+    python -m pyudt.ringfile /var/run/udt.ring -o history.csv
+    python -m pyudt.ringfile /var/run/udt.ring -o history.parquet
+--------------------------------------------------------------------------------
+"""
+
+import csv
+import mmap
+import struct
+import sys
+
+
+MAGIC   = b'PYUDTRNG'
+VERSION = 1
+
+# magic, version, header_size, slot_size, capacity, field_count, period_ms
+_HEADER      = struct.Struct('<8s6I')
+_WRITE_INDEX = struct.Struct('<Q')
+_WRITE_INDEX_OFFSET = 32
+_FIELDS_OFFSET      = 48
+# name, format, offset, reserved
+_FIELD       = struct.Struct('<32s8sII')
+_SEQ         = struct.Struct('<Q')
+
+# numpy type strings to struct codes
+_CODES = { '<i4': 'i', '<i8': 'q', '<f8': 'd' }
+
+
+class RingReader(object):
+    """
+    Lock-free reader of a ring file.
+
+    :param path: path of the ring file.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self._file = open(path, 'rb')
+        self._map = mmap.mmap(self._file.fileno(), 0, access = mmap.ACCESS_READ)
+
+        (magic, version, self.header_size, self.slot_size, self.capacity,
+         field_count, self.period_ms) = _HEADER.unpack_from(self._map, 0)
+
+        if magic != MAGIC:
+            raise ValueError('%s is not a ring file' % path)
+        if version != VERSION:
+            raise ValueError('Unsupported ring file version %d' % version)
+
+        self.fields = []
+        for i in range(field_count):
+            name, fmt, offset, _ = _FIELD.unpack_from(
+                self._map, _FIELDS_OFFSET + i * _FIELD.size)
+            self.fields.append((name.rstrip(b'\0').decode('ascii'),
+                                fmt.rstrip(b'\0').decode('ascii'),
+                                offset))
+
+        self.names = [f[0] for f in self.fields]
+        self._structs = [(struct.Struct(_CODES[f[1]]), f[2])
+                         for f in self.fields]
+
+    def close(self):
+        self._map.close()
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def written(self):
+        """
+        Return the number of records written since the file was created.
+        """
+        return _WRITE_INDEX.unpack_from(self._map, _WRITE_INDEX_OFFSET)[0]
+
+    def dtype(self):
+        """
+        Return the numpy structured dtype of a record.
+        """
+        import numpy
+        return numpy.dtype({ 'names'   : self.names,
+                             'formats' : [f[1] for f in self.fields],
+                             'offsets' : [f[2] for f in self.fields],
+                             'itemsize': self.slot_size })
+
+    def raw(self, start = 0):
+        """
+        Yield (index, bytes) for every complete record still in the ring,
+        oldest first.
+
+        :param start: index of the first record wanted.
+        """
+        end = self.written()
+        start = max(start, end - self.capacity, 0)
+
+        for index in range(start, end):
+            offset = self.header_size + (index % self.capacity) * self.slot_size
+            seq = _SEQ.unpack_from(self._map, offset)[0]
+            if seq != 2 * index + 2:
+                continue
+
+            data = self._map[offset:offset + self.slot_size]
+
+            # The writer may have wrapped around while we copied the slot
+            if _SEQ.unpack_from(self._map, offset)[0] != seq:
+                continue
+
+            yield index, data
+
+    def records(self, start = 0):
+        """
+        Yield every complete record still in the ring as a dict, oldest first.
+
+        :param start: index of the first record wanted.
+        """
+        for _, data in self.raw(start):
+            yield dict((name, s.unpack_from(data, offset)[0])
+                       for name, (s, offset) in zip(self.names, self._structs))
+
+    def array(self, start = 0):
+        """
+        Return the complete records still in the ring as a numpy structured
+        array.
+
+        :param start: index of the first record wanted.
+        """
+        import numpy
+        data = b''.join(d for _, d in self.raw(start))
+        return numpy.frombuffer(data, dtype = self.dtype())
+
+
+def to_csv(reader, out):
+    """
+    Write every record of a ring file as CSV.
+
+    :param reader: RingReader.
+    :param out:    file object.
+    """
+    writer = csv.writer(out)
+    writer.writerow(reader.names)
+    for record in reader.records():
+        writer.writerow([record[name] for name in reader.names])
+
+
+def to_parquet(reader, path):
+    """
+    Write every record of a ring file as Parquet (requires pyarrow).
+
+    :param reader: RingReader.
+    :param path:   destination path.
+    """
+    import pyarrow
+    import pyarrow.parquet
+
+    columns = dict((name, []) for name in reader.names)
+    for record in reader.records():
+        for name in reader.names:
+            columns[name].append(record[name])
+
+    table = pyarrow.Table.from_arrays(
+        [pyarrow.array(columns[name]) for name in reader.names],
+        names = reader.names)
+    pyarrow.parquet.write_table(table, path)
+
+
+def main(argv = None):
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description = 'Convert a perfmon ring file to CSV or Parquet.')
+    parser.add_argument('ring', help = 'ring file written by Sampler')
+    parser.add_argument('-o', '--output', default = '-',
+                        help = 'output file (default: CSV on stdout)')
+    parser.add_argument('-f', '--format', choices = ('csv', 'parquet'),
+                        help = 'output format (default: from the output name)')
+    args = parser.parse_args(argv)
+
+    fmt = args.format
+    if fmt is None:
+        fmt = 'parquet' if args.output.endswith('.parquet') else 'csv'
+
+    with RingReader(args.ring) as reader:
+        if fmt == 'parquet':
+            if args.output == '-':
+                parser.error('Parquet output requires --output')
+            to_parquet(reader, args.output)
+        elif args.output == '-':
+            to_csv(reader, sys.stdout)
+        else:
+            with open(args.output, 'w') as out:
+                to_csv(reader, out)
+
+
+if __name__ == '__main__':
+    main()
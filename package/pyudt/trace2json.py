@@ -0,0 +1,184 @@
+"""
+:module: trace2json.py
+
+--------------------------------------------------------------------------------
+Convert the binary event traces written by udt4_ext.dump_trace() to the
+Chrome trace event format, which can be opened in Perfetto
+(https://ui.perfetto.dev) or chrome://tracing.
+--------------------------------------------------------------------------------
+Every thread of the traced process becomes a track. Binding calls (send, recv,
+epoll_wait...) are slices, with the time spent inside UDT with the GIL
+released nested in them and the wait to reacquire the GIL drawn after it.
+Socket lifecycle events (create, bind, connect, accept, close) are instants.
+
+    pyudt.set_tracing(True)
+    ...
+    pyudt.dump_trace('/tmp/udt.trace')
+
+Command line:
+
+    python -m pyudt.trace2json /tmp/udt.trace -o udt.json
+--------------------------------------------------------------------------------
+"""
+
+import json
+import struct
+import sys
+
+
+MAGIC   = b'PYUDTTRC'
+VERSION = 1
+
+# magic, version, event_size, type_count, site_count, thread_count, pid,
+# clock_offset_ns, reserved
+_HEADER = struct.Struct('<8s6Iq24x')
+_NAME   = struct.Struct('<32s')
+# tid, reserved, count, lost
+_THREAD = struct.Struct('<IIQQ')
+# time_ns, socket, value, type, site, reserved
+_EVENT  = struct.Struct('<qqqHHI')
+
+
+class Trace(object):
+    """
+    Content of a trace file.
+
+    :param path: path of the trace file.
+
+    Attributes:
+        pid:     process that wrote the trace.
+        threads: list of (tid, lost, events), events being lists of
+                 (time_ns, type, site, socket, value) tuples, oldest first.
+                 Times are CLOCK_REALTIME, lost is the number of events
+                 overwritten before the dump.
+    """
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            data = f.read()
+
+        (magic, version, event_size, type_count, site_count, thread_count,
+         self.pid, clock_offset_ns) = _HEADER.unpack_from(data, 0)
+
+        if magic != MAGIC:
+            raise ValueError('%s is not a trace file' % path)
+        if version != VERSION:
+            raise ValueError('Unsupported trace file version %d' % version)
+        if event_size != _EVENT.size:
+            raise ValueError('Unexpected event size %d' % event_size)
+
+        offset = _HEADER.size
+        names = []
+        for i in range(type_count + site_count):
+            names.append(_NAME.unpack_from(data, offset)[0]
+                         .rstrip(b'\0').decode('ascii'))
+            offset += _NAME.size
+        self.types = names[:type_count]
+        self.sites = names[type_count:]
+
+        self.threads = []
+        for i in range(thread_count):
+            tid, _, count, lost = _THREAD.unpack_from(data, offset)
+            offset += _THREAD.size
+
+            events = []
+            for j in range(count):
+                time_ns, socket, value, type_id, site, _ = \
+                    _EVENT.unpack_from(data, offset)
+                offset += _EVENT.size
+                events.append((time_ns + clock_offset_ns,
+                               self.types[type_id], self.sites[site],
+                               socket, value))
+            self.threads.append((tid, lost, events))
+
+
+def _us(time_ns):
+    return time_ns / 1000.0
+
+
+def to_events(trace):
+    """
+    Return the Chrome trace events of a trace.
+
+    :param trace: Trace.
+    """
+    out = []
+    for tid, lost, events in trace.threads:
+        base = { 'pid': trace.pid, 'tid': tid }
+        out.append(dict(base, ph = 'M', name = 'thread_name',
+                        args = { 'name': 'thread %d' % tid }))
+        if lost:
+            out.append(dict(base, ph = 'i', s = 't', name = 'events lost',
+                            ts = _us(events[0][0]) if events else 0,
+                            args = { 'lost': lost }))
+
+        # The oldest events may have been overwritten: drop the ends of
+        # slices whose beginning is missing
+        open_calls = 0
+        open_udt = 0
+
+        for time_ns, kind, site, socket, value in events:
+            ev = dict(base, ts = _us(time_ns))
+
+            if kind == 'call_begin':
+                open_calls += 1
+                ev.update(ph = 'B', cat = 'call', name = site,
+                          args = { 'socket': socket })
+            elif kind == 'call_end':
+                if open_calls == 0:
+                    continue
+                open_calls -= 1
+                ev.update(ph = 'E', cat = 'call', name = site,
+                          args = { 'result': value })
+            elif kind == 'gil_release':
+                open_udt += 1
+                ev.update(ph = 'B', cat = 'udt', name = 'udt::' + site)
+            elif kind == 'gil_acquire':
+                if open_udt == 0:
+                    continue
+                open_udt -= 1
+                # The GIL wait ends at this event: the UDT call returned
+                # "value" nanoseconds earlier
+                ev.update(ph = 'E', cat = 'udt', name = 'udt::' + site,
+                          ts = _us(time_ns - value))
+                out.append(ev)
+                ev = dict(base, ph = 'X', cat = 'gil', name = 'gil wait',
+                          ts = _us(time_ns - value), dur = _us(value))
+            else:
+                ev.update(ph = 'i', s = 't', cat = 'socket', name = kind,
+                          args = { 'socket': socket, 'value': value })
+            out.append(ev)
+    return out
+
+
+def to_json(trace, out):
+    """
+    Write a trace in the Chrome trace event format.
+
+    :param trace: Trace.
+    :param out:   file object.
+    """
+    json.dump({ 'traceEvents': to_events(trace),
+                'displayTimeUnit': 'ns' }, out)
+
+
+def main(argv = None):
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description = 'Convert a binary event trace to Chrome/Perfetto JSON.')
+    parser.add_argument('trace', help = 'trace file written by dump_trace()')
+    parser.add_argument('-o', '--output', default = '-',
+                        help = 'output file (default: stdout)')
+    args = parser.parse_args(argv)
+
+    trace = Trace(args.trace)
+    if args.output == '-':
+        to_json(trace, sys.stdout)
+    else:
+        with open(args.output, 'w') as out:
+            to_json(trace, out)
+
+
+if __name__ == '__main__':
+    main()
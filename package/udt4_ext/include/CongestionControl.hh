@@ -0,0 +1,207 @@
+#ifndef __PYUDT_CONGESTIONCONTROL_HH_
+#define __PYUDT_CONGESTIONCONTROL_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+#include <udt/ccc.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <stddef.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Native congestion controllers, selected per socket through UDT_CC.
+ *
+ * Every controller is a CCC subclass that also implements the Controller
+ * interface: UDT instantiates it for each connection from a factory holding
+ * the algorithm name and its parameters, and the controller publishes its
+ * state on every ACK so that it can be read from Python at any time.
+ */
+namespace cc {
+
+/**
+ * Named numeric values: parameters of a controller.
+ */
+typedef std::map<std::string, double> Params;
+
+/**
+ * Published state of a controller. A plain structure, copied under a mutex,
+ * so that publishing on every ACK does not allocate.
+ */
+struct State
+{
+    /**
+     * Largest number of algorithm-specific values.
+     */
+    static const size_t max_values = 8;
+
+    double pkt_snd_period_us;
+    double cwnd_pkts;
+    double rtt_us;
+    double bandwidth_pps;
+    double rcv_rate_pps;
+    double send_rate_mbps;
+
+    /**
+     * Current mode of the algorithm (static string), or nullptr.
+     */
+    const char* mode;
+
+    /**
+     * Algorithm-specific values, named by static strings.
+     */
+    size_t      count;
+    const char* names[max_values];
+    double      values[max_values];
+
+    /**
+     * Add an algorithm-specific value; extra values are ignored.
+     */
+    void add(const char* name, double value)
+    {
+        if (count == max_values) return;
+        names[count] = name;
+        values[count] = value;
+        ++count;
+    }
+};
+
+/**
+ * Parameter of an algorithm, with its default value. Values must be finite
+ * and positive; allow_zero also accepts 0, meaning no limit.
+ */
+struct Param
+{
+    const char* name;
+    double      value;
+    const char* help;
+    bool        allow_zero;
+};
+
+/**
+ * Monitoring side of a controller.
+ */
+class Controller
+{
+public:
+    Controller();
+    virtual ~Controller();
+
+    /**
+     * Apply the parameters, completed with their defaults. Called before
+     * UDT calls CCC::init().
+     */
+    virtual void configure(const Params& params);
+
+    /**
+     * Name of the algorithm.
+     */
+    const char* algorithm() const;
+    void setAlgorithm(const char* algorithm);
+
+    /**
+     * Copy the last published state.
+     * @param state published values.
+     */
+    void snapshot(State& state) const;
+
+protected:
+    /**
+     * Replace the published state. Called from the UDT threads.
+     */
+    void store(const State& state);
+
+private:
+    const char* algorithm_;
+
+    mutable std::mutex mutex_;
+    State state_;
+};
+
+/**
+ * Register a live controller under its CCC side. UDT deletes the CCC of a
+ * socket when it frees the socket, from its own threads: state() only reads
+ * a CCC returned by UDT_CC while it is registered, under the registry lock.
+ */
+void track(const CCC* ccc, Controller* controller);
+void untrack(const CCC* ccc);
+
+/**
+ * Controller on top of a CCC class (CCC itself or CUDTCC), publishing the
+ * congestion state common to every algorithm.
+ */
+template <class Base>
+class Monitored : public Base, public Controller
+{
+public:
+    Monitored()
+    {
+        track(this, this);
+    }
+
+    ~Monitored()
+    {
+        untrack(this);
+    }
+
+protected:
+    /**
+     * Publish the common state and the values added by collect().
+     * @param mode current mode of the algorithm (static string), or nullptr.
+     */
+    void publish(const char* mode = nullptr)
+    {
+        State state;
+        double period = this->m_dPktSndPeriod;
+
+        state.pkt_snd_period_us = period;
+        state.cwnd_pkts         = this->m_dCWndSize;
+        state.rtt_us            = this->m_iRTT;
+        state.bandwidth_pps     = this->m_iBandwidth;
+        state.rcv_rate_pps      = this->m_iRcvRate;
+        state.send_rate_mbps    = (period > 0.)?
+                                  this->m_iMSS * 8. / period : 0.;
+        state.mode              = mode;
+        state.count             = 0;
+        collect(state);
+        store(state);
+    }
+
+    /**
+     * Add the algorithm-specific values to the published state.
+     */
+    virtual void collect(State&) const {}
+};
+
+/**
+ * Select the congestion controller of a socket that is not connected yet
+ * (or of a listening socket, inherited by the accepted sockets).
+ * @param u UDT socket.
+ * @param name algorithm name, see algorithms().
+ * @param py_params dict of parameters; missing ones take their default.
+ */
+void set(UDTSOCKET u, const std::string& name, py::dict py_params) throw();
+
+/**
+ * Return the state of the controller of a connected socket: the algorithm
+ * name, its mode and its published values. The algorithm is None for
+ * controllers not created by set().
+ * @param u UDT socket.
+ */
+py::dict state(UDTSOCKET u) throw();
+
+/**
+ * Return the available algorithms, with their description and parameters.
+ */
+py::dict algorithms();
+
+} // namespace cc
+
+} // namespace pyudt4
+
+#endif // __PYUDT_CONGESTIONCONTROL_HH_
@@ -0,0 +1,67 @@
+#ifndef __PYUDT_COUNTERS_HH_
+#define __PYUDT_COUNTERS_HH_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pyudt4 {
+
+/**
+ * Process-wide binding counters, updated with relaxed atomics so they can be
+ * read from any thread without the GIL.
+ */
+namespace counters {
+
+/**
+ * X-macro listing every counter: X(name, help)
+ */
+#define PYUDT_COUNTERS(X)                                                   \
+    X(sockets_created,         "UDT sockets created by the binding")        \
+    X(sockets_closed,          "UDT sockets closed by the binding")         \
+    X(connections_accepted,    "Connections accepted")                      \
+    X(connections_established, "Connections established by connect()")     \
+    X(udt_errors,              "UDT errors raised as Python exceptions")    \
+    X(would_block,             "Non-blocking calls that would have blocked")
+
+enum Id
+{
+#define PYUDT_COUNTER_ID(name, help) name,
+    PYUDT_COUNTERS(PYUDT_COUNTER_ID)
+#undef PYUDT_COUNTER_ID
+    count
+};
+
+/**
+ * Description of a counter.
+ */
+struct Info
+{
+    const char* name;
+    const char* help;
+};
+
+extern const Info info[count];
+extern std::atomic<uint64_t> values[count];
+
+/**
+ * Increment a counter.
+ */
+inline void add(Id id, uint64_t n = 1)
+{
+    values[id].fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * Read a counter.
+ */
+inline uint64_t get(Id id)
+{
+    return values[id].load(std::memory_order_relaxed);
+}
+
+} // namespace counters
+
+} // namespace pyudt4
+
+#endif // __PYUDT_COUNTERS_HH_
@@ -6,18 +6,82 @@
 #include <log4cxx/propertyconfigurator.h>
 #include <log4cxx/helpers/exception.h>
 
-#ifdef NDEBUG
-#   define PYUDT_DEBUG_ONLY(X)
-#else
-#   define PYUDT_DEBUG_ONLY(X) X
-#endif // NDEBUG
+#include <atomic>
+#include <sstream>
+#include <string>
+
+// Lowest level compiled in (see pyudt4::logging::Level). Trace and debug
+// logging is only compiled in debug builds, unless PYUDT_LOG_LEVEL is set.
+#ifndef PYUDT_LOG_LEVEL
+#   ifdef NDEBUG
+#       define PYUDT_LOG_LEVEL 2
+#   else
+#       define PYUDT_LOG_LEVEL 0
+#   endif
+#endif // PYUDT_LOG_LEVEL
 
 namespace pyudt4 {
 
-//log4cxx::BasicConfigurator::configure();
-// Define a static logger variable so that it references the
-// Logger instance named "pyudt".
-static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("pyudt"));
+namespace logging {
+
+enum Level
+{
+    TRACE = 0,
+    DEBUG = 1,
+    INFO  = 2,
+    WARN  = 3,
+    ERROR = 4,
+    OFF   = 5
+};
+
+/**
+ * Lowest level logged at runtime.
+ */
+extern std::atomic<int> runtime_level;
+
+/**
+ * Whether messages are handed over to the background logging thread.
+ */
+extern std::atomic<bool> async_enabled;
+
+/**
+ * Whether a level is logged. Costs one relaxed atomic load.
+ */
+inline bool enabled(Level level)
+{
+    return level >= runtime_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * The "pyudt" logger, looked up once.
+ */
+log4cxx::Logger* logger();
+
+/**
+ * Log a formatted message, either directly or through the background
+ * logging thread.
+ */
+void write(Level level, const std::string& message,
+           const char* file, const char* function, int line);
+
+/**
+ * Set the runtime level, of both the binding and the "pyudt" logger.
+ */
+void set_level(Level level);
+
+/**
+ * Start or stop the background logging thread. While it runs, logging only
+ * formats the message and pushes it to a lock-free queue; messages are
+ * dropped when the queue is full.
+ */
+void set_async(bool async);
+
+/**
+ * Number of messages dropped because the background queue was full.
+ */
+uint64_t dropped();
+
+} // namespace logging
 
 /**
  * Simple logger class to facilitate logging with Log4CXX.
@@ -31,37 +95,54 @@ public:
         log4cxx::BasicConfigurator::configure();
 
         // Set default level to TRACE
-        logger->setLevel(log4cxx::Level::getTrace());
+        logging::set_level(logging::TRACE);
 
-        LOG4CXX_INFO(logger, "Starting logging.");
+        LOG4CXX_INFO(logging::logger(), "Starting logging.");
     }
 
-    static void load_logger_configuration(std::string filename)
-    {
-        log4cxx::PropertyConfigurator::configure(filename.c_str());
-    }
+    static void load_logger_configuration(std::string filename);
+
+    static void set_level(std::string level);
+    static std::string get_level();
+    static void set_async(bool async);
+    static bool get_async();
+    static uint64_t dropped();
 };
 
 } // namespace pyudt4
 
-#define PYUDT_LOG_DEBUG(expression)       \
-    PYUDT_DEBUG_ONLY(LOG4CXX_DEBUG        \
-    (log4cxx::Logger::getLogger("pyudt"), \
-     expression))
-
-#define PYUDT_LOG_TRACE(expression)       \
-    PYUDT_DEBUG_ONLY(LOG4CXX_TRACE        \
-    (log4cxx::Logger::getLogger("pyudt"), \
-     expression))
-
-#define PYUDT_LOG_INFO(expression)        \
-     LOG4CXX_INFO                         \
-    (log4cxx::Logger::getLogger("pyudt"), \
-     expression)
-
-#define PYUDT_LOG_ERROR(expression)       \
-     LOG4CXX_ERROR                        \
-    (log4cxx::Logger::getLogger("pyudt"), \
-     expression)
+#define PYUDT_LOG_AT(level, expression)                                    \
+    do                                                                     \
+    {                                                                      \
+        if (::pyudt4::logging::enabled(level))                             \
+        {                                                                  \
+            std::ostringstream pyudt_log_ss_;                              \
+            pyudt_log_ss_ << expression;                                   \
+            ::pyudt4::logging::write(level, pyudt_log_ss_.str(),           \
+                                     __FILE__, __func__, __LINE__);        \
+        }                                                                  \
+    } while (0)
+
+#define PYUDT_LOG_DISABLED(expression) do {} while (0)
+
+#if PYUDT_LOG_LEVEL <= 0
+#   define PYUDT_LOG_TRACE(expression) \
+        PYUDT_LOG_AT(::pyudt4::logging::TRACE, expression)
+#else
+#   define PYUDT_LOG_TRACE(expression) PYUDT_LOG_DISABLED(expression)
+#endif
+
+#if PYUDT_LOG_LEVEL <= 1
+#   define PYUDT_LOG_DEBUG(expression) \
+        PYUDT_LOG_AT(::pyudt4::logging::DEBUG, expression)
+#else
+#   define PYUDT_LOG_DEBUG(expression) PYUDT_LOG_DISABLED(expression)
+#endif
+
+#define PYUDT_LOG_INFO(expression) \
+    PYUDT_LOG_AT(::pyudt4::logging::INFO, expression)
+
+#define PYUDT_LOG_ERROR(expression) \
+    PYUDT_LOG_AT(::pyudt4::logging::ERROR, expression)
 
 #endif // __PYUDT_DEBUG_HH_
@@ -90,6 +90,22 @@ public:
     int wait(int64_t ms_timeout, bool do_uread = true, bool do_uwrite = true,
              bool do_sread = false, bool do_swrite = false) throw ();
 
+    /**
+     * Get the UDT sockets registered in the epoll.
+     */
+    const std::map<UDTSOCKET, Socket*>& getSockets() const;
+
+    /**
+     * Sample the performance of every UDT socket of the epoll in one call,
+     * without holding the GIL.
+     * @param py_out writable buffer of records, e.g. a numpy array of dtype
+     *        pyudt.perfmon_record_dtype(). Sockets that do not fit are
+     *        skipped.
+     * @param clear whether to clear the local measurements after sampling.
+     * @return number of records written.
+     */
+    int perfmon_all(py::object py_out, bool clear = false) const throw();
+
     /**
      * Get the UDT sockets available for reading.
      */
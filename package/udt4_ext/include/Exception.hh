@@ -30,8 +30,48 @@ private:
 std::string parse_python_exception();
 void translatePythonException(const boost::python::error_already_set& e);
 void translateException(const Exception& e);
+
+/**
+ * Raise the last UDT error as a Python exception.
+ *
+ * Would-block (EASYNCSND, EASYNCRCV) and timeout (ETIMEOUT) errors are
+ * routine in non-blocking mode: they raise preallocated WouldBlockError and
+ * UDTTimeoutError exceptions, carrying their UDT error code, without
+ * formatting nor logging. Would-blocks are counted apart from the errors.
+ * Every other error is logged and raised as a UDTError (code, message).
+ */
 void translateUDTError() throw();
 
+/**
+ * Raise the preallocated UDTTimeoutError, e.g. when a deadline passed.
+ */
+void translateTimeout() throw();
+
+/**
+ * Log an error and raise it as a Python exception.
+ * @param message description of the error.
+ */
+void translateError(const std::string& message);
+
+/**
+ * Log an invalid argument value and raise it as a ValueError.
+ * @param message description of the error.
+ */
+void translateValueError(const std::string& message);
+
+/**
+ * Raise an exception describing the failed system call (from errno).
+ * @param what description of the failed operation.
+ */
+void translateSystemError(const std::string& what);
+
+/**
+ * Create the UDTError, WouldBlockError and UDTTimeoutError exception classes
+ * in the current module scope. UDTError derives from TypeError, so that
+ * existing error handling keeps working.
+ */
+void registerUDTExceptions();
+
 } // namespace pyudt4
 
 #endif // __PYUDT_EXCEPTION_HH_
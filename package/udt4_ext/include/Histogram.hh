@@ -0,0 +1,137 @@
+#ifndef __PYUDT_HISTOGRAM_HH_
+#define __PYUDT_HISTOGRAM_HH_
+
+#include <boost/python.hpp>
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Log-linear histogram of non-negative integer values (typically durations
+ * in nanoseconds).
+ *
+ * Every power of two is split into sub_count linear sub-buckets, so the
+ * relative error of a bucket is below 1/sub_count over the whole range, as
+ * in HDR histograms. Values above max_value are counted in the last bucket.
+ */
+class Histogram
+{
+public:
+    static const int      sub_bits     = 3;
+    static const int      sub_count    = 1 << sub_bits;
+    static const int      max_exponent = 40;
+    static const size_t   bucket_count = (max_exponent - sub_bits + 1) * sub_count;
+    static const uint64_t max_value    = (uint64_t(1) << max_exponent) - 1;
+
+    Histogram();
+
+    /**
+     * Index of the bucket of a value.
+     */
+    static size_t bucket(uint64_t value);
+
+    /**
+     * Smallest value of a bucket.
+     */
+    static uint64_t lower_bound(size_t bucket);
+
+    /**
+     * Largest value of a bucket.
+     */
+    static uint64_t upper_bound(size_t bucket);
+
+    /**
+     * Record a value.
+     */
+    void record(uint64_t value, uint64_t count = 1);
+
+    /**
+     * Add the counts of another histogram.
+     */
+    void merge(const Histogram& other);
+
+    /**
+     * Remove the counts of an earlier snapshot of this histogram.
+     */
+    void subtract(const Histogram& other);
+
+    /**
+     * Forget every value.
+     */
+    void clear();
+
+    /**
+     * Number of values recorded.
+     */
+    uint64_t count() const;
+
+    /**
+     * Approximate quantile (upper bound of the bucket holding it).
+     * @param q quantile, between 0 and 1.
+     */
+    uint64_t quantile(double q) const;
+
+    /**
+     * Return a dict with the count, sum, max, usual percentiles and the
+     * non-empty buckets as (upper bound, count) pairs.
+     * @param scale factor applied to the reported values (e.g. 1e-9 to report
+     *        nanoseconds in seconds).
+     */
+    py::dict toPython(double scale = 1.) const;
+
+public:
+    uint64_t counts[bucket_count];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+
+/**
+ * Histogram with a single writer thread and any number of reader threads.
+ * The writer only uses relaxed loads and stores, no atomic read-modify-write.
+ */
+class ShardHistogram
+{
+public:
+    ShardHistogram();
+
+    /**
+     * Record a value. Only called from the owner thread.
+     */
+    void record(uint64_t value)
+    {
+        bump(counts_[Histogram::bucket(value)], 1);
+        bump(total_, 1);
+        bump(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed))
+            max_.store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * Add the current counts to a histogram.
+     */
+    void mergeInto(Histogram& out) const;
+
+private:
+    static void bump(std::atomic<uint64_t>& c, uint64_t n)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> counts_[Histogram::bucket_count];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_HISTOGRAM_HH_
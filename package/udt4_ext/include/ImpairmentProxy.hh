@@ -0,0 +1,197 @@
+#ifndef __PYUDT_IMPAIRMENTPROXY_HH_
+#define __PYUDT_IMPAIRMENTPROXY_HH_
+
+#include <boost/python.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * UDP relay injecting network impairments between two UDT endpoints.
+ *
+ * The proxy listens on a local UDP port and relays every datagram to a
+ * target address; each client address gets its own upstream UDP socket, so
+ * the replies of the target find their way back. Both directions (forward:
+ * client to target, reverse: target to client) have their own delay,
+ * jitter, random or bursty loss, reordering, duplication and token-bucket
+ * rate limit, applied by a native thread that never takes the GIL.
+ *
+ * Nothing requires root, netem or special hardware: UDT endpoints simply
+ * connect to the proxy port instead of the target port. Random decisions
+ * come from a seeded generator, so a run can be replayed.
+ */
+class ImpairmentProxy
+{
+public:
+
+    /**
+     * Direction of the relayed traffic.
+     */
+    enum Direction
+    {
+        FORWARD = 0,    /**< from the clients to the target */
+        REVERSE = 1     /**< from the target to the clients */
+    };
+
+    /**
+     * Impairments applied to one direction.
+     */
+    struct Impairment
+    {
+        /** Constant one-way delay, in milliseconds. */
+        double delay_ms;
+
+        /** Uniform jitter added to the delay, in [-jitter_ms, jitter_ms].
+         *  Packets may be reordered by the jitter, as with netem. */
+        double jitter_ms;
+
+        /** Packet loss probability. */
+        double loss;
+
+        /** Mean length of the loss bursts. Above 1, losses follow a
+         *  two-state (Gilbert-Elliott) model with the same average rate. */
+        double loss_burst;
+
+        /** Probability for a packet to be held back by reorder_ms. */
+        double reorder;
+
+        /** Extra delay of the reordered packets, in milliseconds. */
+        double reorder_ms;
+
+        /** Probability for a packet to be sent twice. */
+        double duplicate;
+
+        /** Token bucket rate, in Mb/s (0 for no limit). */
+        double rate_mbps;
+
+        /** Token bucket depth, in bytes. */
+        double burst_bytes;
+
+        /** Bytes allowed to wait for tokens before packets are dropped. */
+        double queue_bytes;
+
+        Impairment();
+    };
+
+    /**
+     * Constructor. Binds the listening socket.
+     * @param target_ip IP address of the relayed endpoint.
+     * @param target_port UDP port of the relayed endpoint.
+     * @param ip local IP address to listen on.
+     * @param port UDP port (0 for any available port).
+     * @param seed seed of the random decisions.
+     */
+    ImpairmentProxy(std::string target_ip, uint16_t target_port,
+                    std::string ip = "127.0.0.1", uint16_t port = 0,
+                    uint64_t seed = 1);
+
+    /**
+     * Destructor. Stops the relay and closes every socket.
+     */
+    ~ImpairmentProxy();
+
+    /**
+     * Start relaying.
+     */
+    void start();
+
+    /**
+     * Stop relaying and wait for the relay thread to finish. Packets still
+     * delayed are dropped.
+     */
+    void stop();
+
+    /**
+     * Whether the relay is running.
+     */
+    bool isRunning() const;
+
+    /**
+     * Replace the impairments of a direction. Missing keys take their
+     * default value (no impairment).
+     * @param params dict of Impairment fields, e.g. {"delay_ms": 20}.
+     * @param direction "forward", "reverse" or "both".
+     */
+    void configure(py::dict params, std::string direction = "both") throw();
+
+    /**
+     * Replace the impairments of a direction.
+     */
+    void setImpairment(Direction direction, const Impairment& impairment);
+
+    /**
+     * Return the impairments of a direction as a dict.
+     * @param direction "forward" or "reverse".
+     */
+    py::dict impairment(std::string direction) throw();
+
+    /**
+     * Return the packet counters of both directions.
+     */
+    py::dict stats();
+
+    /**
+     * Return the UDP port the proxy listens on.
+     */
+    uint16_t getPort() const;
+
+private:
+    struct Link;
+    struct Queue;
+    struct Clients;
+
+    /**
+     * Relay loop.
+     */
+    void run();
+
+    /**
+     * Read the pending datagrams of a socket, up to a batch, and schedule
+     * them.
+     */
+    void receive(int sock, int64_t now_ns);
+
+    /**
+     * Apply the impairments of a direction to a datagram and schedule the
+     * resulting copies.
+     */
+    void schedule(Direction direction, int sock, const void* addr,
+                  const char* data, size_t size, int64_t now_ns);
+
+    /**
+     * Send the datagrams that are due.
+     * @return time until the next one is due, in nanoseconds (-1 if none).
+     */
+    int64_t flush(int64_t now_ns);
+
+private:
+    int listener_;
+    uint16_t port_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+    /**
+     * Protects links_ (impairments, random state and counters).
+     */
+    std::mutex mutex_;
+    std::unique_ptr<Link> links_[2];
+
+    /**
+     * Only used by the relay thread.
+     */
+    std::unique_ptr<Queue> queue_;
+    std::unique_ptr<Clients> clients_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_IMPAIRMENTPROXY_HH_
@@ -0,0 +1,135 @@
+#ifndef __PYUDT_METRICSEXPORTER_HH_
+#define __PYUDT_METRICSEXPORTER_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+// Forward declarations
+class Epoll;
+
+/**
+ * Embedded HTTP endpoint exposing UDT and binding statistics in the
+ * OpenMetrics text format.
+ *
+ * A native thread serves GET /metrics on a local TCP socket. Every scrape
+ * samples UDT::perfmon for the registered sockets and reports per-socket and
+ * per-peer aggregates, along with the binding counters. The thread never
+ * takes the GIL, and only holds the registration lock while copying the
+ * list of descriptors.
+ */
+class MetricsExporter
+{
+public:
+
+    /**
+     * Constructor. Binds the listening socket.
+     * @param ip local IP address to listen on.
+     * @param port TCP port (0 for any available port).
+     */
+    MetricsExporter(std::string ip = "127.0.0.1", uint16_t port = 0);
+
+    /**
+     * Destructor. Stops the server and closes the listening socket.
+     */
+    ~MetricsExporter();
+
+    /**
+     * Start serving.
+     */
+    void start();
+
+    /**
+     * Stop serving and wait for the server thread to finish.
+     */
+    void stop();
+
+    /**
+     * Whether the server is running.
+     */
+    bool isRunning() const;
+
+    /**
+     * Register a socket.
+     * @param py_socket socket to export.
+     */
+    void add(py::object py_socket) throw();
+
+    /**
+     * Register every socket currently in an epoll.
+     * @param epoll epoll whose sockets should be exported.
+     */
+    void add_epoll(const Epoll& epoll);
+
+    /**
+     * Unregister a socket.
+     * @param py_socket socket to forget.
+     */
+    void remove(py::object py_socket) throw();
+
+    /**
+     * Return the TCP port the exporter listens on.
+     */
+    uint16_t getPort() const;
+
+    /**
+     * Render the current metrics, as served on GET /metrics.
+     */
+    std::string render();
+
+private:
+    /**
+     * Server loop.
+     */
+    void run();
+
+    /**
+     * Answer one HTTP request.
+     */
+    void serve(int client);
+
+    /**
+     * Render the current metrics. Called without the GIL.
+     */
+    std::string scrape();
+
+private:
+    int listener_;
+    uint16_t port_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+    /**
+     * Packet counters of a socket at the previous scrape, from which the
+     * rates are computed.
+     */
+    struct Counts
+    {
+        int64_t ms_timestamp;
+        int64_t pkt_sent;
+        int64_t pkt_recv;
+    };
+
+    /**
+     * Protects sockets_ and previous_.
+     */
+    std::mutex mutex_;
+    std::set<UDTSOCKET> sockets_;
+    std::map<UDTSOCKET, Counts> previous_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_METRICSEXPORTER_HH_
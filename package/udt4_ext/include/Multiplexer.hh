@@ -0,0 +1,140 @@
+#ifndef __PYUDT_MULTIPLEXER_HH_
+#define __PYUDT_MULTIPLEXER_HH_
+
+#include "Socket.hh"
+
+#include <vector>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Owner of a tuned UDP socket shared by many UDT sockets.
+ *
+ * UDT multiplexes every socket bound to the same UDP port over a single
+ * channel. The multiplexer creates that UDP socket with large kernel buffers
+ * and hands out UDT sockets bound to it, so that thousands of peers only cost
+ * one kernel socket.
+ *
+ * UDT takes ownership of the UDP socket once a UDT socket is bound to it, and
+ * closes it when the last of them is released. The multiplexer therefore keeps
+ * an internal anchor socket bound for its whole lifetime.
+ */
+class Multiplexer
+{
+public:
+
+    /**
+     * Default kernel buffer size of the UDP socket, in bytes.
+     */
+    static const int DEFAULT_UDP_BUFFER = 8 * 1024 * 1024;
+
+    /**
+     * Create a multiplexer on any available local port.
+     */
+    Multiplexer();
+
+    /**
+     * Create a multiplexer on a known local address.
+     * @param ip IP address (None for any address).
+     * @param port port (0 for any available port).
+     * @param udp_sndbuf kernel send buffer size of the UDP socket, in bytes.
+     * @param udp_rcvbuf kernel receive buffer size of the UDP socket, in bytes.
+     */
+    Multiplexer(const char* ip, uint16_t port,
+                int udp_sndbuf = DEFAULT_UDP_BUFFER,
+                int udp_rcvbuf = DEFAULT_UDP_BUFFER);
+
+    /**
+     * Destructor.
+     */
+    ~Multiplexer();
+
+    /**
+     * Release the multiplexer. Sockets already created keep working until
+     * they are closed.
+     */
+    void close();
+
+    /**
+     * Create a new UDT socket bound to the shared UDP socket.
+     * @return the new socket, ready to listen or connect.
+     */
+    Socket_ptr socket() throw();
+
+    /**
+     * Return the descriptor of the shared UDP socket.
+     */
+    const SYSSOCKET& getUDPSocket() const;
+
+    /**
+     * Return the local port of the shared UDP socket.
+     */
+    const uint16_t& getPort() const;
+
+    /**
+     * Return the multiplexer's counters: sockets created and still active,
+     * bind errors, effective kernel buffer sizes and packet totals summed
+     * over the active sockets.
+     */
+    py::dict stats();
+
+private:
+    /**
+     * Create, tune and bind the UDP socket, then bind the anchor socket.
+     */
+    void open(const char* ip, uint16_t port);
+
+    /**
+     * Create a UDT socket bound to the UDP socket.
+     * @return descriptor of the new UDT socket.
+     */
+    UDTSOCKET bind_udt_socket() throw();
+
+    /**
+     * Drop the descriptors of the sockets that are no longer alive.
+     */
+    void prune();
+
+private:
+    /**
+     * Shared UDP socket descriptor.
+     */
+    SYSSOCKET udp_socket_;
+
+    /**
+     * Local port of the UDP socket.
+     */
+    uint16_t port_;
+
+    /**
+     * Requested kernel buffer sizes of the UDP socket.
+     */
+    int udp_sndbuf_;
+    int udp_rcvbuf_;
+
+    /**
+     * UDT socket keeping UDT's multiplexer (and the UDP socket) alive.
+     */
+    UDTSOCKET anchor_;
+
+    /**
+     * Descriptors of the UDT sockets created by this multiplexer.
+     */
+    std::vector<UDTSOCKET> descriptors_;
+
+    /**
+     * Number of sockets created since construction.
+     */
+    uint64_t sockets_created_;
+
+    /**
+     * Number of failed UDT binds.
+     */
+    uint64_t bind_errors_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_MULTIPLEXER_HH_
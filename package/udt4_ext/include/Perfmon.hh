@@ -0,0 +1,143 @@
+#ifndef __PYUDT_PERFMON_HH_
+#define __PYUDT_PERFMON_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+#include <stdint.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Access to UDT's performance monitoring (UDT::perfmon).
+ */
+namespace perfmon {
+
+/**
+ * X-macro listing every UDT::TRACEINFO field: X(C type, name)
+ */
+#define PYUDT_TRACEINFO_FIELDS(X)          \
+    X(int64_t, msTimeStamp)                \
+    X(int64_t, pktSentTotal)               \
+    X(int64_t, pktRecvTotal)               \
+    X(int,     pktSndLossTotal)            \
+    X(int,     pktRcvLossTotal)            \
+    X(int,     pktRetransTotal)            \
+    X(int,     pktSentACKTotal)            \
+    X(int,     pktRecvACKTotal)            \
+    X(int,     pktSentNAKTotal)            \
+    X(int,     pktRecvNAKTotal)            \
+    X(int64_t, usSndDurationTotal)         \
+    X(int64_t, pktSent)                    \
+    X(int64_t, pktRecv)                    \
+    X(int,     pktSndLoss)                 \
+    X(int,     pktRcvLoss)                 \
+    X(int,     pktRetrans)                 \
+    X(int,     pktSentACK)                 \
+    X(int,     pktRecvACK)                 \
+    X(int,     pktSentNAK)                 \
+    X(int,     pktRecvNAK)                 \
+    X(double,  mbpsSendRate)               \
+    X(double,  mbpsRecvRate)               \
+    X(int64_t, usSndDuration)              \
+    X(double,  usPktSndPeriod)             \
+    X(int,     pktFlowWindow)              \
+    X(int,     pktCongestionWindow)        \
+    X(int,     pktFlightSize)              \
+    X(double,  msRTT)                      \
+    X(double,  mbpsBandwidth)              \
+    X(int,     byteAvailSndBuf)            \
+    X(int,     byteAvailRcvBuf)
+
+/**
+ * numpy type string of a field type.
+ */
+template <class T> inline const char* format();
+template <> inline const char* format<int>()     { return "<i4"; }
+template <> inline const char* format<int64_t>() { return "<i8"; }
+template <> inline const char* format<double>()  { return "<f8"; }
+
+/**
+ * Description of a TRACEINFO field.
+ */
+struct Field
+{
+    const char* name;
+    const char* format;
+    size_t      offset;
+};
+
+/**
+ * Every TRACEINFO field, in declaration order.
+ */
+extern const Field fields[];
+extern const size_t field_count;
+
+/**
+ * Bulk sampling record: socket descriptor, socket state and its TRACEINFO.
+ */
+struct Record
+{
+    int32_t        descriptor;
+    int32_t        status;
+    UDT::TRACEINFO info;
+};
+
+/**
+ * Writable view over a Python buffer (numpy array, bytearray...), released
+ * when leaving the scope.
+ */
+class BufferView
+{
+public:
+    /**
+     * Acquire a writable buffer of at least min_len bytes.
+     * @param py_buffer object exporting the buffer protocol.
+     * @param min_len minimum size, in bytes.
+     * @param what description used in error messages.
+     */
+    BufferView(py::object py_buffer, size_t min_len, const char* what);
+    ~BufferView();
+
+    char* data() const;
+    size_t size() const;
+
+private:
+    Py_buffer view_;
+};
+
+/**
+ * Return the layout of UDT::TRACEINFO as a dict accepted by numpy.dtype:
+ * names, formats, offsets and itemsize.
+ */
+py::dict layout();
+
+/**
+ * Return the layout of a bulk sampling Record as a dict accepted by
+ * numpy.dtype.
+ */
+py::dict record_layout();
+
+/**
+ * Sample many sockets into an array of Records. Called without the GIL.
+ * @param sockets descriptors of the sockets to sample.
+ * @param count number of sockets.
+ * @param out destination records.
+ * @param clear whether to clear the local measurements after sampling.
+ */
+void sample(const UDTSOCKET* sockets, size_t count, char* out, bool clear);
+
+/**
+ * Sample a socket's performance directly into a Python buffer.
+ * @param u UDT socket.
+ * @param py_buffer writable buffer of at least sizeof(UDT::TRACEINFO) bytes.
+ * @param clear whether to clear the local measurements after sampling.
+ */
+void into(UDTSOCKET u, py::object py_buffer, bool clear) throw();
+
+} // namespace perfmon
+
+} // namespace pyudt4
+
+#endif // __PYUDT_PERFMON_HH_
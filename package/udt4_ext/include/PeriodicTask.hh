@@ -0,0 +1,88 @@
+#ifndef __PYUDT_PERIODICTASK_HH_
+#define __PYUDT_PERIODICTASK_HH_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace pyudt4 {
+
+/**
+ * Native thread running a task at a fixed period, without the GIL.
+ *
+ * Derived classes implement tick(), which is called with mutex_ held, and
+ * must call stop() in their destructor. Their Python entry points lock
+ * mutex_ through acquire(), so that a long tick() does not stall the other
+ * Python threads.
+ */
+class PeriodicTask
+{
+public:
+
+    /**
+     * Start the thread.
+     */
+    void start();
+
+    /**
+     * Stop the thread and wait for it to finish.
+     */
+    void stop();
+
+    /**
+     * Whether the thread is running.
+     */
+    bool isRunning();
+
+protected:
+    /**
+     * Constructor.
+     * @param interval_ms period, in milliseconds.
+     */
+    explicit PeriodicTask(int interval_ms);
+
+    virtual ~PeriodicTask();
+
+    /**
+     * Task run at every period, with mutex_ held.
+     */
+    virtual void tick() = 0;
+
+    /**
+     * Work run after every tick, without mutex_ held: e.g. socket option
+     * changes, which may wait for the socket locks.
+     */
+    virtual void after_tick();
+
+    /**
+     * Lock mutex_ with the GIL held: the GIL is released while waiting for
+     * tick() to finish.
+     */
+    std::unique_lock<std::mutex> acquire();
+
+protected:
+    /**
+     * Period, in milliseconds.
+     */
+    int interval_ms_;
+
+    /**
+     * Protects the state shared with tick().
+     */
+    std::mutex mutex_;
+
+private:
+    /**
+     * Thread loop.
+     */
+    void run();
+
+private:
+    std::thread thread_;
+    std::condition_variable cond_;
+    bool running_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_PERIODICTASK_HH_
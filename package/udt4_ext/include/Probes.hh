@@ -0,0 +1,40 @@
+#ifndef __PYUDT_PROBES_HH_
+#define __PYUDT_PROBES_HH_
+
+/**
+ * Static USDT tracepoints of the "pyudt" provider.
+ *
+ * A probe compiles to a single nop plus an ELF note describing where its
+ * arguments live, so it costs nothing until perf, bpftrace or SystemTap
+ * attach to it:
+ *
+ *     bpftrace -e 'usdt:/path/to/udt4_ext.so:pyudt:send_return
+ *                  { @bytes = hist(arg1); }'
+ *
+ * Probes (arguments):
+ *   send_entry, recv_entry         (socket, length)
+ *   send_return, recv_return       (socket, result)
+ *   accept_entry                   (socket)
+ *   accept_return                  (socket, accepted socket or -1)
+ *   connect_entry                  (socket, port)
+ *   connect_return                 (socket, result)
+ *   close_entry                    (socket)
+ *   close_return                   (socket, result)
+ *   epoll_wait_entry               (epoll id, timeout in ms)
+ *   epoll_wait_return              (epoll id, result)
+ *
+ * Results are the return values of the UDT calls (-1 on error).
+ *
+ * Probes are only compiled in when <sys/sdt.h> was found (PYUDT_HAVE_SDT).
+ */
+
+#ifdef PYUDT_HAVE_SDT
+#   include <sys/sdt.h>
+#   define PYUDT_PROBE1(name, a)    DTRACE_PROBE1(pyudt, name, a)
+#   define PYUDT_PROBE2(name, a, b) DTRACE_PROBE2(pyudt, name, a, b)
+#else
+#   define PYUDT_PROBE1(name, a)    do {} while (0)
+#   define PYUDT_PROBE2(name, a, b) do {} while (0)
+#endif // PYUDT_HAVE_SDT
+
+#endif // __PYUDT_PROBES_HH_
@@ -0,0 +1,34 @@
+#ifndef __PYUDT_RENDEZVOUS_HH_
+#define __PYUDT_RENDEZVOUS_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Set up rendez-vous connections to many peers at once.
+ *
+ * Every connection is a UDT socket in rendez-vous mode bound to the same
+ * local UDP port. The handshakes are started asynchronously and completed by
+ * UDT's receiving thread, so the whole mesh is formed in about one RTT
+ * instead of one blocking connect per peer.
+ *
+ * @param py_peers list of (ip, port) tuples.
+ * @param local_port local UDP port shared by all the connections (the peers
+ *        must connect to it).
+ * @param py_callback optional callable(peer, socket) invoked as each
+ *        handshake completes; socket is None if the connection failed.
+ * @param ms_timeout maximum time to wait for all the handshakes, in
+ *        milliseconds. A negative value waits until UDT gives up.
+ * @return list of connected sockets (None for failures), in peer order.
+ */
+py::list rendezvous_many(py::object py_peers, uint16_t local_port,
+                         py::object py_callback = py::object(),
+                         int64_t ms_timeout = -1) throw();
+
+} // namespace pyudt4
+
+#endif // __PYUDT_RENDEZVOUS_HH_
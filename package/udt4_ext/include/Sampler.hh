@@ -0,0 +1,158 @@
+#ifndef __PYUDT_SAMPLER_HH_
+#define __PYUDT_SAMPLER_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <stdint.h>
+
+#include "PeriodicTask.hh"
+#include "Perfmon.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+// Forward declarations
+class Epoll;
+
+/**
+ * Layout of the ring files written by the Sampler.
+ *
+ * A file starts with a RingHeader, followed by field_count RingField
+ * descriptions of the slot layout, padded to header_size bytes, then
+ * capacity slots of slot_size bytes. Every integer is little-endian.
+ *
+ * Slot i (counting from the creation of the file) is stored at index
+ * i % capacity. Its sequence number is 2i+1 while it is being written and
+ * 2i+2 once it is complete, so readers in other processes can detect torn or
+ * overwritten slots without taking any lock: read the sequence, copy the
+ * slot, then read the sequence again.
+ */
+namespace ring {
+
+static const char     magic[8] = { 'P', 'Y', 'U', 'D', 'T', 'R', 'N', 'G' };
+static const uint32_t version  = 1;
+
+struct RingHeader
+{
+    char                  magic[8];
+    uint32_t              version;
+    uint32_t              header_size;
+    uint32_t              slot_size;
+    uint32_t              capacity;
+    uint32_t              field_count;
+    uint32_t              period_ms;
+
+    /**
+     * Number of slots written since the creation of the file.
+     */
+    std::atomic<uint64_t> write_index;
+    uint64_t              reserved;
+};
+
+struct RingField
+{
+    char     name[32];
+    char     format[8];
+    uint32_t offset;
+    uint32_t reserved;
+};
+
+struct RingSlot
+{
+    std::atomic<uint64_t> seq;
+    int64_t               timestamp_us;
+    perfmon::Record       record;
+};
+
+} // namespace ring
+
+/**
+ * Background telemetry sampler.
+ *
+ * A native thread snapshots UDT::perfmon for the registered sockets at a fixed
+ * period, without the GIL, and appends the records to a memory-mapped ring
+ * file that other processes can read while it is being written.
+ */
+class Sampler : public PeriodicTask
+{
+public:
+
+    /**
+     * Constructor. Creates the ring file, replacing any previous one with
+     * rename(): readers that still map the previous file keep reading it.
+     * @param path path of the ring file.
+     * @param capacity number of records kept in the file.
+     * @param period_ms sampling period, in milliseconds.
+     */
+    Sampler(std::string path, int capacity = 3600, int period_ms = 1000);
+
+    /**
+     * Destructor. Stops the sampling thread and unmaps the file.
+     */
+    ~Sampler();
+
+    /**
+     * Register a socket for sampling.
+     * @param py_socket socket to sample.
+     */
+    void add(py::object py_socket) throw();
+
+    /**
+     * Register every socket currently in an epoll.
+     * @param epoll epoll whose sockets should be sampled.
+     */
+    void add_epoll(const Epoll& epoll);
+
+    /**
+     * Unregister a socket.
+     * @param py_socket socket to forget.
+     */
+    void remove(py::object py_socket) throw();
+
+    /**
+     * Return the path of the ring file.
+     */
+    const std::string& getPath() const;
+
+    /**
+     * Return the number of records kept in the ring file.
+     */
+    int getCapacity() const;
+
+    /**
+     * Return the number of records written since the file was created.
+     */
+    uint64_t written() const;
+
+private:
+    /**
+     * Sample every registered socket once.
+     */
+    void tick();
+
+    /**
+     * Append a record to the ring.
+     */
+    void append(int64_t timestamp_us, const perfmon::Record& record);
+
+private:
+    std::string path_;
+    int capacity_;
+
+    int fd_;
+    size_t size_;
+    char* map_;
+    ring::RingHeader* header_;
+    ring::RingSlot* slots_;
+
+    std::set<UDTSOCKET> sockets_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_SAMPLER_HH_
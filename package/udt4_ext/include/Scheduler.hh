@@ -0,0 +1,187 @@
+#ifndef __PYUDT_SCHEDULER_HH_
+#define __PYUDT_SCHEDULER_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Weighted fair sending scheduler across many connections.
+ *
+ * Producers enqueue buffers per socket, and native sender threads drain the
+ * queues with deficit round robin, in two levels: between the classes of a
+ * priority (in proportion to the class weights), then between the sockets
+ * of a class (in proportion to the socket weights). Classes of a lower
+ * priority value are always served first, so latency-sensitive streams do
+ * not wait behind bulk ones.
+ *
+ * Sockets are written without blocking: a socket whose send buffer is full
+ * is parked in a UDT epoll until it becomes writable, and the others keep
+ * being served meanwhile.
+ */
+class Scheduler
+{
+public:
+
+    /**
+     * Constructor. Creates the "default" class (weight 1, priority 0).
+     * @param threads number of sender threads.
+     * @param quantum bytes granted per round to a class or socket of weight 1.
+     * @param max_queue bytes a socket may have queued before enqueue()
+     *        refuses more.
+     */
+    Scheduler(int threads = 1, int quantum = 64 << 10,
+              int64_t max_queue = 16 << 20);
+
+    /**
+     * Destructor. Stops the sender threads and drops the queued data.
+     */
+    ~Scheduler();
+
+    /**
+     * Start the sender threads.
+     */
+    void start();
+
+    /**
+     * Stop the sender threads. The queued data is kept.
+     */
+    void stop();
+
+    /**
+     * Whether the sender threads are running.
+     */
+    bool isRunning() const;
+
+    /**
+     * Add a class.
+     * @param name unique class name.
+     * @param weight share of its priority level.
+     * @param priority priority level, lower values are served first.
+     */
+    void add_class(std::string name, double weight = 1.,
+                   int priority = 0) throw();
+
+    /**
+     * Register a socket. Its sends become non-blocking until it is removed,
+     * and it should only be written through the scheduler meanwhile.
+     * @param py_socket connected socket.
+     * @param name class name.
+     * @param weight share of its class.
+     */
+    void add(py::object py_socket, std::string name = "default",
+             double weight = 1.) throw();
+
+    /**
+     * Unregister a socket and restore its sending mode. The buffer being
+     * sent is completed, so that the stream holds no truncated message, and
+     * the other queued buffers are dropped.
+     * @param py_socket registered socket.
+     */
+    void remove(py::object py_socket) throw();
+
+    /**
+     * Queue a copy of a buffer for a registered socket.
+     * @param py_socket registered socket.
+     * @param py_data object exporting the buffer protocol.
+     * @return bytes queued for the socket, or -1 if its queue is full.
+     */
+    int64_t enqueue(py::object py_socket, py::object py_data) throw();
+
+    /**
+     * Wait until every queue is empty.
+     * @param ms_timeout timeout in milliseconds, negative to wait forever.
+     * @return whether the queues are empty.
+     */
+    bool flush(int64_t ms_timeout = -1);
+
+    /**
+     * Return the queue depths and sending counters per class and per
+     * socket.
+     */
+    py::dict stats();
+
+private:
+    struct Class;
+    struct Flow;
+
+    /**
+     * Sender thread loop.
+     */
+    void run();
+
+    /**
+     * Choose the next socket to write to and the number of bytes it may
+     * write, by deficit round robin. Called with mutex_ held.
+     */
+    std::shared_ptr<Flow> pick(size_t& len);
+
+    /**
+     * Account for the result of a send. Called with mutex_ held.
+     */
+    void complete(const std::shared_ptr<Flow>& flow, int res, int code,
+                  const std::string& message);
+
+    /**
+     * Drop the queued data of a socket and take it out of the rounds.
+     * Called with mutex_ held.
+     */
+    void drop(Flow& flow);
+
+    /**
+     * Interrupt the thread waiting in the epoll.
+     */
+    void wake();
+
+private:
+    int quantum_;
+    int64_t max_queue_;
+
+    std::vector<std::thread> threads_;
+    size_t thread_count_;
+    std::atomic<bool> running_;
+
+    /**
+     * UDT epoll of the blocked sockets, and event file descriptor waking it.
+     */
+    int eid_;
+    int wake_fd_;
+
+    /**
+     * Protects everything below.
+     */
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable drained_;
+    std::condition_variable idle_;
+
+    std::map<std::string, std::unique_ptr<Class> > classes_;
+    std::map<UDTSOCKET, std::shared_ptr<Flow> > flows_;
+
+    /**
+     * Active classes (with queued data) of every priority, in round order.
+     */
+    std::map<int, std::deque<Class*> > levels_;
+
+    int64_t queued_bytes_;
+    size_t blocked_;
+    bool polling_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_SCHEDULER_HH_
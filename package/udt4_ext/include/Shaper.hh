@@ -0,0 +1,185 @@
+#ifndef __PYUDT_SHAPER_HH_
+#define __PYUDT_SHAPER_HH_
+
+#include "Socket.hh"
+#include "PeriodicTask.hh"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Hierarchical bandwidth shaper for groups of sockets.
+ *
+ * Classes form a tree (e.g. link, tenants, jobs) in the manner of HTB: each
+ * class is guaranteed its rate, and may borrow the capacity its siblings
+ * leave unused, up to its ceil, in proportion to its weight. Sockets are
+ * attached to classes and share the rate of their class max-min fairly.
+ *
+ * A native thread samples the sockets at every period, estimates their
+ * demand from their sending rate (a socket sending at its cap wants more),
+ * distributes the rates down the tree and enforces the result with UDT_MAXBW,
+ * which UDT turns into its packet pacing. Adding or removing a socket
+ * redistributes the rates immediately.
+ */
+class Shaper : public PeriodicTask
+{
+public:
+
+    /**
+     * Constructor.
+     * @param interval_ms sampling and reallocation period, in milliseconds.
+     */
+    explicit Shaper(int interval_ms = 100);
+
+    /**
+     * Destructor. Stops the sampling thread.
+     */
+    ~Shaper();
+
+    /**
+     * Add a class.
+     * @param name unique class name.
+     * @param rate_mbps guaranteed rate, in Mb/s.
+     * @param ceil_mbps maximum rate when borrowing, in Mb/s (0: rate_mbps,
+     *        no borrowing). A root class has nothing to borrow from: its
+     *        rate is its capacity.
+     * @param parent parent class ("" for a root class).
+     * @param weight share of the capacity borrowed from the parent.
+     */
+    void add_class(std::string name, double rate_mbps, double ceil_mbps = 0.,
+                   std::string parent = "", double weight = 1.) throw();
+
+    /**
+     * Remove a class without sockets nor children.
+     * @param name class name.
+     */
+    void remove_class(std::string name) throw();
+
+    /**
+     * Attach a socket to a class, or move it to another one.
+     * @param py_socket socket to shape.
+     * @param name class name.
+     */
+    void add(py::object py_socket, std::string name) throw();
+
+    /**
+     * Detach a socket and remove its rate limit.
+     * @param py_socket socket to forget.
+     */
+    void remove(py::object py_socket) throw();
+
+    /**
+     * Return the per-class and per-socket rates: guaranteed, ceil, demand,
+     * allocated, borrowed and measured throughput (Mb/s), and packets sent.
+     */
+    py::dict stats();
+
+private:
+    /**
+     * Node of the class tree.
+     */
+    struct Class
+    {
+        std::string parent;
+        double      rate;       // bytes/s
+        double      ceil;       // bytes/s
+        double      weight;
+
+        std::vector<std::string> children;
+        std::vector<UDTSOCKET>   sockets;
+
+        double      demand;     // bytes/s
+        double      alloc;      // bytes/s
+        double      throughput; // bytes/s
+        int64_t     packets;    // sent by the sockets, since attached
+    };
+
+    /**
+     * Shaped socket.
+     */
+    struct Member
+    {
+        std::string cls;
+        int         mss;
+        int64_t     packets;    // pktSentTotal at the last sample
+        double      throughput; // bytes/s
+        double      demand;     // bytes/s
+        double      alloc;      // bytes/s
+        int64_t     maxbw;      // applied UDT_MAXBW
+    };
+
+    /**
+     * Sample every socket, then reallocate.
+     */
+    void tick();
+
+    /**
+     * Apply the allocations after a tick.
+     */
+    void after_tick();
+
+    /**
+     * Recompute the demands and allocations. Called with mutex_ held.
+     */
+    void rebalance();
+
+    /**
+     * Apply the allocations that changed, and lift the limit of the removed
+     * sockets, with UDT_MAXBW. Called without mutex_ nor the GIL: UDT takes
+     * the socket locks to set an option, and waits for a blocking call on
+     * the socket meanwhile.
+     */
+    void apply();
+
+    /**
+     * Release the GIL and apply().
+     */
+    void apply_released();
+
+    /**
+     * Demand of a class, bottom-up.
+     */
+    double update_demand(Class& cls);
+
+    /**
+     * Share the allocation of a class among its children and sockets,
+     * top-down.
+     */
+    void distribute(Class& cls);
+
+    /**
+     * Aggregate the measured throughput of a class, bottom-up.
+     */
+    double update_throughput(Class& cls);
+
+    /**
+     * Detach a socket from its class.
+     */
+    void detach(UDTSOCKET u);
+
+private:
+    std::map<std::string, Class> classes_;
+    std::map<UDTSOCKET, Member> members_;
+
+    /**
+     * Removed sockets whose limit is not lifted yet.
+     */
+    std::vector<UDTSOCKET> released_;
+
+    /**
+     * Serializes apply(), so that the last allocations are applied last.
+     */
+    std::mutex apply_mutex_;
+
+    std::chrono::steady_clock::time_point last_sample_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_SHAPER_HH_
@@ -8,6 +8,7 @@
 #include <map>
 
 #include "Memory.hh"
+#include "Histogram.hh"
 
 namespace py = boost::python;
 
@@ -39,6 +40,14 @@ public:
      */
     Socket(UDTSOCKET descriptor, bool close_on_delete = false);
 
+    /**
+     * Create a UDT socket of a given type.
+     * @param addr_family address family: AF_INET or AF_INET6.
+     * @param type SOCK_STREAM, or SOCK_DGRAM for message mode.
+     * @param protocol protocol (ignored by UDT).
+     */
+    Socket(int addr_family, int type, int protocol);
+
     /**
      * Destructor.
      */
@@ -99,6 +108,93 @@ public:
      */
     void setCloseOnDelete(bool close_on_delete);
 
+    /**
+     * Get whether the socket connects in rendez-vous mode.
+     */
+    bool getRendezvous() const throw();
+
+    /**
+     * Set whether the socket connects in rendez-vous mode. Both peers must
+     * enable it, bind to a known port and connect to each other.
+     */
+    void setRendezvous(bool rendezvous) throw();
+
+    /**
+     * Get whether sends block.
+     */
+    bool getSendBlocking() const;
+
+    /**
+     * Set whether sends block, keeping their timeout.
+     */
+    void setSendBlocking(bool blocking) throw();
+
+    /**
+     * Set a UDT socket option.
+     * @param opt option (UDT_MSS, UDT_FC, UDT_MAXBW...).
+     * @param py_value new value, checked against the option's type and range.
+     */
+    void setsockopt(int opt, boost::python::object py_value) throw();
+
+    /**
+     * Get a UDT socket option.
+     * @param opt option (UDT_MSS, UDT_FC, UDT_MAXBW...).
+     * @return the option's value.
+     */
+    boost::python::object getsockopt(int opt) const throw();
+
+    /**
+     * Apply a named tuning profile (MSS, FC, UDT/UDP buffers and MAXBW).
+     * Must be called before bind or connect.
+     * @param name profile name: lan_10g, wan_high_bdp or low_latency.
+     */
+    void apply_profile(std::string name) throw();
+
+    /**
+     * Select the congestion control algorithm. Must be called before
+     * connect, or on the listening socket before accept.
+     * @param name algorithm name, see pyudt.congestion_controls().
+     * @param params dict of algorithm parameters, e.g. {"rate_mbps": 500}.
+     */
+    void set_congestion_control(std::string name,
+                                py::dict params = py::dict()) throw();
+
+    /**
+     * Return the algorithm, mode and state of the congestion controller of
+     * a connected socket.
+     */
+    py::dict congestion_control() const throw();
+
+    /**
+     * Set the blocking mode of both directions, like socket.setblocking().
+     * Blocking mode also removes the timeouts.
+     */
+    void setblocking(bool blocking) throw();
+
+    /**
+     * Set the timeout of both directions, like socket.settimeout().
+     * @param py_timeout None for blocking calls without timeout, 0 for
+     *        non-blocking calls, or a timeout in seconds.
+     */
+    void settimeout(boost::python::object py_timeout) throw();
+
+    /**
+     * Sample the socket's performance into the socket's own snapshot, which
+     * is refreshed (not reallocated) by every call.
+     * @param clear whether to clear the local measurements after sampling.
+     * @return the snapshot.
+     */
+    const UDT::TRACEINFO& perfmon(bool clear = false) throw();
+
+    /**
+     * Sample the socket's performance into a Python buffer, e.g. a numpy
+     * array of dtype pyudt.perfmon_dtype().
+     * @param py_buffer writable buffer of at least sizeof(TRACEINFO) bytes.
+     * @param clear whether to clear the local measurements after sampling.
+     */
+    void perfmon_into(boost::python::object py_buffer,
+                      bool clear = false) const throw();
+
     /**
      * Put the socket's information in a string.
      */
@@ -137,6 +233,96 @@ public:
      */
     void send(boost::python::object py_data) const throw();
 
+    /**
+     * Send as much data as possible without blocking, whatever the mode of
+     * the socket. The mode is left untouched: on a blocking socket, the free
+     * space of the send buffer is checked first, so another thread sending
+     * on the same socket at the same time may make the call wait.
+     * @param py_data object exporting the buffer protocol.
+     * @return number of bytes sent, or -1 if the send buffer is full.
+     */
+    int try_send(boost::python::object py_data) throw();
+
+    /**
+     * Receive the available data without blocking, whatever the mode of the
+     * socket. As for try_send(), a blocking socket is checked for data
+     * first, and should not be read by another thread at the same time.
+     * @param py_buffer writable buffer (bytearray, memoryview...).
+     * @param nbytes maximum number of bytes, 0 for the size of the buffer.
+     * @return number of bytes received, or -1 if no data is available.
+     */
+    int try_recv_into(boost::python::object py_buffer, int nbytes = 0) throw();
+
+    /**
+     * Send a whole buffer, blocking until it is sent whatever the mode of
+     * the socket. The options of the socket are left unchanged: with a
+     * deadline or in non-blocking mode, the call waits for the socket to
+     * become writable in an epoll.
+     * @param py_data object exporting the buffer protocol.
+     * @param deadline time on the monotonic clock (pyudt.monotonic(), or
+     *        time.monotonic() on Linux), in seconds. Calls block until then,
+     *        and UDTTimeoutError is raised if it passes. Negative: the
+     *        timeout of the socket applies, if any.
+     * @return number of bytes sent.
+     */
+    int sendall(boost::python::object py_data, double deadline = -1) throw();
+
+    /**
+     * Receive data into a buffer.
+     * @param py_buffer writable buffer (bytearray, memoryview...).
+     * @param nbytes maximum number of bytes, 0 for the size of the buffer.
+     * @param deadline see sendall().
+     * @return number of bytes received.
+     */
+    int recv_into(boost::python::object py_buffer, int nbytes = 0,
+                  double deadline = -1) throw();
+
+    /**
+     * Send a message (SOCK_DGRAM sockets).
+     * @param py_data object exporting the buffer protocol (bytes, bytearray,
+     *        memoryview...).
+     * @param ttl_ms time-to-live of the message, in milliseconds (-1 for
+     *        infinite).
+     * @param in_order whether the message must be delivered in order.
+     * @return the number of bytes of data sent.
+     */
+    int sendmsg(boost::python::object py_data, int ttl_ms = -1,
+                bool in_order = false) const throw();
+
+    /**
+     * Receive a message (SOCK_DGRAM sockets). With timestamping enabled, a
+     * message without timestamp is returned whole and counted as unstamped
+     * in latency().
+     * @param max_len maximum size of the message, in bytes.
+     * @return the message, as bytes.
+     */
+    boost::python::object recvmsg(int max_len) throw();
+
+    /**
+     * Get whether messages are timestamped.
+     */
+    bool getTimestamping() const;
+
+    /**
+     * Set whether messages are timestamped. The sender prefixes every
+     * message with its send time, and the receiver strips it and records the
+     * one-way delivery latency. It must be enabled on both peers of a
+     * connection before the first message.
+     */
+    void setTimestamping(bool timestamping);
+
+    /**
+     * Return the histogram of the one-way latencies of the timestamped
+     * messages received, in seconds, and the number of messages received
+     * without timestamp ("unstamped").
+     */
+    py::dict latency() const;
+
+    /**
+     * Forget the recorded latencies and unstamped messages.
+     */
+    void reset_latency();
+
     /**
      * Bind a UDT socket to a known or an available local address.
      * @param ip IP address.
@@ -186,6 +372,30 @@ public:
     accept() throw();
 
 private:
+    /**
+     * Set the default blocking modes: non-blocking send, blocking receive.
+     */
+    void setDefaultOptions() throw();
+
+    /**
+     * Set the blocking mode and timeout (ms, -1 for none) of the send
+     * direction, only calling UDT if they changed. The GIL is released
+     * meanwhile: UDT waits for the calls in progress on the socket.
+     */
+    void setSendMode(bool blocking, int timeout_ms) throw();
+
+    /**
+     * Set the blocking mode and timeout (ms, -1 for none) of the receive
+     * direction, only calling UDT if they changed. The GIL is released
+     * meanwhile.
+     */
+    void setRecvMode(bool blocking, int timeout_ms) throw();
+
+    /**
+     * Read the blocking modes and timeouts back from UDT.
+     */
+    void loadModes() throw();
+
     /**
      * Build the structure containing the socket IP address, port, address
      * family etc.
@@ -226,8 +436,44 @@ private:
      * Whether the socket is alive.
      */
     bool is_alive_;
+
+    /**
+     * Blocking modes and timeouts (ms, -1 for none) of both directions, as
+     * last set.
+     */
+    bool snd_blocking_;
+    bool rcv_blocking_;
+    int snd_timeout_ms_;
+    int rcv_timeout_ms_;
+
+    /**
+     * Last performance snapshot.
+     */
+    UDT::TRACEINFO perf_;
+
+    /**
+     * Whether messages are timestamped.
+     */
+    bool timestamping_;
+
+    /**
+     * One-way latencies of the timestamped messages received, in nanoseconds.
+     */
+    shared_ptr<Histogram> latency_;
+
+    /**
+     * Number of messages received without timestamp while timestamping.
+     */
+    uint64_t unstamped_;
 };
 
+/**
+ * Extract the Socket wrapped by a Python object, or raise an exception.
+ * @param py_socket Python object expected to be a Socket.
+ * @param what signature of the calling method, for the error message.
+ */
+Socket* extractSocket(py::object py_socket, const char* what);
+
 } // namespace pyudt4
 
 #endif // __PYUDT_SOCKET_HH_
@@ -0,0 +1,170 @@
+#ifndef __PYUDT_SOCKETOPTIONS_HH_
+#define __PYUDT_SOCKETOPTIONS_HH_
+
+#include <boost/python.hpp>
+#include <udt/udt.h>
+#include <string>
+#include <stdint.h>
+#include <climits>
+#include <sys/socket.h> // linger
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Typed table of the UDT socket options.
+ */
+namespace options {
+
+/**
+ * Python-side representation of an option value.
+ */
+enum Kind
+{
+    BOOL,   ///< bool
+    INT,    ///< int
+    INT64,  ///< int64_t
+    LINGER, ///< (onoff, seconds) tuple
+    OPAQUE  ///< not settable from Python (e.g. UDT_CC)
+};
+
+/**
+ * X-macro listing every UDT option in UDTOpt order:
+ * X(option, kind, C type, minimum, maximum, read-only)
+ */
+#define PYUDT_SOCKET_OPTIONS(X)                                         \
+    X(UDT_MSS,        INT,    int,     64,  65536,      false)          \
+    X(UDT_SNDSYN,     BOOL,   bool,    0,   1,          false)          \
+    X(UDT_RCVSYN,     BOOL,   bool,    0,   1,          false)          \
+    X(UDT_CC,         OPAQUE, void*,   0,   0,          false)          \
+    X(UDT_FC,         INT,    int,     1,   INT_MAX,    false)          \
+    X(UDT_SNDBUF,     INT,    int,     1,   INT_MAX,    false)          \
+    X(UDT_RCVBUF,     INT,    int,     1,   INT_MAX,    false)          \
+    X(UDT_LINGER,     LINGER, linger,  0,   INT_MAX,    false)          \
+    X(UDP_SNDBUF,     INT,    int,     1,   INT_MAX,    false)          \
+    X(UDP_RCVBUF,     INT,    int,     1,   INT_MAX,    false)          \
+    X(UDT_MAXMSG,     INT,    int,     1,   INT_MAX,    false)          \
+    X(UDT_MSGTTL,     INT,    int,     -1,  INT_MAX,    false)          \
+    X(UDT_RENDEZVOUS, BOOL,   bool,    0,   1,          false)          \
+    X(UDT_SNDTIMEO,   INT,    int,     -1,  INT_MAX,    false)          \
+    X(UDT_RCVTIMEO,   INT,    int,     -1,  INT_MAX,    false)          \
+    X(UDT_REUSEADDR,  BOOL,   bool,    0,   1,          false)          \
+    X(UDT_MAXBW,      INT64,  int64_t, -1,  INT64_MAX,  false)          \
+    X(UDT_STATE,      INT,    int32_t, 0,   INT_MAX,    true)           \
+    X(UDT_EVENT,      INT,    int32_t, 0,   INT_MAX,    true)           \
+    X(UDT_SNDDATA,    INT,    int,     0,   INT_MAX,    true)           \
+    X(UDT_RCVDATA,    INT,    int,     0,   INT_MAX,    true)
+
+/**
+ * Description of a UDT option.
+ */
+struct Option
+{
+    UDTOpt      opt;
+    const char* name;
+    Kind        kind;
+    int         size;
+    int64_t     min;
+    int64_t     max;
+    bool        read_only;
+};
+
+#define PYUDT_OPTION_ENTRY(opt, kind, ctype, min, max, ro) \
+    { opt, #opt, kind, (int) sizeof(ctype), min, max, ro },
+
+constexpr Option table[] = { PYUDT_SOCKET_OPTIONS(PYUDT_OPTION_ENTRY) };
+
+#undef PYUDT_OPTION_ENTRY
+
+constexpr int count = sizeof(table) / sizeof(table[0]);
+
+constexpr bool is_ordered(int i = 0)
+{
+    return i == count || (table[i].opt == i && is_ordered(i + 1));
+}
+
+static_assert(count == UDT_RCVDATA + 1, "Missing UDT option in the table");
+static_assert(is_ordered(), "UDT option table must follow UDTOpt order");
+
+/**
+ * C type of each option, for typed access from C++.
+ */
+template <UDTOpt O> struct traits;
+
+#define PYUDT_OPTION_TRAITS(opt, kind_, ctype, min, max, ro) \
+    template <> struct traits<opt> { typedef ctype type; };
+
+PYUDT_SOCKET_OPTIONS(PYUDT_OPTION_TRAITS)
+
+#undef PYUDT_OPTION_TRAITS
+
+/**
+ * Set an option with its exact C type.
+ * @return UDT::ERROR on failure.
+ */
+template <UDTOpt O>
+inline int set(UDTSOCKET u, typename traits<O>::type value)
+{
+    return UDT::setsockopt(u, 0, O, &value, sizeof(value));
+}
+
+/**
+ * Get an option with its exact C type.
+ * @return UDT::ERROR on failure.
+ */
+template <UDTOpt O>
+inline int get(UDTSOCKET u, typename traits<O>::type& value)
+{
+    int len = sizeof(value);
+    return UDT::getsockopt(u, 0, O, &value, &len);
+}
+
+/**
+ * Validate a Python value and set the option.
+ * @param u UDT socket.
+ * @param opt option (a UDTOpt value).
+ * @param py_value new value.
+ */
+void set_from_python(UDTSOCKET u, int opt, py::object py_value) throw();
+
+/**
+ * Get an option as a Python value.
+ * @param u UDT socket.
+ * @param opt option (a UDTOpt value).
+ */
+py::object get_as_python(UDTSOCKET u, int opt) throw();
+
+/**
+ * Named set of tuning options.
+ */
+struct Profile
+{
+    const char* name;
+    int         mss;
+    int         fc;
+    int         udt_sndbuf;
+    int         udt_rcvbuf;
+    int         udp_sndbuf;
+    int         udp_rcvbuf;
+    int64_t     maxbw;
+};
+
+/**
+ * Apply a named profile. The socket must not be bound or connected yet,
+ * since UDT ignores most of these options afterwards.
+ * @param u UDT socket.
+ * @param name profile name: lan_10g, wan_high_bdp or low_latency.
+ */
+void apply_profile(UDTSOCKET u, const std::string& name) throw();
+
+/**
+ * Return the available profiles as a dict of dicts.
+ */
+py::dict profiles();
+
+} // namespace options
+
+} // namespace pyudt4
+
+#endif // __PYUDT_SOCKETOPTIONS_HH_
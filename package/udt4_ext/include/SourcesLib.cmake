@@ -2,8 +2,26 @@ set(currentFolder "package/udt4_ext/include")
 
 set(PYUDT_HEADERS
 ${PYUDT_HEADERS}
+${currentFolder}/CongestionControl.hh
+${currentFolder}/Counters.hh
 ${currentFolder}/Debug.hh
 ${currentFolder}/Epoll.hh
 ${currentFolder}/Exception.hh
+${currentFolder}/Histogram.hh
+${currentFolder}/ImpairmentProxy.hh
+${currentFolder}/MetricsExporter.hh
+${currentFolder}/Multiplexer.hh
+${currentFolder}/PeriodicTask.hh
+${currentFolder}/Perfmon.hh
+${currentFolder}/Probes.hh
+${currentFolder}/Rendezvous.hh
+${currentFolder}/Sampler.hh
+${currentFolder}/Scheduler.hh
+${currentFolder}/Shaper.hh
 ${currentFolder}/Socket.hh
+${currentFolder}/SocketOptions.hh
+${currentFolder}/Stats.hh
+${currentFolder}/Trace.hh
+${currentFolder}/Tuner.hh
+${currentFolder}/UDPSocket.hh
 )
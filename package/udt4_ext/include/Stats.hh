@@ -0,0 +1,207 @@
+#ifndef __PYUDT_STATS_HH_
+#define __PYUDT_STATS_HH_
+
+#include <Python.h>
+#include <boost/python.hpp>
+#include <stdint.h>
+#include <time.h>
+
+#include "Histogram.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+/**
+ * Binding-overhead instrumentation of the hot entry points.
+ *
+ * For every call, the time spent inside UDT (with the GIL released) and the
+ * time spent in the binding around it (argument parsing, conversions, GIL
+ * reacquisition) are recorded in log-linear histograms. Every thread writes
+ * to its own shard, so recording never contends; shards are merged when the
+ * statistics are read.
+ */
+namespace stats {
+
+/**
+ * X-macro listing every instrumented call site: X(name)
+ */
+#define PYUDT_CALL_SITES(X) \
+    X(send)                 \
+    X(recv)                 \
+    X(accept)               \
+    X(connect)              \
+    X(sendmsg)              \
+    X(recvmsg)              \
+    X(epoll_wait)           \
+    X(perfmon)
+
+enum Site
+{
+#define PYUDT_CALL_SITE_ID(name) name,
+    PYUDT_CALL_SITES(PYUDT_CALL_SITE_ID)
+#undef PYUDT_CALL_SITE_ID
+    site_count
+};
+
+extern const char* const site_names[site_count];
+
+/**
+ * Statistics of a call site.
+ */
+struct SiteStats
+{
+    SiteStats()
+    : calls(0),
+      errors(0),
+      bytes(0),
+      gil_slow(0)
+    {
+    }
+
+    uint64_t  calls;
+    uint64_t  errors;
+    uint64_t  bytes;
+    Histogram inside_ns;
+    Histogram outside_ns;
+
+    /**
+     * Time waited to reacquire the GIL after UDT returned, and number of
+     * waits over the threshold (only while GIL tracking is enabled).
+     */
+    Histogram gil_ns;
+    uint64_t  gil_slow;
+};
+
+/**
+ * Statistics of every call site.
+ */
+struct Snapshot
+{
+    SiteStats sites[site_count];
+};
+
+/**
+ * Monotonic time, in nanoseconds.
+ */
+inline int64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Record a call in the shard of the current thread.
+ * @param gil_ns time waited to reacquire the GIL, or -1 if not measured.
+ */
+void record(Site site, int64_t inside_ns, int64_t outside_ns,
+            int64_t bytes, bool error, int64_t gil_ns = -1);
+
+/**
+ * Enable or disable the measurement of GIL reacquisition.
+ * @param enabled whether to measure how long threads wait for the GIL.
+ * @param threshold_us waits longer than this are also counted as slow.
+ */
+void set_gil_tracking(bool enabled, int64_t threshold_us = 1000);
+
+/**
+ * Whether GIL reacquisition is measured.
+ */
+bool gil_tracking();
+
+/**
+ * Merge every shard, minus what was there at the last reset().
+ */
+void snapshot(Snapshot& out);
+
+/**
+ * Start counting from zero again.
+ */
+void reset();
+
+/**
+ * Return the statistics of every call site as a dict, durations in seconds.
+ */
+py::dict to_python();
+
+/**
+ * Instrumentation of one call into UDT, recorded when leaving the scope.
+ *
+ * Replaces Py_BEGIN_ALLOW_THREADS/Py_END_ALLOW_THREADS around the UDT call:
+ *
+ *     stats::CallScope scope(stats::recv);
+ *     scope.releaseGIL();
+ *     res = UDT::recv(...);
+ *     scope.acquireGIL();
+ */
+class CallScope
+{
+public:
+    /**
+     * @param socket UDT socket or epoll id the call applies to, traced with
+     * the call events (see Trace.hh).
+     */
+    explicit CallScope(Site site, int64_t socket = -1);
+
+    /**
+     * Record the call. Reacquires the GIL if it is still released.
+     */
+    ~CallScope();
+
+    /**
+     * Release the GIL before calling UDT. A call may release and reacquire
+     * the GIL several times (e.g. once per chunk).
+     */
+    void releaseGIL();
+
+    /**
+     * Reacquire the GIL once UDT returned.
+     */
+    void acquireGIL();
+
+    /**
+     * Set the number of bytes transferred by the call.
+     */
+    void setBytes(int64_t bytes);
+
+    /**
+     * Set the result traced when leaving the scope (e.g. number of ready
+     * sockets) when it is not a number of bytes.
+     */
+    void setResult(int64_t result);
+
+    /**
+     * Mark the call as failed.
+     */
+    void setError();
+
+private:
+    CallScope(const CallScope&);
+    CallScope& operator=(const CallScope&);
+
+private:
+    Site site_;
+    int64_t socket_;
+    PyThreadState* state_;
+
+    int64_t start_;
+    int64_t released_;
+
+    /**
+     * Time spent without the GIL, and reacquiring it (-1 if not tracked),
+     * summed over every release/acquire pair of the call.
+     */
+    int64_t inside_;
+    int64_t gil_;
+
+    int64_t bytes_;
+    int64_t result_;
+    bool error_;
+};
+
+} // namespace stats
+
+} // namespace pyudt4
+
+#endif // __PYUDT_STATS_HH_
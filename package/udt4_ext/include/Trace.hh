@@ -0,0 +1,132 @@
+#ifndef __PYUDT_TRACE_HH_
+#define __PYUDT_TRACE_HH_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace pyudt4 {
+
+/**
+ * Binary event trace.
+ *
+ * While tracing, every thread appends fixed-size events to its own ring
+ * buffer, without locking nor formatting: the oldest events are overwritten
+ * when a ring is full. dump() writes every ring to a file that
+ * pyudt.trace2json converts to the Chrome/Perfetto trace format. The ring
+ * of an exited thread is freed once a dump() wrote it.
+ */
+namespace trace {
+
+/**
+ * X-macro listing every event type: X(name)
+ */
+#define PYUDT_TRACE_EVENTS(X) \
+    X(socket_create)          \
+    X(socket_bind)            \
+    X(socket_connect)         \
+    X(socket_accept)          \
+    X(socket_close)           \
+    X(call_begin)             \
+    X(call_end)               \
+    X(gil_release)            \
+    X(gil_acquire)
+
+enum Type
+{
+#define PYUDT_TRACE_EVENT_ID(name) name,
+    PYUDT_TRACE_EVENTS(PYUDT_TRACE_EVENT_ID)
+#undef PYUDT_TRACE_EVENT_ID
+    type_count
+};
+
+extern const char* const type_names[type_count];
+
+/**
+ * A traced event. Its layout is part of the dump format.
+ */
+struct Event
+{
+    /**
+     * CLOCK_MONOTONIC time, in nanoseconds.
+     */
+    int64_t time_ns;
+
+    /**
+     * UDT socket or epoll id the event applies to, -1 if none.
+     */
+    int64_t socket;
+
+    /**
+     * Bytes transferred (call_end of send/recv), ready sockets (call_end of
+     * epoll_wait), accepted socket (socket_accept), GIL wait in nanoseconds
+     * (gil_acquire).
+     */
+    int64_t value;
+
+    uint16_t type;
+
+    /**
+     * stats::Site of call_begin, call_end, gil_release and gil_acquire.
+     */
+    uint16_t site;
+
+    uint32_t reserved;
+};
+
+/**
+ * Whether events are recorded.
+ */
+extern std::atomic<bool> active;
+
+inline bool enabled()
+{
+    return active.load(std::memory_order_relaxed);
+}
+
+/**
+ * Append an event to the ring of the current thread.
+ */
+void emit(Type type, int64_t socket, int64_t value, int site);
+
+/**
+ * Record an event if tracing. Costs one relaxed atomic load otherwise.
+ */
+inline void event(Type type, int64_t socket, int64_t value = 0, int site = 0)
+{
+    if (enabled()) emit(type, socket, value, site);
+}
+
+/**
+ * Start a new trace, discarding the events of the previous one.
+ * @param capacity events kept per thread, rounded up to a power of two.
+ */
+void start(size_t capacity = 65536);
+
+/**
+ * Stop recording. The events are kept until the next start() or clear().
+ */
+void stop();
+
+/**
+ * Discard every recorded event.
+ */
+void clear();
+
+/**
+ * Write the recorded events to a file. Can be called while tracing.
+ * @return number of events written.
+ */
+uint64_t dump(const std::string& path);
+
+/**
+ * Start or stop tracing (Python interface).
+ */
+void set_tracing(bool enabled, size_t capacity = 65536);
+
+} // namespace trace
+
+} // namespace pyudt4
+
+#endif // __PYUDT_TRACE_HH_
@@ -0,0 +1,159 @@
+#ifndef __PYUDT_TUNER_HH_
+#define __PYUDT_TUNER_HH_
+
+#include "Socket.hh"
+#include "PeriodicTask.hh"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+// Forward declarations
+class Epoll;
+
+/**
+ * Bandwidth-delay product auto-tuner.
+ *
+ * A native thread samples UDT::perfmon for the registered sockets and keeps,
+ * for every peer, an estimate of the bandwidth-delay product of the link.
+ *
+ * UDT only accepts new UDT_SNDBUF, UDT_RCVBUF and UDT_FC values before a
+ * socket is bound, so the buffers of live connections are never resized:
+ * they are sized by prepare() from what was learned on earlier connections
+ * to the same peer. Live connections are only adjusted through UDT_MAXBW,
+ * which is capped to a multiple of the measured bandwidth.
+ */
+class Tuner : public PeriodicTask
+{
+public:
+
+    /**
+     * Constructor.
+     * @param interval_ms sampling period, in milliseconds.
+     * @param max_buffer maximum size of each UDT buffer, in bytes.
+     * @param max_memory maximum total size of the buffers sized by the
+     *        tuner, in bytes.
+     * @param maxbw_headroom cap UDT_MAXBW of live connections to this
+     *        multiple of the measured bandwidth; 0 leaves UDT_MAXBW alone.
+     */
+    Tuner(int interval_ms = 1000,
+          int max_buffer = 256 << 20,
+          int64_t max_memory = int64_t(1) << 30,
+          double maxbw_headroom = 2.);
+
+    /**
+     * Destructor. Stops the sampling thread.
+     */
+    ~Tuner();
+
+    /**
+     * Register a socket for sampling.
+     * @param py_socket socket to sample.
+     */
+    void add(py::object py_socket) throw();
+
+    /**
+     * Register every socket currently in an epoll.
+     * @param epoll epoll whose sockets should be sampled.
+     */
+    void add_epoll(const Epoll& epoll);
+
+    /**
+     * Unregister a socket.
+     * @param py_socket socket to forget.
+     */
+    void remove(py::object py_socket) throw();
+
+    /**
+     * Size the buffers of a socket that is about to connect to a peer, from
+     * the bandwidth-delay product measured on that link, and register it.
+     * A peer not learned yet keeps UDT's default size. Either way the
+     * buffers are counted against max_memory, and shrunk to fit in it.
+     * Raises an exception if less than 1 MB per buffer is left.
+     * @param py_socket socket that is not bound yet.
+     * @param ip IP address of the peer.
+     * @return the buffer size applied, in bytes.
+     */
+    int prepare(py::object py_socket, std::string ip) throw();
+
+    /**
+     * Return the last estimates: per-socket and per-peer RTT, bandwidth,
+     * bandwidth-delay product and target buffer size.
+     */
+    py::dict stats();
+
+private:
+    /**
+     * Per-socket tuning state.
+     */
+    struct Entry
+    {
+        std::string peer;
+        double      ms_rtt;
+        double      mbps_bandwidth;
+        int         flight_size;
+        int         avail_snd_buf;
+        double      bdp;
+        int         buffer;
+        int64_t     maxbw;
+    };
+
+    /**
+     * Per-peer link estimate.
+     */
+    struct Link
+    {
+        double ms_rtt;
+        double mbps_bandwidth;
+        double bdp;
+    };
+
+    /**
+     * Sample every registered socket once.
+     */
+    void tick();
+
+    /**
+     * Apply the UDT_MAXBW changes of the last tick. Called without mutex_:
+     * UDT takes the socket locks to set an option, and waits for a blocking
+     * call on the socket meanwhile.
+     */
+    void after_tick();
+
+    /**
+     * Buffer size for a given bandwidth-delay product, within the limits.
+     */
+    int target_buffer(double bdp) const;
+
+    /**
+     * Register a descriptor.
+     */
+    void add_descriptor(UDTSOCKET u);
+
+private:
+    int max_buffer_;
+    int64_t max_memory_;
+    double maxbw_headroom_;
+
+    /**
+     * Total size of the buffers sized by prepare(), in bytes.
+     */
+    int64_t memory_;
+
+    std::map<UDTSOCKET, Entry> entries_;
+    std::map<std::string, Link> links_;
+
+    /**
+     * UDT_MAXBW changes computed by tick(), for after_tick().
+     */
+    std::vector<std::pair<UDTSOCKET, int64_t> > pending_;
+};
+
+} // namespace pyudt4
+
+#endif // __PYUDT_TUNER_HH_
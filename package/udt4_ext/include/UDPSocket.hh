@@ -0,0 +1,62 @@
+#ifndef __PYUDT_UDPSOCKET_HH_
+#define __PYUDT_UDPSOCKET_HH_
+
+#include <string>
+#include <stdint.h>
+#include <udt/udt.h>
+
+namespace pyudt4 {
+
+/**
+ * Helpers for the system UDP sockets handed over to UDT with UDT::bind2.
+ */
+namespace udp {
+
+/**
+ * Create and bind a UDP socket with the given kernel buffer sizes.
+ * @param ip IP address (nullptr for any address).
+ * @param port port (0 for any available port).
+ * @param sndbuf kernel send buffer size, in bytes.
+ * @param rcvbuf kernel receive buffer size, in bytes.
+ * @param reuseport whether to join the SO_REUSEPORT group of the port.
+ * @return descriptor of the bound UDP socket.
+ */
+SYSSOCKET open(const char* ip, uint16_t port, int sndbuf, int rcvbuf,
+               bool reuseport = false);
+
+/**
+ * Return the local port a UDP socket is bound to.
+ * @param sock UDP socket.
+ */
+uint16_t get_port(SYSSOCKET sock);
+
+/**
+ * Set a kernel buffer size, bypassing rmem_max/wmem_max when allowed to.
+ * @param sock UDP socket.
+ * @param opt SO_SNDBUF or SO_RCVBUF.
+ * @param size buffer size, in bytes.
+ * @return 0 on success, -1 otherwise.
+ */
+int set_kernel_buffer(SYSSOCKET sock, int opt, int size);
+
+/**
+ * Return the effective kernel buffer size, or -1 on error.
+ * @param sock UDP socket.
+ * @param opt SO_SNDBUF or SO_RCVBUF.
+ */
+int get_kernel_buffer(SYSSOCKET sock, int opt);
+
+/**
+ * Attach a classic BPF program to a SO_REUSEPORT group, selecting the group
+ * member from the peer's address and port. Every packet of a UDT connection
+ * then lands on the same member, independently of the kernel's hash seed.
+ * @param sock any UDP socket of the group.
+ * @param group_size number of sockets in the group.
+ */
+void attach_reuseport_bpf(SYSSOCKET sock, unsigned int group_size);
+
+} // namespace udp
+
+} // namespace pyudt4
+
+#endif // __PYUDT_UDPSOCKET_HH_
@@ -0,0 +1,902 @@
+#include "CongestionControl.hh"
+
+#include <Python.h>
+#include <udt/udt.h>
+#include <udt/ccc.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace cc {
+
+namespace detail {
+
+/**
+ * Monotonic time, in microseconds.
+ */
+static
+int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Number of packets from sequence number a to b (UDT sequence numbers are
+ * 31-bit and wrap around).
+ */
+static
+int32_t seq_offset(int32_t a, int32_t b)
+{
+    static const int32_t max_seq = 0x7FFFFFFF;
+    static const int32_t threshold = 0x3FFFFFFF;
+
+    if (std::abs(a - b) < threshold) return b - a;
+    if (a < b) return b - a - max_seq - 1;
+    return b - a + max_seq + 1;
+}
+
+/**
+ * Packet sending period, in microseconds, for a rate in Mb/s.
+ */
+static
+double period_us(int mss, double rate_mbps)
+{
+    return mss * 8. / rate_mbps;
+}
+
+} // namespace detail
+
+
+// ------------------------------------------------------------------------
+//  Algorithms
+// ------------------------------------------------------------------------
+
+/**
+ * Stock UDT algorithm (rate-based AIMD with packet-pair bandwidth
+ * estimation), with its state published.
+ */
+class NativeUDT : public Monitored<CUDTCC>
+{
+public:
+    static const Param params[];
+
+    virtual void init()
+    {
+        CUDTCC::init();
+        publish();
+    }
+
+    virtual void onACK(int32_t ack)
+    {
+        CUDTCC::onACK(ack);
+        publish();
+    }
+
+    virtual void onLoss(const int32_t* losslist, int size)
+    {
+        CUDTCC::onLoss(losslist, size);
+        publish();
+    }
+
+    virtual void onTimeout()
+    {
+        CUDTCC::onTimeout();
+        publish();
+    }
+};
+
+const Param NativeUDT::params[] = {
+    { nullptr, 0., nullptr, false }
+};
+
+
+/**
+ * Constant sending rate, whatever the losses: for dedicated circuits whose
+ * capacity is known.
+ */
+class FixedRate : public Monitored<CCC>
+{
+public:
+    static const Param params[];
+
+    FixedRate()
+    : rate_mbps_(100.),
+      cwnd_pkts_(25600.)
+    {
+    }
+
+    virtual void configure(const Params& p)
+    {
+        rate_mbps_ = p.at("rate_mbps");
+        cwnd_pkts_ = p.at("cwnd_pkts");
+    }
+
+    virtual void init()
+    {
+        m_dPktSndPeriod = detail::period_us(m_iMSS, rate_mbps_);
+        m_dCWndSize = cwnd_pkts_;
+        publish();
+    }
+
+    virtual void onACK(int32_t)
+    {
+        publish();
+    }
+
+    virtual void onLoss(const int32_t*, int)
+    {
+        publish();
+    }
+
+    virtual void onTimeout()
+    {
+        publish();
+    }
+
+private:
+    virtual void collect(State& state) const
+    {
+        state.add("rate_mbps", rate_mbps_);
+    }
+
+private:
+    double rate_mbps_;
+    double cwnd_pkts_;
+};
+
+const Param FixedRate::params[] = {
+    { "rate_mbps", 100.,    "sending rate, in Mb/s" },
+    { "cwnd_pkts", 25600.,  "congestion window, in packets (UDT_FC also "
+                            "caps the packets in flight)" },
+    { nullptr, 0., nullptr, false }
+};
+
+
+/**
+ * Model-based controller in the style of BBR.
+ *
+ * The bottleneck bandwidth is the windowed maximum of the delivery rate
+ * (the receiving rate reported in the ACKs) over the last rounds, and the
+ * propagation delay the windowed minimum of the RTT. The sending rate is a
+ * gain times the bandwidth, the window a gain times the bandwidth-delay
+ * product; losses do not change the model:
+ *
+ * - STARTUP: high gain until the bandwidth stops growing for 3 rounds,
+ * - DRAIN: inverse gain until the packets in flight fit the BDP,
+ * - PROBE_BW: gain cycle (1.25, 0.75, then 1 for 6 RTTs),
+ * - PROBE_RTT: window of 4 packets for a while when the minimum RTT has not
+ *   been refreshed for min_rtt_window_ms.
+ */
+class BBR : public Monitored<CCC>
+{
+public:
+    static const Param params[];
+
+    enum Mode { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+    BBR()
+    : mode_(STARTUP),
+      startup_gain_(2.885),
+      cwnd_gain_(2.),
+      probe_gain_(1.25),
+      bw_window_rounds_(10),
+      min_rtt_window_us_(10000000),
+      probe_rtt_us_(200000),
+      initial_rate_mbps_(10.),
+      max_rate_mbps_(0.),
+      pacing_gain_(2.885),
+      btl_bw_pps_(0.),
+      min_rtt_us_(0.),
+      min_rtt_stamp_us_(0),
+      probe_rtt_done_us_(0),
+      round_(0),
+      round_end_seq_(0),
+      full_bw_pps_(0.),
+      full_bw_rounds_(0),
+      cycle_index_(0),
+      cycle_stamp_us_(0)
+    {
+    }
+
+    virtual void configure(const Params& p)
+    {
+        startup_gain_      = p.at("startup_gain");
+        cwnd_gain_         = p.at("cwnd_gain");
+        probe_gain_        = p.at("probe_gain");
+        bw_window_rounds_  = (int64_t) std::max(1., p.at("bw_window_rounds"));
+        min_rtt_window_us_ = (int64_t) (p.at("min_rtt_window_ms") * 1e3);
+        probe_rtt_us_      = (int64_t) (p.at("probe_rtt_ms") * 1e3);
+        initial_rate_mbps_ = p.at("initial_rate_mbps");
+        max_rate_mbps_     = p.at("max_rate_mbps");
+    }
+
+    virtual void init()
+    {
+        int64_t now = detail::now_us();
+
+        mode_ = STARTUP;
+        pacing_gain_ = startup_gain_;
+        btl_bw_pps_ = initial_rate_mbps_ * 1e6 / 8. / m_iMSS;
+        min_rtt_us_ = 0.;
+        min_rtt_stamp_us_ = now;
+        round_end_seq_ = m_iSndCurrSeqNo;
+
+        apply();
+        publish(mode_name());
+    }
+
+    virtual void onACK(int32_t ack)
+    {
+        int64_t now = detail::now_us();
+
+        // A round ends when the packets sent at its start are acknowledged
+        bool new_round = detail::seq_offset(round_end_seq_, ack) > 0;
+        if (new_round)
+        {
+            ++round_;
+            round_end_seq_ = m_iSndCurrSeqNo;
+        }
+
+        updateBandwidth();
+        updateMinRTT(now);
+
+        switch (mode_)
+        {
+        case STARTUP:
+            if (new_round) checkFullBandwidth();
+            break;
+
+        case DRAIN:
+            if (inflight(ack) <= bdp()) enterProbeBW(now);
+            break;
+
+        case PROBE_BW:
+            if (now - cycle_stamp_us_ > (int64_t) min_rtt_us_)
+            {
+                cycle_index_ = (cycle_index_ + 1) % 8;
+                cycle_stamp_us_ = now;
+                pacing_gain_ = cycleGain();
+            }
+            break;
+
+        case PROBE_RTT:
+            if (now >= probe_rtt_done_us_)
+            {
+                min_rtt_stamp_us_ = now;
+                enterProbeBW(now);
+            }
+            break;
+        }
+
+        // Refresh a stale minimum RTT
+        if (mode_ != PROBE_RTT
+         && now - min_rtt_stamp_us_ > min_rtt_window_us_)
+        {
+            mode_ = PROBE_RTT;
+            pacing_gain_ = 1.;
+            probe_rtt_done_us_ = now + std::max<int64_t>(probe_rtt_us_,
+                                                         (int64_t) min_rtt_us_);
+        }
+
+        apply();
+        publish(mode_name());
+    }
+
+    virtual void onLoss(const int32_t*, int)
+    {
+        publish(mode_name());
+    }
+
+    virtual void onTimeout()
+    {
+        publish(mode_name());
+    }
+
+private:
+    const char* mode_name() const
+    {
+        static const char* names[] = {
+            "startup", "drain", "probe_bw", "probe_rtt"
+        };
+        return names[mode_];
+    }
+
+    double cycleGain() const
+    {
+        switch (cycle_index_)
+        {
+        case 0:  return probe_gain_;
+        case 1:  return 2. - probe_gain_;
+        default: return 1.;
+        }
+    }
+
+    /**
+     * Bandwidth-delay product, in packets.
+     */
+    double bdp() const
+    {
+        return btl_bw_pps_ * min_rtt_us_ / 1e6;
+    }
+
+    int32_t inflight(int32_t ack) const
+    {
+        return std::max(0, detail::seq_offset(ack, m_iSndCurrSeqNo));
+    }
+
+    void updateBandwidth()
+    {
+        if (m_iRcvRate <= 0) return;
+
+        // Windowed maximum over the last bw_window_rounds_ rounds
+        while (!bw_samples_.empty() && bw_samples_.back().second <= m_iRcvRate)
+            bw_samples_.pop_back();
+        bw_samples_.push_back(std::make_pair(round_, double(m_iRcvRate)));
+        while (bw_samples_.front().first + bw_window_rounds_ <= round_)
+            bw_samples_.pop_front();
+
+        btl_bw_pps_ = bw_samples_.front().second;
+    }
+
+    void updateMinRTT(int64_t now)
+    {
+        if (m_iRTT <= 0) return;
+
+        if (min_rtt_us_ <= 0. || m_iRTT <= min_rtt_us_)
+        {
+            min_rtt_us_ = m_iRTT;
+            min_rtt_stamp_us_ = now;
+        }
+    }
+
+    void checkFullBandwidth()
+    {
+        if (btl_bw_pps_ >= full_bw_pps_ * 1.25)
+        {
+            full_bw_pps_ = btl_bw_pps_;
+            full_bw_rounds_ = 0;
+            return;
+        }
+
+        if (++full_bw_rounds_ >= 3)
+        {
+            mode_ = DRAIN;
+            pacing_gain_ = 1. / startup_gain_;
+        }
+    }
+
+    void enterProbeBW(int64_t now)
+    {
+        mode_ = PROBE_BW;
+        cycle_index_ = 0;
+        cycle_stamp_us_ = now;
+        pacing_gain_ = cycleGain();
+    }
+
+    /**
+     * Derive the sending period and window from the model.
+     */
+    void apply()
+    {
+        double rate_pps = pacing_gain_ * btl_bw_pps_;
+        if (max_rate_mbps_ > 0.)
+            rate_pps = std::min(rate_pps, max_rate_mbps_ * 1e6 / 8. / m_iMSS);
+        if (rate_pps > 0.) m_dPktSndPeriod = 1e6 / rate_pps;
+
+        if (mode_ == PROBE_RTT)
+            m_dCWndSize = 4.;
+        else if (min_rtt_us_ > 0.)
+            m_dCWndSize = std::max(16., cwnd_gain_ * bdp() + 16.);
+        else
+            m_dCWndSize = std::max(m_dCWndSize, 16.);
+    }
+
+    virtual void collect(State& state) const
+    {
+        state.add("btl_bw_mbps", btl_bw_pps_ * m_iMSS * 8. / 1e6);
+        state.add("min_rtt_us",  min_rtt_us_);
+        state.add("pacing_gain", pacing_gain_);
+        state.add("bdp_pkts",    bdp());
+        state.add("round",       double(round_));
+    }
+
+private:
+    Mode mode_;
+
+    double  startup_gain_;
+    double  cwnd_gain_;
+    double  probe_gain_;
+    int64_t bw_window_rounds_;
+    int64_t min_rtt_window_us_;
+    int64_t probe_rtt_us_;
+    double  initial_rate_mbps_;
+    double  max_rate_mbps_;
+
+    double  pacing_gain_;
+    double  btl_bw_pps_;
+    double  min_rtt_us_;
+    int64_t min_rtt_stamp_us_;
+    int64_t probe_rtt_done_us_;
+
+    int64_t round_;
+    int32_t round_end_seq_;
+    double  full_bw_pps_;
+    int     full_bw_rounds_;
+
+    int     cycle_index_;
+    int64_t cycle_stamp_us_;
+
+    /**
+     * (round, delivery rate) samples, decreasing rates.
+     */
+    std::deque<std::pair<int64_t, double> > bw_samples_;
+};
+
+const Param BBR::params[] = {
+    { "startup_gain",      2.885, "pacing gain of the startup phase" },
+    { "cwnd_gain",         2.,    "window, in bandwidth-delay products" },
+    { "probe_gain",        1.25,  "pacing gain of the bandwidth probes" },
+    { "bw_window_rounds",  10.,   "bandwidth filter length, in rounds" },
+    { "min_rtt_window_ms", 10000., "minimum RTT filter length, in ms" },
+    { "probe_rtt_ms",      200.,  "duration of the RTT probes, in ms" },
+    { "initial_rate_mbps", 10.,   "sending rate before the first sample" },
+    { "max_rate_mbps",     0.,    "sending rate cap, 0 for none", true },
+    { nullptr, 0., nullptr, false }
+};
+
+
+/**
+ * Scavenger (lower-than-best-effort) controller in the style of LEDBAT.
+ *
+ * The queueing delay is the RTT above its base value, the minimum over the
+ * last base_history_min minutes. The window grows in proportion to the gap
+ * between the queueing delay and its target, and shrinks as soon as the
+ * delay exceeds the target: the transfer fills idle capacity, but yields to
+ * the loss-based flows that build up the queues. Losses halve the window,
+ * once per RTT at most.
+ */
+class Ledbat : public Monitored<CCC>
+{
+public:
+    static const Param params[];
+
+    Ledbat()
+    : target_us_(25000.),
+      gain_(1.),
+      min_cwnd_(2.),
+      max_cwnd_(0.),
+      history_us_(60000000),
+      history_size_(10),
+      base_rtt_us_(0.),
+      queuing_us_(0.),
+      last_ack_(0),
+      last_decrease_us_(0),
+      history_stamp_us_(0)
+    {
+    }
+
+    virtual void configure(const Params& p)
+    {
+        target_us_    = p.at("target_ms") * 1e3;
+        gain_         = p.at("gain");
+        min_cwnd_     = p.at("min_cwnd_pkts");
+        max_cwnd_     = p.at("max_cwnd_pkts");
+        history_size_ = std::max<size_t>(1, (size_t) p.at("base_history_min"));
+    }
+
+    virtual void init()
+    {
+        m_dCWndSize = std::max(min_cwnd_, 16.);
+        m_dPktSndPeriod = 1.;
+        last_ack_ = m_iSndCurrSeqNo;
+        history_.assign(1, 0.);
+        history_stamp_us_ = detail::now_us();
+        publish(mode_name());
+    }
+
+    virtual void onACK(int32_t ack)
+    {
+        int64_t now = detail::now_us();
+        int32_t acked = std::max(0, detail::seq_offset(last_ack_, ack));
+        last_ack_ = ack;
+
+        if (m_iRTT <= 0 || acked == 0)
+        {
+            publish(mode_name());
+            return;
+        }
+
+        updateBaseRTT(now);
+        queuing_us_ = std::max(0., m_iRTT - base_rtt_us_);
+
+        double off_target = (target_us_ - queuing_us_) / target_us_;
+        setWindow(m_dCWndSize + gain_ * off_target * acked / m_dCWndSize);
+        publish(mode_name());
+    }
+
+    virtual void onLoss(const int32_t*, int)
+    {
+        int64_t now = detail::now_us();
+        if (now - last_decrease_us_ >= m_iRTT)
+        {
+            last_decrease_us_ = now;
+            setWindow(m_dCWndSize / 2.);
+        }
+        publish(mode_name());
+    }
+
+    virtual void onTimeout()
+    {
+        setWindow(min_cwnd_);
+        publish(mode_name());
+    }
+
+private:
+    const char* mode_name() const
+    {
+        return (queuing_us_ > target_us_)? "yield" : "fill";
+    }
+
+    /**
+     * Keep the minimum RTT of every interval of history_us_, and the base
+     * RTT as the minimum of the last history_size_ intervals, so that a
+     * route change eventually raises it.
+     */
+    void updateBaseRTT(int64_t now)
+    {
+        if (now - history_stamp_us_ >= history_us_)
+        {
+            history_stamp_us_ = now;
+            history_.push_back(m_iRTT);
+            if (history_.size() > history_size_)
+                history_.erase(history_.begin());
+        }
+        else if (history_.back() <= 0. || m_iRTT < history_.back())
+        {
+            history_.back() = m_iRTT;
+        }
+
+        base_rtt_us_ = history_.back();
+        for (size_t i = 0; i < history_.size(); ++i)
+        {
+            if (history_[i] > 0.) base_rtt_us_ = std::min(base_rtt_us_, history_[i]);
+        }
+    }
+
+    /**
+     * Clamp the window, and pace it over the RTT.
+     */
+    void setWindow(double cwnd)
+    {
+        double max_cwnd = (max_cwnd_ > 0.)? max_cwnd_ : m_dMaxCWndSize;
+        m_dCWndSize = std::max(min_cwnd_, cwnd);
+        if (max_cwnd > 0.) m_dCWndSize = std::min(m_dCWndSize, max_cwnd);
+
+        if (m_iRTT > 0) m_dPktSndPeriod = m_iRTT / m_dCWndSize;
+    }
+
+    virtual void collect(State& state) const
+    {
+        state.add("base_rtt_us", base_rtt_us_);
+        state.add("queuing_delay_us", queuing_us_);
+        state.add("target_us", target_us_);
+    }
+
+private:
+    double  target_us_;
+    double  gain_;
+    double  min_cwnd_;
+    double  max_cwnd_;
+    int64_t history_us_;
+    size_t  history_size_;
+
+    double  base_rtt_us_;
+    double  queuing_us_;
+    int32_t last_ack_;
+    int64_t last_decrease_us_;
+
+    /**
+     * Minimum RTT of the last intervals, the current one last.
+     */
+    std::vector<double> history_;
+    int64_t history_stamp_us_;
+};
+
+const Param Ledbat::params[] = {
+    { "target_ms",        25.,  "queueing delay target, in ms" },
+    { "gain",             1.,   "window growth, in packets per RTT at zero "
+                                "queueing delay" },
+    { "min_cwnd_pkts",    2.,   "minimum window, in packets" },
+    { "max_cwnd_pkts",    0.,   "maximum window, 0 for UDT_FC", true },
+    { "base_history_min", 10.,  "base RTT memory, in minutes" },
+    { nullptr, 0., nullptr, false }
+};
+
+
+// ------------------------------------------------------------------------
+//  Registry
+// ------------------------------------------------------------------------
+
+namespace detail {
+
+/**
+ * Create a controller and apply its parameters.
+ */
+template <class T>
+CCC* create(const char* name, const Params& params)
+{
+    T* cc = new T();
+    cc->setAlgorithm(name);
+    cc->configure(params);
+    return cc;
+}
+
+struct Algorithm
+{
+    const char*  name;
+    const char*  description;
+    const Param* params;
+    CCC*       (*create)(const char*, const Params&);
+};
+
+static const Algorithm algorithms[] = {
+    { "udt", "stock UDT rate-based AIMD",
+      NativeUDT::params, &create<NativeUDT> },
+    { "fixed_rate", "constant rate, loss-insensitive (dedicated circuits)",
+      FixedRate::params, &create<FixedRate> },
+    { "bbr", "model-based: bottleneck bandwidth and minimum RTT",
+      BBR::params, &create<BBR> },
+    { "ledbat", "scavenger: yields as soon as the queueing delay rises",
+      Ledbat::params, &create<Ledbat> },
+};
+
+static const size_t algorithm_count = sizeof(algorithms) / sizeof(algorithms[0]);
+
+/**
+ * Live controllers, by their CCC side.
+ */
+static std::mutex registry_mutex;
+static std::map<const CCC*, Controller*> registry;
+
+static
+const Algorithm* lookup(const std::string& name)
+{
+    for (size_t i = 0; i < algorithm_count; ++i)
+    {
+        if (name == algorithms[i].name) return &algorithms[i];
+    }
+    return nullptr;
+}
+
+/**
+ * Factory handed to UDT_CC: UDT clones it, and creates a controller for
+ * every connection.
+ */
+class Factory : public CCCVirtualFactory
+{
+public:
+    Factory(const Algorithm* algorithm, const Params& params)
+    : algorithm_(algorithm),
+      params_(params)
+    {
+    }
+
+    virtual CCC* create()
+    {
+        return algorithm_->create(algorithm_->name, params_);
+    }
+
+    virtual CCCVirtualFactory* clone()
+    {
+        return new Factory(*this);
+    }
+
+private:
+    const Algorithm* algorithm_;
+    Params params_;
+};
+
+} // namespace detail
+
+
+void track(const CCC* ccc, Controller* controller)
+{
+    std::lock_guard<std::mutex> lock(detail::registry_mutex);
+    detail::registry[ccc] = controller;
+}
+
+
+void untrack(const CCC* ccc)
+{
+    std::lock_guard<std::mutex> lock(detail::registry_mutex);
+    detail::registry.erase(ccc);
+}
+
+
+Controller::Controller()
+: algorithm_(nullptr),
+  state_()
+{
+}
+
+
+Controller::~Controller()
+{
+}
+
+
+void Controller::configure(const Params&)
+{
+}
+
+
+const char* Controller::algorithm() const
+{
+    return algorithm_;
+}
+
+
+void Controller::setAlgorithm(const char* algorithm)
+{
+    algorithm_ = algorithm;
+}
+
+
+void Controller::snapshot(State& state) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    state = state_;
+}
+
+
+void Controller::store(const State& state)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+}
+
+
+void set(UDTSOCKET u, const std::string& name, py::dict py_params) throw()
+{
+    const detail::Algorithm* algorithm = detail::lookup(name);
+    if (algorithm == nullptr)
+        translateError("Unknown congestion control: " + name);
+
+    // Defaults, then the given values
+    Params params;
+    std::map<std::string, const Param*> known;
+    for (const Param* p = algorithm->params; p->name != nullptr; ++p)
+    {
+        params[p->name] = p->value;
+        known[p->name] = p;
+    }
+
+    py::list keys = py_params.keys();
+    for (py::ssize_t i = 0; i < py::len(keys); ++i)
+    {
+        py::extract<std::string> get_name(keys[i]);
+        py::extract<double> get_value(py_params[keys[i]]);
+        if (!get_name.check() || !get_value.check())
+        {
+            translateError("Wrong arguments: set_congestion_control("
+                           "(str)name, (dict)params)");
+        }
+
+        std::string param = get_name();
+        std::map<std::string, const Param*>::const_iterator p =
+            known.find(param);
+        if (p == known.end())
+        {
+            translateError("Unknown parameter of congestion control "
+                           + name + ": " + param);
+        }
+
+        double value = get_value();
+        if (!std::isfinite(value) || value < 0.
+         || (value == 0. && !p->second->allow_zero))
+        {
+            translateValueError("Parameter " + param + " of congestion "
+                                "control " + name + " must be "
+                                + (p->second->allow_zero? "positive or 0"
+                                                        : "positive"));
+        }
+        params[param] = value;
+    }
+
+    detail::Factory factory(algorithm, params);
+    if (UDT::ERROR == UDT::setsockopt(u, 0, UDT_CC, &factory, sizeof(factory)))
+    {
+        translateUDTError();
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Congestion control of socket " << u << ": " << name);
+}
+
+
+py::dict state(UDTSOCKET u) throw()
+{
+    // UDT waits for a connection in progress to read an option
+    CCC* ccc = nullptr;
+    int len = sizeof(ccc);
+    int res_get;
+    Py_BEGIN_ALLOW_THREADS;
+    res_get = UDT::getsockopt(u, 0, UDT_CC, &ccc, &len);
+    Py_END_ALLOW_THREADS;
+    if (UDT::ERROR == res_get)
+    {
+        translateUDTError();
+        return py::dict();
+    }
+
+    // Only read the controller while it is registered: the socket may have
+    // been freed, and its controller with it, since UDT returned it
+    const char* algorithm = nullptr;
+    State state;
+    {
+        std::lock_guard<std::mutex> lock(detail::registry_mutex);
+        std::map<const CCC*, Controller*>::const_iterator iter =
+            detail::registry.find(ccc);
+        if (iter != detail::registry.end())
+        {
+            algorithm = iter->second->algorithm();
+            iter->second->snapshot(state);
+        }
+    }
+
+    py::dict res;
+    if (algorithm == nullptr)
+    {
+        res["algorithm"] = py::object();
+        return res;
+    }
+
+    res["algorithm"] = algorithm;
+    if (state.mode != nullptr) res["mode"] = state.mode;
+    res["pkt_snd_period_us"] = state.pkt_snd_period_us;
+    res["cwnd_pkts"]         = state.cwnd_pkts;
+    res["rtt_us"]            = state.rtt_us;
+    res["bandwidth_pps"]     = state.bandwidth_pps;
+    res["rcv_rate_pps"]      = state.rcv_rate_pps;
+    res["send_rate_mbps"]    = state.send_rate_mbps;
+    for (size_t i = 0; i < state.count; ++i)
+        res[state.names[i]] = state.values[i];
+    return res;
+}
+
+
+py::dict algorithms()
+{
+    py::dict res;
+    for (size_t i = 0; i < detail::algorithm_count; ++i)
+    {
+        const detail::Algorithm& a = detail::algorithms[i];
+
+        py::dict params;
+        for (const Param* p = a.params; p->name != nullptr; ++p)
+            params[p->name] = p->value;
+
+        py::dict d;
+        d["description"] = a.description;
+        d["params"] = params;
+        res[a.name] = d;
+    }
+    return res;
+}
+
+} // namespace cc
+
+} // namespace pyudt4
@@ -0,0 +1,17 @@
+#include "Counters.hh"
+
+namespace pyudt4 {
+
+namespace counters {
+
+#define PYUDT_COUNTER_INFO(name, help) { #name, help },
+
+const Info info[count] = { PYUDT_COUNTERS(PYUDT_COUNTER_INFO) };
+
+#undef PYUDT_COUNTER_INFO
+
+std::atomic<uint64_t> values[count];
+
+} // namespace counters
+
+} // namespace pyudt4
@@ -0,0 +1,354 @@
+#include "Debug.hh"
+
+#include <log4cxx/spi/location/locationinfo.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "Exception.hh"
+
+namespace pyudt4 {
+
+namespace logging {
+
+std::atomic<int>  runtime_level(INFO);
+std::atomic<bool> async_enabled(false);
+
+namespace detail {
+
+/**
+ * Names of the levels, as used from Python.
+ */
+static const char* const level_names[] = { "TRACE", "DEBUG", "INFO", "WARN",
+                                           "ERROR", "OFF" };
+
+static
+log4cxx::LevelPtr to_log4cxx(Level level)
+{
+    switch (level)
+    {
+    case TRACE: return log4cxx::Level::getTrace();
+    case DEBUG: return log4cxx::Level::getDebug();
+    case INFO:  return log4cxx::Level::getInfo();
+    case WARN:  return log4cxx::Level::getWarn();
+    case ERROR: return log4cxx::Level::getError();
+    default:    return log4cxx::Level::getOff();
+    }
+}
+
+static
+Level from_log4cxx(int level)
+{
+    if (level <= log4cxx::Level::TRACE_INT) return TRACE;
+    if (level <= log4cxx::Level::DEBUG_INT) return DEBUG;
+    if (level <= log4cxx::Level::INFO_INT)  return INFO;
+    if (level <= log4cxx::Level::WARN_INT)  return WARN;
+    if (level <= log4cxx::Level::ERROR_INT) return ERROR;
+    return OFF;
+}
+
+static
+void forced_log(Level level, const std::string& message,
+                const char* file, const char* function, int line)
+{
+    logger()->forcedLog(to_log4cxx(level), message,
+                        log4cxx::spi::LocationInfo(file, function, line));
+}
+
+/**
+ * Bounded lock-free multi-producer queue drained by a single logging thread
+ * (D. Vyukov's bounded MPMC queue). Producers never wait: when the queue is
+ * full, the message is dropped.
+ *
+ * Producers check async_enabled once registered as pushing, so that stop()
+ * can wait for the pushes in progress after clearing it: the messages that
+ * see it cleared are logged synchronously, the others are drained.
+ */
+class AsyncBackend
+{
+public:
+    static const size_t capacity    = 1024;
+    static const size_t max_message = 512;
+
+    AsyncBackend()
+    : enqueue_(0),
+      dequeue_(0),
+      dropped_(0),
+      pushing_(0),
+      running_(false)
+    {
+        for (size_t i = 0; i < capacity; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~AsyncBackend()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) return;
+
+        running_.store(true);
+        thread_ = std::thread(&AsyncBackend::run, this);
+    }
+
+    /**
+     * Stop the logging thread and write the queued messages. Called once
+     * async_enabled is cleared.
+     */
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+
+        while (pushing_.load() != 0) std::this_thread::yield();
+
+        running_.store(false);
+        thread_.join();
+        drain();
+    }
+
+    /**
+     * Queue a message, unless async_enabled was cleared.
+     * @return false if the message must be logged synchronously.
+     */
+    bool push(Level level, const std::string& message,
+              const char* file, const char* function, int line)
+    {
+        pushing_.fetch_add(1);
+        if (!async_enabled.load())
+        {
+            pushing_.fetch_sub(1);
+            return false;
+        }
+
+        enqueue(level, message, file, function, line);
+        pushing_.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void enqueue(Level level, const std::string& message,
+                 const char* file, const char* function, int line)
+    {
+        size_t pos = enqueue_.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;)
+        {
+            slot = &slots_[pos % capacity];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+            if (diff == 0)
+            {
+                if (enqueue_.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else pos = enqueue_.load(std::memory_order_relaxed);
+        }
+
+        slot->level    = level;
+        slot->file     = file;
+        slot->function = function;
+        slot->line     = line;
+        slot->length   = std::min(message.size(), max_message);
+        memcpy(slot->message, message.data(), slot->length);
+
+        slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        Level               level;
+        const char*         file;
+        const char*         function;
+        int                 line;
+        size_t              length;
+        char                message[max_message];
+    };
+
+    /**
+     * Write every queued message. Only called from the logging thread, or
+     * once it stopped.
+     */
+    bool drain()
+    {
+        bool any = false;
+
+        for (;;)
+        {
+            Slot& slot = slots_[dequeue_ % capacity];
+            if (slot.seq.load(std::memory_order_acquire) != dequeue_ + 1)
+                return any;
+
+            forced_log(slot.level, std::string(slot.message, slot.length),
+                       slot.file, slot.function, slot.line);
+
+            slot.seq.store(dequeue_ + capacity, std::memory_order_release);
+            ++dequeue_;
+            any = true;
+        }
+    }
+
+    void run()
+    {
+        while (running_.load())
+        {
+            if (!drain())
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+private:
+    Slot slots_[capacity];
+
+    std::atomic<size_t>   enqueue_;
+    size_t                dequeue_;
+    std::atomic<uint64_t> dropped_;
+
+    /**
+     * Producers between their check of async_enabled and their enqueue.
+     */
+    std::atomic<int> pushing_;
+
+    /**
+     * Serializes start() and stop().
+     */
+    std::mutex mutex_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+const size_t AsyncBackend::capacity;
+const size_t AsyncBackend::max_message;
+
+static
+AsyncBackend& backend()
+{
+    static AsyncBackend b;
+    return b;
+}
+
+} // namespace detail
+
+
+log4cxx::Logger* logger()
+{
+    // Looked up once: getLogger() locks the logger hierarchy
+    static log4cxx::LoggerPtr l(log4cxx::Logger::getLogger("pyudt"));
+    return &*l;
+}
+
+
+void write(Level level, const std::string& message,
+           const char* file, const char* function, int line)
+{
+    if (async_enabled.load(std::memory_order_relaxed)
+     && detail::backend().push(level, message, file, function, line))
+        return;
+
+    detail::forced_log(level, message, file, function, line);
+}
+
+
+void set_level(Level level)
+{
+    logger()->setLevel(detail::to_log4cxx(level));
+    runtime_level.store(level, std::memory_order_relaxed);
+}
+
+
+void set_async(bool async)
+{
+    if (async)
+    {
+        detail::backend().start();
+        async_enabled.store(true);
+    }
+    else
+    {
+        async_enabled.store(false);
+        detail::backend().stop();
+    }
+}
+
+
+uint64_t dropped()
+{
+    return detail::backend().dropped();
+}
+
+} // namespace logging
+
+
+void Logger::load_logger_configuration(std::string filename)
+{
+    log4cxx::PropertyConfigurator::configure(filename.c_str());
+
+    // Follow the level set by the configuration
+    logging::runtime_level.store(
+        logging::detail::from_log4cxx(
+            logging::logger()->getEffectiveLevel()->toInt()),
+        std::memory_order_relaxed);
+}
+
+
+void Logger::set_level(std::string level)
+{
+    for (int i = logging::TRACE; i <= logging::OFF; ++i)
+    {
+        if (level == logging::detail::level_names[i])
+        {
+            logging::set_level(logging::Level(i));
+            return;
+        }
+    }
+
+    translateError("Unknown log level: " + level);
+}
+
+
+std::string Logger::get_level()
+{
+    return logging::detail::level_names[
+        logging::runtime_level.load(std::memory_order_relaxed)];
+}
+
+
+void Logger::set_async(bool async)
+{
+    logging::set_async(async);
+}
+
+
+bool Logger::get_async()
+{
+    return logging::async_enabled;
+}
+
+
+uint64_t Logger::dropped()
+{
+    return logging::dropped();
+}
+
+} // namespace pyudt4
@@ -3,8 +3,13 @@
 #include <udt/udt.h>
 #include <iostream>
 #include <set>
+#include <vector>
+#include <algorithm>
 #include <boost/python.hpp>
 
+#include "Perfmon.hh"
+#include "Stats.hh"
+#include "Probes.hh"
 #include "Exception.hh"
 #include "Debug.hh"
 
@@ -356,20 +361,42 @@ int Epoll::wait(int64_t ms_timeout,
                 bool do_uread, bool do_uwrite,
                 bool do_sread, bool do_swrite) throw ()
 {
-    int res = UDT::epoll_wait(id_,
-                             (do_uread)? &read_udt_:nullptr,
-                             (do_uwrite)? &write_udt_:nullptr,
-                             ms_timeout,
-                             (do_sread)? &read_sys_:nullptr,
-                             (do_swrite)? &write_sys_:nullptr);
+    stats::CallScope scope(stats::epoll_wait, id_);
+    int res;
+
+    // Other threads may read the member sets meanwhile: fill local ones
+    // without the GIL, and publish them once it is held again
+    std::set<UDTSOCKET> read_udt, write_udt;
+    std::set<SYSSOCKET> read_sys, write_sys;
+
+    PYUDT_PROBE2(epoll_wait_entry, id_, ms_timeout);
+    scope.releaseGIL();
+    res = UDT::epoll_wait(id_,
+                          (do_uread)? &read_udt:nullptr,
+                          (do_uwrite)? &write_udt:nullptr,
+                          ms_timeout,
+                          (do_sread)? &read_sys:nullptr,
+                          (do_swrite)? &write_sys:nullptr);
+    scope.acquireGIL();
+    PYUDT_PROBE2(epoll_wait_return, id_, res);
+
+    if (do_uread) read_udt_.swap(read_udt);
+    if (do_uwrite) write_udt_.swap(write_udt);
+    if (do_sread) read_sys_.swap(read_sys);
+    if (do_swrite) write_sys_.swap(write_sys);
 
     if (res == UDT::ERROR)
     {
         if (UDT::getlasterror().getErrorCode() == CUDTException::ETIMEOUT)
             res = 0;
-        else translateUDTError();
+        else
+        {
+            scope.setError();
+            translateUDTError();
+        }
     }
 
+    scope.setResult(res);
     PYUDT_LOG_TRACE("Number of UDT/system sockets ready for IO in epoll "
                     << id_ << ": " << res);
 
@@ -377,6 +404,39 @@ int Epoll::wait(int64_t ms_timeout,
 }
 
 
+const std::map<UDTSOCKET, Socket*>& Epoll::getSockets() const
+{
+    return objmap_;
+}
+
+
+int Epoll::perfmon_all(py::object py_out, bool clear) const throw()
+{
+    perfmon::BufferView view(py_out, 0, "Epoll::perfmon_all(out, clear)");
+
+    // Snapshot the registry while holding the GIL
+    std::vector<UDTSOCKET> sockets;
+    sockets.reserve(objmap_.size());
+    for (std::map<UDTSOCKET, Socket*>::const_iterator iter = objmap_.begin();
+         iter != objmap_.end();
+         ++iter)
+    {
+        sockets.push_back(iter->first);
+    }
+
+    size_t count = std::min(sockets.size(),
+                            view.size() / sizeof(perfmon::Record));
+
+    Py_BEGIN_ALLOW_THREADS;
+    perfmon::sample(sockets.data(), count, view.data(), clear);
+    Py_END_ALLOW_THREADS;
+
+    PYUDT_LOG_TRACE("Sampled " << count << " socket(s) of epoll " << id_);
+
+    return (int) count;
+}
+
+
 const std::set<UDTSOCKET> Epoll::get_read_udt() const
 {
     return read_udt_;
@@ -2,14 +2,85 @@
 
 #include <Python.h>
 #include <udt/udt.h>
+#include <cerrno>
+#include <cstring>
 
 #include <boost/python.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "Counters.hh"
 #include "Debug.hh"
 
 namespace pyudt4 {
 
+namespace detail {
+
+/**
+ * Preallocated Python exception raised for a UDT error code.
+ */
+struct FastError
+{
+    PyObject* type;
+    PyObject* args;
+};
+
+static PyObject* udt_error = nullptr;
+static FastError would_block_snd = { nullptr, nullptr };
+static FastError would_block_rcv = { nullptr, nullptr };
+static FastError timeout         = { nullptr, nullptr };
+
+static
+PyObject* new_exception(const char* name, PyObject* base)
+{
+    std::string qualified = std::string("udt4_ext.") + name;
+
+    PyObject* type = PyErr_NewException(const_cast<char*>(qualified.c_str()),
+                                        base, nullptr);
+    if (!type) boost::python::throw_error_already_set();
+
+    boost::python::scope().attr(name) =
+        boost::python::handle<>(boost::python::borrowed(type));
+    return type;
+}
+
+static
+FastError new_fast_error(PyObject* type, int code, const char* message)
+{
+    FastError error;
+    error.type = type;
+    error.args = Py_BuildValue("(is)", code, message);
+    if (!error.args) boost::python::throw_error_already_set();
+    return error;
+}
+
+/**
+ * Raise the preallocated exception of a UDT error code, if any.
+ */
+static
+bool set_fast_error(int code)
+{
+    const FastError* error = nullptr;
+
+    if (code == CUDTException::EASYNCSND)
+        error = &would_block_snd;
+    else if (code == CUDTException::EASYNCRCV)
+        error = &would_block_rcv;
+    else if (code == CUDTException::ETIMEOUT)
+        error = &timeout;
+
+    if (!error || !error->type) return false;
+
+    if (error != &timeout)
+        counters::add(counters::would_block);
+    else
+        counters::add(counters::udt_errors);
+
+    PyErr_SetObject(error->type, error->args);
+    return true;
+}
+
+} // namespace detail
+
 Exception::Exception(std::string message,
                      std::string extraData)
 : message_(message),
@@ -82,8 +153,17 @@ void translateException(const Exception& e)
 
 void translateUDTError() throw()
 {
+    // Fast path: nothing to format nor log
+    if (detail::set_fast_error(UDT::getlasterror().getErrorCode()))
+    {
+        UDT::getlasterror().clear();
+        throw boost::python::error_already_set();
+    }
+
+    counters::add(counters::udt_errors);
+
     // Get the error message
-    long err_code = UDT::getlasterror().getErrorCode();
+    int err_code = UDT::getlasterror().getErrorCode();
     std::string err_msg = "[UDT error "
                         + boost::lexical_cast<std::string>(err_code)
                         + "] " + UDT::getlasterror().getErrorMessage();
@@ -91,10 +171,65 @@ void translateUDTError() throw()
     // Clear the error message from the error buffer
     UDT::getlasterror().clear();
 
-    // Raise an exception
-    Exception e(err_msg, "");
+    // Raise a UDTError carrying the code
+    PYUDT_LOG_ERROR(err_msg);
+
+    if (!detail::udt_error)
+    {
+        PyErr_SetString(PyExc_TypeError, err_msg.c_str());
+        throw boost::python::error_already_set();
+    }
+
+    PyObject* args = Py_BuildValue("(is)", err_code, err_msg.c_str());
+    if (args)
+    {
+        PyErr_SetObject(detail::udt_error, args);
+        Py_DECREF(args);
+    }
+    throw boost::python::error_already_set();
+}
+
+void translateTimeout() throw()
+{
+    detail::set_fast_error(CUDTException::ETIMEOUT);
+    throw boost::python::error_already_set();
+}
+
+void translateError(const std::string& message)
+{
+    Exception e(message, "");
     translateException(e);
     throw e;
 }
 
+void translateValueError(const std::string& message)
+{
+    PYUDT_LOG_ERROR(message);
+
+    PyErr_SetString(PyExc_ValueError, message.c_str());
+    throw boost::python::error_already_set();
+}
+
+void translateSystemError(const std::string& what)
+{
+    translateError(what + ": " + strerror(errno));
+}
+
+void registerUDTExceptions()
+{
+    detail::udt_error = detail::new_exception("UDTError", PyExc_TypeError);
+
+    PyObject* would_block = detail::new_exception("WouldBlockError",
+                                                  detail::udt_error);
+    detail::would_block_snd = detail::new_fast_error(
+        would_block, CUDTException::EASYNCSND,
+        "Non-blocking send would block");
+    detail::would_block_rcv = detail::new_fast_error(
+        would_block, CUDTException::EASYNCRCV,
+        "Non-blocking receive would block");
+    detail::timeout = detail::new_fast_error(
+        detail::new_exception("UDTTimeoutError", detail::udt_error),
+        CUDTException::ETIMEOUT, "Operation timed out");
+}
+
 } // namespace pyudt4
@@ -0,0 +1,161 @@
+#include "Histogram.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+const int      Histogram::sub_bits;
+const int      Histogram::sub_count;
+const int      Histogram::max_exponent;
+const size_t   Histogram::bucket_count;
+const uint64_t Histogram::max_value;
+
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+
+size_t Histogram::bucket(uint64_t value)
+{
+    if (value < (uint64_t) sub_count) return (size_t) value;
+    if (value > max_value) value = max_value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - sub_bits;
+    return (shift + 1) * sub_count + (size_t) ((value >> shift) - sub_count);
+}
+
+
+uint64_t Histogram::lower_bound(size_t bucket)
+{
+    if (bucket < (size_t) sub_count) return bucket;
+
+    int shift = (int) (bucket / sub_count) - 1;
+    uint64_t mantissa = bucket % sub_count + sub_count;
+    return mantissa << shift;
+}
+
+
+uint64_t Histogram::upper_bound(size_t bucket)
+{
+    if (bucket + 1 >= bucket_count) return max_value;
+    return lower_bound(bucket + 1) - 1;
+}
+
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    counts[bucket(value)] += count;
+    total += count;
+    sum   += value * count;
+    max    = std::max(max, value);
+}
+
+
+void Histogram::merge(const Histogram& other)
+{
+    for (size_t i = 0; i < bucket_count; ++i) counts[i] += other.counts[i];
+    total += other.total;
+    sum   += other.sum;
+    max    = std::max(max, other.max);
+}
+
+
+void Histogram::subtract(const Histogram& other)
+{
+    for (size_t i = 0; i < bucket_count; ++i)
+        counts[i] -= std::min(counts[i], other.counts[i]);
+    total -= std::min(total, other.total);
+    sum   -= std::min(sum, other.sum);
+
+    // The maximum cannot be subtracted: keep the bucket bound instead
+    max = 0;
+    for (size_t i = bucket_count; i-- > 0; )
+    {
+        if (counts[i])
+        {
+            max = upper_bound(i);
+            break;
+        }
+    }
+}
+
+
+void Histogram::clear()
+{
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    sum   = 0;
+    max   = 0;
+}
+
+
+uint64_t Histogram::count() const
+{
+    return total;
+}
+
+
+uint64_t Histogram::quantile(double q) const
+{
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t) (q * total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        seen += counts[i];
+        if (seen > rank) return std::min(upper_bound(i), max);
+    }
+    return max;
+}
+
+
+py::dict Histogram::toPython(double scale) const
+{
+    py::list buckets;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        if (counts[i])
+            buckets.append(py::make_tuple(upper_bound(i) * scale, counts[i]));
+    }
+
+    py::dict res;
+    res["count"]   = total;
+    res["sum"]     = sum * scale;
+    res["max"]     = max * scale;
+    res["p50"]     = quantile(0.5) * scale;
+    res["p90"]     = quantile(0.9) * scale;
+    res["p99"]     = quantile(0.99) * scale;
+    res["p999"]    = quantile(0.999) * scale;
+    res["buckets"] = buckets;
+    return res;
+}
+
+
+ShardHistogram::ShardHistogram()
+: total_(0),
+  sum_(0),
+  max_(0)
+{
+    for (size_t i = 0; i < Histogram::bucket_count; ++i) counts_[i] = 0;
+}
+
+
+void ShardHistogram::mergeInto(Histogram& out) const
+{
+    for (size_t i = 0; i < Histogram::bucket_count; ++i)
+        out.counts[i] += counts_[i].load(std::memory_order_relaxed);
+    out.total += total_.load(std::memory_order_relaxed);
+    out.sum   += sum_.load(std::memory_order_relaxed);
+    out.max    = std::max(out.max, max_.load(std::memory_order_relaxed));
+}
+
+} // namespace pyudt4
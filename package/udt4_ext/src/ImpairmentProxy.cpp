@@ -0,0 +1,679 @@
+#include "ImpairmentProxy.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <random>
+#include <vector>
+#include <arpa/inet.h>  // inet_pton
+#include <poll.h>       // ppoll
+#include <sys/socket.h>
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // close
+
+#include "UDPSocket.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * How often the relay thread checks whether it should stop, in nanoseconds.
+ */
+static const int64_t proxy_poll_ns = 200000000;
+
+/**
+ * Largest datagram relayed, in bytes.
+ */
+static const size_t proxy_max_datagram = 65536;
+
+/**
+ * Largest number of datagrams read from a socket per poll, so that a busy
+ * socket cannot delay the due datagrams.
+ */
+static const int proxy_receive_batch = 64;
+
+/**
+ * Kernel buffer size of the relay sockets, in bytes.
+ */
+static const int proxy_kernel_buffer = 4 << 20;
+
+/**
+ * Largest number of client addresses, each with its own upstream socket.
+ */
+static const size_t proxy_max_clients = 1024;
+
+typedef ImpairmentProxy::Impairment Impairment;
+
+/**
+ * Impairment field settable from Python.
+ */
+struct ImpairmentField
+{
+    const char* name;
+    double Impairment::* field;
+    double max;     /**< largest accepted value (probabilities) */
+};
+
+static const ImpairmentField impairment_fields[] = {
+    { "delay_ms",    &Impairment::delay_ms,    1e9 },
+    { "jitter_ms",   &Impairment::jitter_ms,   1e9 },
+    { "loss",        &Impairment::loss,        1.  },
+    { "loss_burst",  &Impairment::loss_burst,  1e9 },
+    { "reorder",     &Impairment::reorder,     1.  },
+    { "reorder_ms",  &Impairment::reorder_ms,  1e9 },
+    { "duplicate",   &Impairment::duplicate,   1.  },
+    { "rate_mbps",   &Impairment::rate_mbps,   1e9 },
+    { "burst_bytes", &Impairment::burst_bytes, 1e12 },
+    { "queue_bytes", &Impairment::queue_bytes, 1e12 },
+};
+
+static const size_t impairment_field_count =
+    sizeof(impairment_fields) / sizeof(impairment_fields[0]);
+
+/**
+ * Packet counters of a direction.
+ */
+struct ProxyCounters
+{
+    uint64_t received;
+    uint64_t sent;
+    uint64_t sent_bytes;
+    uint64_t lost;
+    uint64_t queue_dropped;
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t send_errors;
+};
+
+/**
+ * Delayed datagram.
+ */
+struct ProxyPacket
+{
+    int64_t     due_ns;
+    uint64_t    seq;
+    int         sock;
+    sockaddr_in to;
+    std::string data;
+};
+
+struct LaterPacket
+{
+    bool operator()(const ProxyPacket* a, const ProxyPacket* b) const
+    {
+        return (a->due_ns != b->due_ns)? a->due_ns > b->due_ns
+                                       : a->seq > b->seq;
+    }
+};
+
+static
+int64_t proxy_now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static
+uint64_t address_key(const sockaddr_in& addr)
+{
+    return (uint64_t(ntohl(addr.sin_addr.s_addr)) << 16)
+         | ntohs(addr.sin_port);
+}
+
+static
+ImpairmentProxy::Direction parse_direction(const std::string& direction)
+{
+    if (direction == "forward") return ImpairmentProxy::FORWARD;
+    if (direction == "reverse") return ImpairmentProxy::REVERSE;
+
+    translateError("Wrong arguments: ImpairmentProxy: unknown direction "
+                   + direction);
+    return ImpairmentProxy::FORWARD;
+}
+
+} // namespace detail
+
+
+/**
+ * State of a direction.
+ */
+struct ImpairmentProxy::Link
+{
+    Impairment impairment;
+    detail::ProxyCounters counters;
+
+    /** Gilbert-Elliott state: losing every packet. */
+    bool bad;
+
+    /** Token bucket: available bytes (negative when packets wait). */
+    double tokens;
+    int64_t refill_ns;
+
+    std::mt19937_64 rng;
+
+    explicit Link(uint64_t seed)
+    : counters(),
+      bad(false),
+      tokens(0),
+      refill_ns(0),
+      rng(seed)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        bad = false;
+        tokens = impairment.burst_bytes;
+        refill_ns = detail::proxy_now_ns();
+    }
+
+    double uniform()
+    {
+        return std::uniform_real_distribution<double>(0., 1.)(rng);
+    }
+
+    bool chance(double p)
+    {
+        return (p > 0.) && uniform() < p;
+    }
+
+    bool lose()
+    {
+        const Impairment& i = impairment;
+        if (i.loss <= 0.) return false;
+        if (i.loss >= 1.) return true;
+        if (i.loss_burst <= 1.) return chance(i.loss);
+
+        // Mean burst length 1/p_bg, stationary loss rate p_gb/(p_gb + p_bg)
+        double p_bg = 1. / i.loss_burst;
+        double p_gb = i.loss * p_bg / (1. - i.loss);
+        if (chance(bad? p_bg : p_gb)) bad = !bad;
+        return bad;
+    }
+
+    /**
+     * Take tokens for a packet.
+     * @return the time the packet must wait for tokens, or -1 if the
+     *         queue is full.
+     */
+    int64_t shape(size_t size, int64_t now_ns)
+    {
+        const Impairment& i = impairment;
+        if (i.rate_mbps <= 0.) return 0;
+
+        double rate = i.rate_mbps * 1e6 / 8. / 1e9; // bytes per ns
+        tokens = std::min(i.burst_bytes,
+                          tokens + (now_ns - refill_ns) * rate);
+        refill_ns = now_ns;
+
+        tokens -= size;
+        if (tokens >= 0.) return 0;
+
+        if (-tokens > i.queue_bytes)
+        {
+            tokens += size;
+            return -1;
+        }
+        return int64_t(-tokens / rate);
+    }
+};
+
+
+/**
+ * Datagrams waiting for their departure time.
+ */
+struct ImpairmentProxy::Queue
+{
+    std::priority_queue<detail::ProxyPacket*,
+                        std::vector<detail::ProxyPacket*>,
+                        detail::LaterPacket> packets;
+    uint64_t seq;
+
+    Queue() : seq(0) {}
+
+    ~Queue()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        while (!packets.empty())
+        {
+            delete packets.top();
+            packets.pop();
+        }
+    }
+};
+
+
+/**
+ * Upstream socket of every client address.
+ */
+struct ImpairmentProxy::Clients
+{
+    sockaddr_in target;
+    std::map<uint64_t, int> upstream;
+    std::map<int, sockaddr_in> clients;
+
+    ~Clients()
+    {
+        for (std::map<int, sockaddr_in>::const_iterator iter = clients.begin();
+             iter != clients.end();
+             ++iter)
+        {
+            ::close(iter->first);
+        }
+    }
+
+    /**
+     * Return the upstream socket of a client, or -1.
+     */
+    int get(const sockaddr_in& client)
+    {
+        uint64_t key = detail::address_key(client);
+        std::map<uint64_t, int>::const_iterator iter = upstream.find(key);
+        if (iter != upstream.end()) return iter->second;
+
+        if (upstream.size() >= detail::proxy_max_clients)
+        {
+            PYUDT_LOG_ERROR("Impairment proxy: too many clients");
+            return -1;
+        }
+
+        int sock = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock < 0
+         || ::connect(sock, (const sockaddr*) &target, sizeof(target)) != 0)
+        {
+            PYUDT_LOG_ERROR("Impairment proxy: could not create upstream "
+                            "socket: " << strerror(errno));
+            if (sock >= 0) ::close(sock);
+            return -1;
+        }
+        udp::set_kernel_buffer(sock, SO_SNDBUF, detail::proxy_kernel_buffer);
+        udp::set_kernel_buffer(sock, SO_RCVBUF, detail::proxy_kernel_buffer);
+
+        upstream[key] = sock;
+        clients[sock] = client;
+        return sock;
+    }
+};
+
+
+ImpairmentProxy::Impairment::Impairment()
+: delay_ms(0.),
+  jitter_ms(0.),
+  loss(0.),
+  loss_burst(1.),
+  reorder(0.),
+  reorder_ms(1.),
+  duplicate(0.),
+  rate_mbps(0.),
+  burst_bytes(15000.),
+  queue_bytes(1 << 20)
+{
+}
+
+
+ImpairmentProxy::ImpairmentProxy(std::string target_ip, uint16_t target_port,
+                                 std::string ip, uint16_t port, uint64_t seed)
+: listener_(-1),
+  port_(0),
+  running_(false),
+  queue_(new Queue()),
+  clients_(new Clients())
+{
+    memset(&clients_->target, 0, sizeof(clients_->target));
+    clients_->target.sin_family = AF_INET;
+    clients_->target.sin_port = htons(target_port);
+    if (inet_pton(AF_INET, target_ip.c_str(),
+                  &clients_->target.sin_addr) != 1)
+    {
+        translateError("Wrong arguments: ImpairmentProxy: invalid "
+                       "address " + target_ip);
+    }
+
+    // Independent random streams, so that impairing one direction does not
+    // change the decisions made for the other
+    links_[FORWARD].reset(new Link(seed));
+    links_[REVERSE].reset(new Link(seed ^ 0x9e3779b97f4a7c15ULL));
+
+    listener_ = udp::open(ip.c_str(), port, detail::proxy_kernel_buffer,
+                          detail::proxy_kernel_buffer);
+    port_ = udp::get_port(listener_);
+
+    PYUDT_LOG_TRACE("Impairment proxy listening on " << ip << ":" << port_
+                    << ", relaying to " << target_ip << ":" << target_port);
+}
+
+
+ImpairmentProxy::~ImpairmentProxy()
+{
+    stop();
+
+    if (listener_ >= 0) ::close(listener_);
+}
+
+
+void ImpairmentProxy::start()
+{
+    if (running_.exchange(true)) return;
+
+    thread_ = std::thread(&ImpairmentProxy::run, this);
+}
+
+
+void ImpairmentProxy::stop()
+{
+    if (!running_.exchange(false)) return;
+
+    Py_BEGIN_ALLOW_THREADS;
+    thread_.join();
+    Py_END_ALLOW_THREADS;
+
+    queue_->clear();
+}
+
+
+bool ImpairmentProxy::isRunning() const
+{
+    return running_;
+}
+
+
+void ImpairmentProxy::configure(py::dict params, std::string direction) throw()
+{
+    Impairment impairment;
+
+    py::list keys = params.keys();
+    for (py::ssize_t k = 0; k < py::len(keys); ++k)
+    {
+        py::extract<std::string> get_name(keys[k]);
+        py::extract<double> get_value(params[keys[k]]);
+        if (!get_name.check() || !get_value.check())
+        {
+            translateError("Wrong arguments: ImpairmentProxy::"
+                           "configure((dict)params, (str)direction)");
+        }
+
+        std::string name = get_name();
+        double value = get_value();
+
+        const detail::ImpairmentField* field = nullptr;
+        for (size_t i = 0; i < detail::impairment_field_count; ++i)
+        {
+            if (name == detail::impairment_fields[i].name)
+                field = &detail::impairment_fields[i];
+        }
+
+        if (field == nullptr)
+            translateError("Unknown impairment: " + name);
+        if (!(value >= 0. && value <= field->max))
+            translateError("Impairment out of range: " + name);
+
+        impairment.*(field->field) = value;
+    }
+
+    if (direction == "both")
+    {
+        setImpairment(FORWARD, impairment);
+        setImpairment(REVERSE, impairment);
+    }
+    else
+    {
+        setImpairment(detail::parse_direction(direction), impairment);
+    }
+}
+
+
+void ImpairmentProxy::setImpairment(Direction direction,
+                                    const Impairment& impairment)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Link& link = *links_[direction];
+    link.impairment = impairment;
+    link.reset();
+}
+
+
+py::dict ImpairmentProxy::impairment(std::string direction) throw()
+{
+    Direction d = detail::parse_direction(direction);
+
+    Impairment impairment;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        impairment = links_[d]->impairment;
+    }
+
+    py::dict res;
+    for (size_t i = 0; i < detail::impairment_field_count; ++i)
+    {
+        res[detail::impairment_fields[i].name] =
+            impairment.*(detail::impairment_fields[i].field);
+    }
+    return res;
+}
+
+
+py::dict ImpairmentProxy::stats()
+{
+    detail::ProxyCounters counters[2];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters[FORWARD] = links_[FORWARD]->counters;
+        counters[REVERSE] = links_[REVERSE]->counters;
+    }
+
+    const char* names[] = { "forward", "reverse" };
+    py::dict res;
+    for (int d = 0; d < 2; ++d)
+    {
+        const detail::ProxyCounters& c = counters[d];
+        py::dict link;
+        link["received"]      = c.received;
+        link["sent"]          = c.sent;
+        link["sent_bytes"]    = c.sent_bytes;
+        link["lost"]          = c.lost;
+        link["queue_dropped"] = c.queue_dropped;
+        link["duplicated"]    = c.duplicated;
+        link["reordered"]     = c.reordered;
+        link["send_errors"]   = c.send_errors;
+        res[names[d]] = link;
+    }
+    return res;
+}
+
+
+uint16_t ImpairmentProxy::getPort() const
+{
+    return port_;
+}
+
+
+void ImpairmentProxy::run()
+{
+    std::vector<pollfd> fds;
+
+    while (running_)
+    {
+        int64_t wait = flush(detail::proxy_now_ns());
+        if (wait < 0 || wait > detail::proxy_poll_ns)
+            wait = detail::proxy_poll_ns;
+
+        timespec timeout;
+        timeout.tv_sec  = wait / 1000000000;
+        timeout.tv_nsec = wait % 1000000000;
+
+        // The listener first, then the upstream sockets
+        fds.clear();
+        pollfd pfd;
+        pfd.fd = listener_;
+        pfd.events = POLLIN;
+        fds.push_back(pfd);
+        for (std::map<int, sockaddr_in>::const_iterator iter =
+                 clients_->clients.begin();
+             iter != clients_->clients.end();
+             ++iter)
+        {
+            pfd.fd = iter->first;
+            fds.push_back(pfd);
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i) fds[i].revents = 0;
+        if (::ppoll(fds.data(), fds.size(), &timeout, nullptr) <= 0) continue;
+
+        int64_t now = detail::proxy_now_ns();
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i].revents & POLLIN) receive(fds[i].fd, now);
+        }
+    }
+}
+
+
+void ImpairmentProxy::receive(int sock, int64_t now_ns)
+{
+    char buf[detail::proxy_max_datagram];
+
+    for (int n = 0; n < detail::proxy_receive_batch; ++n)
+    {
+        sockaddr_in from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t size = ::recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT,
+                                  (sockaddr*) &from, &fromlen);
+        if (size < 0) return;
+
+        if (sock == listener_)
+        {
+            int upstream = clients_->get(from);
+            if (upstream >= 0)
+                schedule(FORWARD, upstream, nullptr, buf, size, now_ns);
+        }
+        else
+        {
+            schedule(REVERSE, listener_, &clients_->clients[sock], buf, size,
+                     now_ns);
+        }
+    }
+}
+
+
+void ImpairmentProxy::schedule(Direction direction, int sock,
+                               const void* addr, const char* data,
+                               size_t size, int64_t now_ns)
+{
+    int64_t delays[2];
+    int copies = 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Link& link = *links_[direction];
+        const Impairment& i = link.impairment;
+        ++link.counters.received;
+
+        if (link.lose())
+        {
+            ++link.counters.lost;
+            return;
+        }
+
+        int64_t wait = link.shape(size, now_ns);
+        if (wait < 0)
+        {
+            ++link.counters.queue_dropped;
+            return;
+        }
+
+        if (link.chance(i.duplicate))
+        {
+            ++link.counters.duplicated;
+            copies = 2;
+        }
+
+        for (int c = 0; c < copies; ++c)
+        {
+            double delay = i.delay_ms;
+            if (i.jitter_ms > 0.)
+                delay += (2. * link.uniform() - 1.) * i.jitter_ms;
+            if (link.chance(i.reorder))
+            {
+                ++link.counters.reordered;
+                delay += i.reorder_ms;
+            }
+            delays[c] = wait + int64_t(std::max(0., delay) * 1e6);
+        }
+    }
+
+    for (int c = 0; c < copies; ++c)
+    {
+        detail::ProxyPacket* packet = new detail::ProxyPacket();
+        packet->due_ns = now_ns + delays[c];
+        packet->seq    = queue_->seq++;
+        packet->sock   = sock;
+        packet->data.assign(data, size);
+        if (addr != nullptr)
+            memcpy(&packet->to, addr, sizeof(packet->to));
+        else
+            packet->to.sin_family = AF_UNSPEC;
+        queue_->packets.push(packet);
+    }
+}
+
+
+int64_t ImpairmentProxy::flush(int64_t now_ns)
+{
+    std::vector<detail::ProxyPacket*> due;
+    while (!queue_->packets.empty() && queue_->packets.top()->due_ns <= now_ns)
+    {
+        due.push_back(queue_->packets.top());
+        queue_->packets.pop();
+    }
+
+    uint64_t sent[2] = { 0, 0 }, bytes[2] = { 0, 0 }, errors[2] = { 0, 0 };
+    for (size_t i = 0; i < due.size(); ++i)
+    {
+        detail::ProxyPacket* p = due[i];
+
+        // Upstream sockets are connected to the target
+        int d = (p->to.sin_family == AF_UNSPEC)? FORWARD : REVERSE;
+        ssize_t res = (d == FORWARD)?
+            ::send(p->sock, p->data.data(), p->data.size(), MSG_DONTWAIT) :
+            ::sendto(p->sock, p->data.data(), p->data.size(), MSG_DONTWAIT,
+                     (const sockaddr*) &p->to, sizeof(p->to));
+
+        if (res < 0) ++errors[d];
+        else
+        {
+            ++sent[d];
+            bytes[d] += res;
+        }
+        delete p;
+    }
+
+    if (!due.empty())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int d = 0; d < 2; ++d)
+        {
+            links_[d]->counters.sent        += sent[d];
+            links_[d]->counters.sent_bytes  += bytes[d];
+            links_[d]->counters.send_errors += errors[d];
+        }
+    }
+
+    if (queue_->packets.empty()) return -1;
+    return queue_->packets.top()->due_ns - now_ns;
+}
+
+} // namespace pyudt4
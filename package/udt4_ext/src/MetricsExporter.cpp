@@ -0,0 +1,564 @@
+#include "MetricsExporter.hh"
+
+#include <udt/udt.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <arpa/inet.h>  // inet_pton, inet_ntop
+#include <poll.h>       // poll
+#include <sys/socket.h>
+#include <unistd.h>     // close
+
+#include "Epoll.hh"
+#include "Socket.hh"
+#include "SocketOptions.hh"
+#include "Counters.hh"
+#include "Stats.hh"
+#include "UDPSocket.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * How often the server thread checks whether it should stop, in milliseconds.
+ */
+static const int exporter_poll_ms = 200;
+
+/**
+ * Largest HTTP request accepted, in bytes.
+ */
+static const size_t exporter_max_request = 4096;
+
+/**
+ * How per-socket values are combined into per-peer values.
+ */
+enum Aggregate { SUM, MAX };
+
+/**
+ * TRACEINFO metric exported per socket and per peer.
+ */
+struct TraceMetric
+{
+    const char* name;
+    const char* type;
+    const char* help;
+    Aggregate   aggregate;
+    double    (*value)(const UDT::TRACEINFO&);
+};
+
+static const TraceMetric trace_metrics[] = {
+    { "sent_packets", "counter", "Packets sent, including retransmissions",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktSentTotal); } },
+    { "received_packets", "counter", "Packets received",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktRecvTotal); } },
+    { "send_loss_packets", "counter", "Packets reported lost by the receiver",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktSndLossTotal); } },
+    { "receive_loss_packets", "counter", "Packets detected lost",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktRcvLossTotal); } },
+    { "retransmitted_packets", "counter", "Packets retransmitted",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktRetransTotal); } },
+    { "send_rate_mbps", "gauge",
+      "Sending rate since the previous scrape, in Mb/s",
+      SUM, [](const UDT::TRACEINFO& p) { return p.mbpsSendRate; } },
+    { "receive_rate_mbps", "gauge",
+      "Receiving rate since the previous scrape, in Mb/s",
+      SUM, [](const UDT::TRACEINFO& p) { return p.mbpsRecvRate; } },
+    { "bandwidth_mbps", "gauge", "Estimated link bandwidth, in Mb/s",
+      MAX, [](const UDT::TRACEINFO& p) { return p.mbpsBandwidth; } },
+    { "rtt_seconds", "gauge", "Round-trip time (worst socket for a peer)",
+      MAX, [](const UDT::TRACEINFO& p) { return p.msRTT / 1e3; } },
+    { "flow_window_packets", "gauge", "Flow window size",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktFlowWindow); } },
+    { "congestion_window_packets", "gauge", "Congestion window size",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktCongestionWindow); } },
+    { "flight_size_packets", "gauge", "Packets in flight",
+      SUM, [](const UDT::TRACEINFO& p) { return double(p.pktFlightSize); } },
+};
+
+static const size_t trace_metric_count =
+    sizeof(trace_metrics) / sizeof(trace_metrics[0]);
+
+/**
+ * Snapshot of a connected socket.
+ */
+struct SocketSample
+{
+    UDTSOCKET      descriptor;
+    std::string    peer_ip;
+    uint16_t       peer_port;
+    int            mss;
+    UDT::TRACEINFO info;
+};
+
+/**
+ * Per-peer aggregate.
+ */
+struct PeerSample
+{
+    int    sockets;
+    double values[trace_metric_count];
+};
+
+static
+void write_family(std::ostringstream& ss, const std::string& name,
+                  const char* type, const char* help)
+{
+    ss << "# TYPE " << name << ' ' << type << '\n'
+       << "# HELP " << name << ' ' << help << '\n';
+}
+
+static
+const char* sample_suffix(const char* type)
+{
+    return (std::string(type) == "counter")? "_total" : "";
+}
+
+static
+void write_histogram(std::ostringstream& ss, const std::string& name,
+                     const char* site, const Histogram& h)
+{
+    // Export the buckets below powers of two only, from 1 us to 16 s,
+    // labelled with their real upper bound (2^e - 1 ns)
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (int e = 10; e <= 34; ++e)
+    {
+        size_t end = Histogram::bucket(uint64_t(1) << e);
+        for (; bucket < end; ++bucket) cumulative += h.counts[bucket];
+
+        ss << name << "_bucket{call=\"" << site << "\",le=\""
+           << double(Histogram::upper_bound(end - 1)) * 1e-9 << "\"} "
+           << cumulative << '\n';
+    }
+    ss << name << "_bucket{call=\"" << site << "\",le=\"+Inf\"} "
+       << h.total << '\n'
+       << name << "_count{call=\"" << site << "\"} " << h.total << '\n'
+       << name << "_sum{call=\"" << site << "\"} " << h.sum * 1e-9 << '\n';
+}
+
+static
+bool send_all(int sock, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t res = ::send(sock, data.data() + sent, data.size() - sent,
+                             MSG_NOSIGNAL);
+        if (res <= 0) return false;
+        sent += res;
+    }
+    return true;
+}
+
+} // namespace detail
+
+
+MetricsExporter::MetricsExporter(std::string ip, uint16_t port)
+: listener_(-1),
+  port_(0),
+  running_(false)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+    {
+        translateError("Wrong arguments: MetricsExporter: invalid address "
+                       + ip);
+    }
+
+    listener_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener_ < 0)
+    {
+        translateSystemError("Could not create metrics socket");
+        return;
+    }
+
+    int one = 1;
+    ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (::bind(listener_, (sockaddr*) &addr, sizeof(addr)) != 0
+     || ::listen(listener_, 16) != 0)
+    {
+        int err = errno;
+        ::close(listener_);
+        errno = err;
+        translateSystemError("Could not listen on " + ip);
+        return;
+    }
+
+    port_ = udp::get_port(listener_);
+
+    PYUDT_LOG_TRACE("Metrics exporter listening on " << ip << ":" << port_);
+}
+
+
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+
+    if (listener_ >= 0) ::close(listener_);
+}
+
+
+void MetricsExporter::start()
+{
+    if (running_.exchange(true)) return;
+
+    thread_ = std::thread(&MetricsExporter::run, this);
+}
+
+
+void MetricsExporter::stop()
+{
+    if (!running_.exchange(false)) return;
+
+    Py_BEGIN_ALLOW_THREADS;
+    thread_.join();
+    Py_END_ALLOW_THREADS;
+}
+
+
+bool MetricsExporter::isRunning() const
+{
+    return running_;
+}
+
+
+void MetricsExporter::add(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(
+        py_socket, "MetricsExporter::add((Socket)s)");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sockets_.insert(socket->getDescriptor());
+}
+
+
+void MetricsExporter::add_epoll(const Epoll& epoll)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const std::map<UDTSOCKET, Socket*>& sockets = epoll.getSockets();
+    for (std::map<UDTSOCKET, Socket*>::const_iterator iter = sockets.begin();
+         iter != sockets.end();
+         ++iter)
+    {
+        sockets_.insert(iter->first);
+    }
+}
+
+
+void MetricsExporter::remove(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(
+        py_socket, "MetricsExporter::remove((Socket)s)");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sockets_.erase(socket->getDescriptor());
+}
+
+
+uint16_t MetricsExporter::getPort() const
+{
+    return port_;
+}
+
+
+std::string MetricsExporter::render()
+{
+    std::string res;
+
+    Py_BEGIN_ALLOW_THREADS;
+    res = scrape();
+    Py_END_ALLOW_THREADS;
+
+    return res;
+}
+
+
+void MetricsExporter::run()
+{
+    pollfd pfd;
+    pfd.fd = listener_;
+    pfd.events = POLLIN;
+
+    while (running_)
+    {
+        pfd.revents = 0;
+        if (::poll(&pfd, 1, detail::exporter_poll_ms) <= 0) continue;
+
+        int client = ::accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+
+        serve(client);
+        ::close(client);
+    }
+}
+
+
+void MetricsExporter::serve(int client)
+{
+    // A stalled scraper must not stall the exporter for long
+    timeval timeout = { 1, 0 };
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos
+        && request.size() < detail::exporter_max_request)
+    {
+        ssize_t res = ::recv(client, buf, sizeof(buf), 0);
+        if (res <= 0) break;
+        request.append(buf, res);
+    }
+
+    std::string line = request.substr(0, request.find("\r\n"));
+    std::string status, type, body;
+
+    if (line.compare(0, 13, "GET /metrics ") == 0
+     || line.compare(0, 6, "GET / ") == 0)
+    {
+        status = "200 OK";
+        type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        body = scrape();
+    }
+    else
+    {
+        status = "404 Not Found";
+        type = "text/plain; charset=utf-8";
+        body = "Not found\n";
+    }
+
+    std::ostringstream ss;
+    ss << "HTTP/1.0 " << status << "\r\n"
+       << "Content-Type: " << type << "\r\n"
+       << "Content-Length: " << body.size() << "\r\n"
+       << "Connection: close\r\n\r\n"
+       << body;
+
+    detail::send_all(client, ss.str());
+}
+
+
+std::string MetricsExporter::scrape()
+{
+    std::vector<UDTSOCKET> descriptors;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        descriptors.assign(sockets_.begin(), sockets_.end());
+    }
+
+    std::vector<detail::SocketSample> samples;
+    std::vector<UDTSOCKET> dead;
+
+    for (size_t i = 0; i < descriptors.size(); ++i)
+    {
+        UDTSOCKET u = descriptors[i];
+        UDTSTATUS status = UDT::getsockstate(u);
+
+        if (status == BROKEN || status == CLOSED || status == NONEXIST)
+        {
+            dead.push_back(u);
+            continue;
+        }
+
+        detail::SocketSample sample;
+        sockaddr_in addr;
+        int addrlen = sizeof(addr);
+        char ip[INET_ADDRSTRLEN] = { '\0' };
+
+        if (status != CONNECTED
+         || UDT::ERROR == UDT::perfmon(u, &sample.info, false)
+         || UDT::ERROR == options::get<UDT_MSS>(u, sample.mss)
+         || UDT::ERROR == UDT::getpeername(u, (sockaddr*) &addr, &addrlen))
+        {
+            UDT::getlasterror().clear();
+            continue;
+        }
+
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        sample.descriptor = u;
+        sample.peer_ip    = ip;
+        sample.peer_port  = ntohs(addr.sin_port);
+        samples.push_back(sample);
+    }
+
+    // UDT's rates are averages since the last perfmon(clear=true), i.e.
+    // since the connection here: rate the packets since the previous scrape,
+    // counted as full payloads like UDT does
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < dead.size(); ++i) sockets_.erase(dead[i]);
+
+        std::map<UDTSOCKET, Counts> current;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            UDT::TRACEINFO& info = samples[i].info;
+            Counts now = { info.msTimeStamp, info.pktSentTotal,
+                           info.pktRecvTotal };
+
+            Counts before = Counts();
+            std::map<UDTSOCKET, Counts>::const_iterator prev =
+                previous_.find(samples[i].descriptor);
+            if (prev != previous_.end()) before = prev->second;
+
+            double ms = double(now.ms_timestamp - before.ms_timestamp);
+            double bits = (samples[i].mss - 28 - 16) * 8.;
+            info.mbpsSendRate = (ms > 0.)?
+                (now.pkt_sent - before.pkt_sent) * bits / (ms * 1e3) : 0.;
+            info.mbpsRecvRate = (ms > 0.)?
+                (now.pkt_recv - before.pkt_recv) * bits / (ms * 1e3) : 0.;
+
+            current[samples[i].descriptor] = (ms > 0.)? now : before;
+        }
+        previous_.swap(current);
+    }
+
+    // Per-peer aggregates
+    std::map<std::string, detail::PeerSample> peers;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        std::map<std::string, detail::PeerSample>::iterator peer =
+            peers.find(samples[i].peer_ip);
+        if (peer == peers.end())
+        {
+            detail::PeerSample p = detail::PeerSample();
+            peer = peers.insert(std::make_pair(samples[i].peer_ip, p)).first;
+        }
+
+        ++peer->second.sockets;
+        for (size_t m = 0; m < detail::trace_metric_count; ++m)
+        {
+            double v = detail::trace_metrics[m].value(samples[i].info);
+            double& agg = peer->second.values[m];
+            agg = (detail::trace_metrics[m].aggregate == detail::SUM)?
+                  agg + v : std::max(agg, v);
+        }
+    }
+
+    std::ostringstream ss;
+    ss.precision(10);
+
+    for (size_t m = 0; m < detail::trace_metric_count; ++m)
+    {
+        const detail::TraceMetric& metric = detail::trace_metrics[m];
+        const char* suffix = detail::sample_suffix(metric.type);
+
+        std::string name = std::string("pyudt_socket_") + metric.name;
+        detail::write_family(ss, name, metric.type, metric.help);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            ss << name << suffix
+               << "{socket=\"" << samples[i].descriptor
+               << "\",peer=\"" << samples[i].peer_ip << ':'
+               << samples[i].peer_port << "\"} "
+               << metric.value(samples[i].info) << '\n';
+        }
+
+        name = std::string("pyudt_peer_") + metric.name;
+        detail::write_family(ss, name, metric.type, metric.help);
+        for (std::map<std::string, detail::PeerSample>::const_iterator peer =
+                 peers.begin();
+             peer != peers.end();
+             ++peer)
+        {
+            ss << name << suffix << "{peer=\"" << peer->first << "\"} "
+               << peer->second.values[m] << '\n';
+        }
+    }
+
+    detail::write_family(ss, "pyudt_peer_sockets", "gauge",
+                         "Connected sockets exported per peer");
+    for (std::map<std::string, detail::PeerSample>::const_iterator peer =
+             peers.begin();
+         peer != peers.end();
+         ++peer)
+    {
+        ss << "pyudt_peer_sockets{peer=\"" << peer->first << "\"} "
+           << peer->second.sockets << '\n';
+    }
+
+    // Binding overhead of the hot entry points
+    std::unique_ptr<stats::Snapshot> calls(new stats::Snapshot());
+    stats::snapshot(*calls);
+
+    detail::write_family(ss, "pyudt_calls", "counter",
+                         "Calls into UDT through the binding");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        ss << "pyudt_calls_total{call=\"" << stats::site_names[i] << "\"} "
+           << calls->sites[i].calls << '\n';
+    }
+
+    detail::write_family(ss, "pyudt_call_errors", "counter",
+                         "Calls into UDT that failed");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        ss << "pyudt_call_errors_total{call=\"" << stats::site_names[i] << "\"} "
+           << calls->sites[i].errors << '\n';
+    }
+
+    detail::write_family(ss, "pyudt_call_bytes", "counter",
+                         "Bytes transferred by the calls into UDT");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        ss << "pyudt_call_bytes_total{call=\"" << stats::site_names[i] << "\"} "
+           << calls->sites[i].bytes << '\n';
+    }
+
+    detail::write_family(ss, "pyudt_call_inside_seconds", "histogram",
+                         "Time spent inside UDT, with the GIL released");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        detail::write_histogram(ss, "pyudt_call_inside_seconds",
+                                stats::site_names[i], calls->sites[i].inside_ns);
+    }
+
+    detail::write_family(ss, "pyudt_call_outside_seconds", "histogram",
+                         "Time spent in the binding around the UDT call");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        detail::write_histogram(ss, "pyudt_call_outside_seconds",
+                                stats::site_names[i], calls->sites[i].outside_ns);
+    }
+
+    detail::write_family(ss, "pyudt_call_gil_wait_seconds", "histogram",
+                         "Time waited to reacquire the GIL after UDT returned");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        detail::write_histogram(ss, "pyudt_call_gil_wait_seconds",
+                                stats::site_names[i], calls->sites[i].gil_ns);
+    }
+
+    detail::write_family(ss, "pyudt_call_gil_slow", "counter",
+                         "GIL reacquisitions slower than the threshold");
+    for (int i = 0; i < stats::site_count; ++i)
+    {
+        ss << "pyudt_call_gil_slow_total{call=\"" << stats::site_names[i] << "\"} "
+           << calls->sites[i].gil_slow << '\n';
+    }
+
+    // Binding counters
+    for (int c = 0; c < counters::count; ++c)
+    {
+        std::string name = std::string("pyudt_") + counters::info[c].name;
+        detail::write_family(ss, name, "counter", counters::info[c].help);
+        ss << name << "_total " << counters::get(counters::Id(c)) << '\n';
+    }
+
+    ss << "# EOF\n";
+    return ss.str();
+}
+
+} // namespace pyudt4
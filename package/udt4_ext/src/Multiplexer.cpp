@@ -0,0 +1,192 @@
+#include "Multiplexer.hh"
+
+#include <udt/udt.h>
+#include <sys/socket.h>
+
+#include "UDPSocket.hh"
+#include "SocketOptions.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+Multiplexer::Multiplexer()
+: udp_socket_(-1),
+  port_(0),
+  udp_sndbuf_(DEFAULT_UDP_BUFFER),
+  udp_rcvbuf_(DEFAULT_UDP_BUFFER),
+  anchor_(UDT::INVALID_SOCK),
+  sockets_created_(0),
+  bind_errors_(0)
+{
+    open(nullptr, 0);
+}
+
+
+Multiplexer::Multiplexer(const char* ip, uint16_t port,
+                         int udp_sndbuf, int udp_rcvbuf)
+: udp_socket_(-1),
+  port_(0),
+  udp_sndbuf_(udp_sndbuf),
+  udp_rcvbuf_(udp_rcvbuf),
+  anchor_(UDT::INVALID_SOCK),
+  sockets_created_(0),
+  bind_errors_(0)
+{
+    open(ip, port);
+}
+
+
+Multiplexer::~Multiplexer()
+{
+    close();
+
+    PYUDT_LOG_TRACE("Destroyed multiplexer on UDP socket " << udp_socket_);
+}
+
+
+void Multiplexer::open(const char* ip, uint16_t port)
+{
+    udp_socket_ = udp::open(ip, port, udp_sndbuf_, udp_rcvbuf_);
+    port_ = udp::get_port(udp_socket_);
+
+    // From now on, UDT owns the UDP socket
+    anchor_ = bind_udt_socket();
+
+    PYUDT_LOG_TRACE("Created multiplexer on UDP socket " << udp_socket_
+                    << " (port " << port_ << ")");
+}
+
+
+void Multiplexer::close()
+{
+    if (anchor_ == UDT::INVALID_SOCK) return;
+
+    // Releasing the anchor lets UDT close the UDP socket once every other
+    // socket of this multiplexer is closed
+    UDT::close(anchor_);
+    anchor_ = UDT::INVALID_SOCK;
+
+    PYUDT_LOG_TRACE("Released multiplexer on UDP socket " << udp_socket_);
+}
+
+
+UDTSOCKET Multiplexer::bind_udt_socket() throw()
+{
+    UDTSOCKET descriptor = UDT::socket(AF_INET, SOCK_STREAM, 0);
+    if (descriptor == UDT::INVALID_SOCK)
+    {
+        translateUDTError();
+        return UDT::INVALID_SOCK;
+    }
+
+    // UDT applies the socket's UDP buffer sizes to the shared UDP socket,
+    // which would otherwise shrink the kernel buffers back to UDT's defaults
+    if (UDT::ERROR == options::set<UDP_SNDBUF>(descriptor, udp_sndbuf_)
+     || UDT::ERROR == options::set<UDP_RCVBUF>(descriptor, udp_rcvbuf_)
+     || UDT::ERROR == UDT::bind2(descriptor, udp_socket_))
+    {
+        ++bind_errors_;
+        UDT::close(descriptor);
+        translateUDTError();
+        return UDT::INVALID_SOCK;
+    }
+
+    return descriptor;
+}
+
+
+Socket_ptr Multiplexer::socket() throw()
+{
+    if (anchor_ == UDT::INVALID_SOCK)
+    {
+        translateError("Multiplexer::socket called on a closed multiplexer");
+    }
+
+    UDTSOCKET descriptor = bind_udt_socket();
+
+    prune();
+    descriptors_.push_back(descriptor);
+    ++sockets_created_;
+
+    PYUDT_LOG_TRACE("Bound UDT socket " << descriptor
+                    << " to multiplexer on port " << port_);
+
+    return make_shared<Socket>(descriptor, true);
+}
+
+
+const SYSSOCKET& Multiplexer::getUDPSocket() const
+{
+    return udp_socket_;
+}
+
+
+const uint16_t& Multiplexer::getPort() const
+{
+    return port_;
+}
+
+
+void Multiplexer::prune()
+{
+    std::vector<UDTSOCKET>::iterator iter = descriptors_.begin();
+    while (iter != descriptors_.end())
+    {
+        UDTSTATUS status = UDT::getsockstate(*iter);
+        if (  status == BROKEN
+           || status == CLOSED
+           || status == NONEXIST)
+        {
+            iter = descriptors_.erase(iter);
+        }
+        else ++iter;
+    }
+}
+
+
+py::dict Multiplexer::stats()
+{
+    prune();
+
+    int64_t pkt_sent = 0, pkt_recv = 0;
+    int64_t snd_loss = 0, rcv_loss = 0, retrans = 0;
+
+    // socket() and prune() may change descriptors_ once the GIL is released
+    const std::vector<UDTSOCKET> descriptors(descriptors_);
+
+    Py_BEGIN_ALLOW_THREADS;
+    UDT::TRACEINFO perf;
+    for (std::vector<UDTSOCKET>::const_iterator iter = descriptors.begin();
+         iter != descriptors.end();
+         ++iter)
+    {
+        if (UDT::ERROR == UDT::perfmon(*iter, &perf, false)) continue;
+
+        pkt_sent += perf.pktSentTotal;
+        pkt_recv += perf.pktRecvTotal;
+        snd_loss += perf.pktSndLossTotal;
+        rcv_loss += perf.pktRcvLossTotal;
+        retrans  += perf.pktRetransTotal;
+    }
+    UDT::getlasterror().clear();
+    Py_END_ALLOW_THREADS;
+
+    py::dict res;
+    res["port"]               = port_;
+    res["sockets_created"]    = sockets_created_;
+    res["sockets_active"]     = descriptors.size();
+    res["bind_errors"]        = bind_errors_;
+    res["udp_sndbuf"]         = udp::get_kernel_buffer(udp_socket_, SO_SNDBUF);
+    res["udp_rcvbuf"]         = udp::get_kernel_buffer(udp_socket_, SO_RCVBUF);
+    res["pkt_sent_total"]     = pkt_sent;
+    res["pkt_recv_total"]     = pkt_recv;
+    res["pkt_snd_loss_total"] = snd_loss;
+    res["pkt_rcv_loss_total"] = rcv_loss;
+    res["pkt_retrans_total"]  = retrans;
+    return res;
+}
+
+} // namespace pyudt4
@@ -0,0 +1,163 @@
+#include "Perfmon.hh"
+
+#include <udt/udt.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace perfmon {
+
+BufferView::BufferView(py::object py_buffer, size_t min_len, const char* what)
+{
+    if (PyObject_GetBuffer(py_buffer.ptr(), &view_,
+                           PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) != 0)
+    {
+        PyErr_Clear();
+        translateError(std::string("Wrong arguments: ") + what
+                       + ": a writable contiguous buffer is required");
+    }
+
+    if ((size_t) view_.len < min_len)
+    {
+        PyBuffer_Release(&view_);
+        translateError(std::string("Buffer too small in ") + what);
+    }
+}
+
+
+BufferView::~BufferView()
+{
+    PyBuffer_Release(&view_);
+}
+
+
+char* BufferView::data() const
+{
+    return static_cast<char*>(view_.buf);
+}
+
+
+size_t BufferView::size() const
+{
+    return view_.len;
+}
+
+
+#define PYUDT_FIELD_ENTRY(type, name) \
+    { #name, format<type>(), offsetof(UDT::TRACEINFO, name) },
+
+const Field fields[] = { PYUDT_TRACEINFO_FIELDS(PYUDT_FIELD_ENTRY) };
+
+#undef PYUDT_FIELD_ENTRY
+
+const size_t field_count = sizeof(fields) / sizeof(fields[0]);
+
+
+namespace detail {
+
+static
+py::dict layout(size_t base, size_t itemsize,
+                py::list names, py::list formats, py::list offsets)
+{
+    for (size_t i = 0; i < field_count; ++i)
+    {
+        names.append(fields[i].name);
+        formats.append(fields[i].format);
+        offsets.append(base + fields[i].offset);
+    }
+
+    py::dict res;
+    res["names"]    = names;
+    res["formats"]  = formats;
+    res["offsets"]  = offsets;
+    res["itemsize"] = itemsize;
+    return res;
+}
+
+} // namespace detail
+
+
+py::dict layout()
+{
+    return detail::layout(0, sizeof(UDT::TRACEINFO),
+                          py::list(), py::list(), py::list());
+}
+
+
+py::dict record_layout()
+{
+    py::list names, formats, offsets;
+
+    names.append("descriptor");
+    formats.append(format<int>());
+    offsets.append(offsetof(Record, descriptor));
+
+    names.append("status");
+    formats.append(format<int>());
+    offsets.append(offsetof(Record, status));
+
+    return detail::layout(offsetof(Record, info), sizeof(Record),
+                          names, formats, offsets);
+}
+
+
+void sample(const UDTSOCKET* sockets, size_t count, char* out, bool clear)
+{
+    bool aligned = reinterpret_cast<uintptr_t>(out) % alignof(Record) == 0;
+    Record tmp;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Record* rec = aligned? reinterpret_cast<Record*>(out) + i : &tmp;
+
+        rec->descriptor = sockets[i];
+        rec->status = UDT::getsockstate(sockets[i]);
+        if (UDT::ERROR == UDT::perfmon(sockets[i], &rec->info, clear))
+        {
+            memset(&rec->info, 0, sizeof(rec->info));
+            UDT::getlasterror().clear();
+        }
+
+        if (!aligned) memcpy(out + i * sizeof(Record), &tmp, sizeof(tmp));
+    }
+}
+
+
+void into(UDTSOCKET u, py::object py_buffer, bool clear) throw()
+{
+    BufferView view(py_buffer, sizeof(UDT::TRACEINFO),
+                    "Socket::perfmon_into(buffer)");
+    int res;
+
+    Py_BEGIN_ALLOW_THREADS;
+    if (reinterpret_cast<uintptr_t>(view.data()) % alignof(UDT::TRACEINFO) == 0)
+    {
+        // UDT writes straight into the caller's buffer
+        res = UDT::perfmon(u, reinterpret_cast<UDT::TRACEINFO*>(view.data()),
+                           clear);
+    }
+    else
+    {
+        UDT::TRACEINFO perf;
+        res = UDT::perfmon(u, &perf, clear);
+        memcpy(view.data(), &perf, sizeof(perf));
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (res == UDT::ERROR)
+    {
+        translateUDTError();
+        return;
+    }
+}
+
+} // namespace perfmon
+
+} // namespace pyudt4
@@ -0,0 +1,94 @@
+#include "PeriodicTask.hh"
+
+#include <Python.h>
+#include <chrono>
+
+#include "Debug.hh"
+
+namespace pyudt4 {
+
+PeriodicTask::PeriodicTask(int interval_ms)
+: interval_ms_(interval_ms),
+  running_(false)
+{
+}
+
+
+PeriodicTask::~PeriodicTask()
+{
+}
+
+
+void PeriodicTask::start()
+{
+    std::unique_lock<std::mutex> lock(acquire());
+    if (running_) return;
+
+    running_ = true;
+    thread_ = std::thread(&PeriodicTask::run, this);
+
+    PYUDT_LOG_TRACE("Started periodic task (period: " << interval_ms_ << " ms)");
+}
+
+
+void PeriodicTask::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(acquire());
+        if (!running_) return;
+        running_ = false;
+    }
+    cond_.notify_all();
+
+    // tick() never takes the GIL, which the caller holds
+    Py_BEGIN_ALLOW_THREADS;
+    thread_.join();
+    Py_END_ALLOW_THREADS;
+
+    PYUDT_LOG_TRACE("Stopped periodic task");
+}
+
+
+bool PeriodicTask::isRunning()
+{
+    std::unique_lock<std::mutex> lock(acquire());
+    return running_;
+}
+
+
+std::unique_lock<std::mutex> PeriodicTask::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        // tick() never takes the GIL: wait for it without holding the GIL
+        Py_BEGIN_ALLOW_THREADS;
+        lock.lock();
+        Py_END_ALLOW_THREADS;
+    }
+    return lock;
+}
+
+
+void PeriodicTask::after_tick()
+{
+}
+
+
+void PeriodicTask::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+        if (!running_) break;
+
+        tick();
+
+        lock.unlock();
+        after_tick();
+        lock.lock();
+    }
+}
+
+} // namespace pyudt4
@@ -5,7 +5,22 @@
 
 #include "Memory.hh"
 #include "Epoll.hh"
+#include "Multiplexer.hh"
+#include "Rendezvous.hh"
+#include "UDPSocket.hh"
 #include "Socket.hh"
+#include "SocketOptions.hh"
+#include "Perfmon.hh"
+#include "Tuner.hh"
+#include "Shaper.hh"
+#include "Scheduler.hh"
+#include "Sampler.hh"
+#include "MetricsExporter.hh"
+#include "ImpairmentProxy.hh"
+#include "CongestionControl.hh"
+#include "Counters.hh"
+#include "Stats.hh"
+#include "Trace.hh"
 #include "Exception.hh"
 #include "Debug.hh"
 
@@ -98,6 +113,38 @@ static void udt_startup()
 }
 
 
+/**
+ * Create a UDP socket member of the SO_REUSEPORT group of a port, for a
+ * worker process to attach its listener with Socket.bind_to_udp.
+ */
+static SYSSOCKET reuseport_socket(const char* ip, uint16_t port,
+                                  int udp_sndbuf = Multiplexer::DEFAULT_UDP_BUFFER,
+                                  int udp_rcvbuf = Multiplexer::DEFAULT_UDP_BUFFER)
+{
+    return udp::open(ip, port, udp_sndbuf, udp_rcvbuf, true);
+}
+
+
+/**
+ * Time on the clock used by deadlines, in seconds.
+ */
+static double monotonic()
+{
+    return stats::now_ns() * 1e-9;
+}
+
+/**
+ * Return the binding counters as a dict.
+ */
+static py::dict binding_counters()
+{
+    py::dict res;
+    for (int c = 0; c < counters::count; ++c)
+        res[counters::info[c].name] = counters::get(counters::Id(c));
+    return res;
+}
+
+
 namespace detail {
 
 /**
@@ -184,6 +231,34 @@ struct container_to_python
 
 // Member function overloads
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(epoll_wait, Epoll::wait, 1, 5)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(epoll_perfmon_all, Epoll::perfmon_all, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_perfmon, Socket::perfmon, 0, 1)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_sendmsg, Socket::sendmsg, 1, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_try_recv_into,
+                                       Socket::try_recv_into, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_sendall, Socket::sendall, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_recv_into, Socket::recv_into, 1, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_perfmon_into,
+                                       Socket::perfmon_into, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(socket_set_congestion_control,
+                                       Socket::set_congestion_control, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(shaper_add_class, Shaper::add_class, 2, 5)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(scheduler_add_class,
+                                       Scheduler::add_class, 1, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(scheduler_add, Scheduler::add, 1, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(scheduler_flush, Scheduler::flush, 0, 1)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(proxy_configure,
+                                       ImpairmentProxy::configure, 1, 2)
+
+// Free function overloads
+BOOST_PYTHON_FUNCTION_OVERLOADS(reuseport_socket_overloads,
+                                reuseport_socket, 2, 4)
+BOOST_PYTHON_FUNCTION_OVERLOADS(set_gil_tracking_overloads,
+                                stats::set_gil_tracking, 1, 2)
+BOOST_PYTHON_FUNCTION_OVERLOADS(set_tracing_overloads,
+                                trace::set_tracing, 1, 2)
+BOOST_PYTHON_FUNCTION_OVERLOADS(rendezvous_many_overloads,
+                                rendezvous_many, 2, 4)
 
 BOOST_PYTHON_MODULE(udt4_ext)
 {
@@ -209,6 +284,7 @@ BOOST_PYTHON_MODULE(udt4_ext)
 
     class_<Socket, shared_ptr<Socket> >("Socket", init<>())
     .def(init<UDTSOCKET,bool>())
+    .def(init<int,int,int>(args("addr_family", "type", "protocol")))
     .def("descriptor", &Socket::setDescriptor)
     .def("descriptor", &Socket::getDescriptor, return_value_policy<copy_const_reference>())
     .def("addr_family", &Socket::setAddressFamily)
@@ -219,6 +295,24 @@ BOOST_PYTHON_MODULE(udt4_ext)
     .def("protocol", &Socket::getProtocol, return_value_policy<copy_const_reference>())
     .def("close_on_delete", &Socket::setCloseOnDelete)
     .def("close_on_delete", &Socket::getCloseOnDelete, return_value_policy<copy_const_reference>())
+    .def("rendezvous", &Socket::setRendezvous)
+    .def("rendezvous", &Socket::getRendezvous)
+    .def("setsockopt", &Socket::setsockopt)
+    .def("getsockopt", &Socket::getsockopt)
+    .def("apply_profile", &Socket::apply_profile)
+    .def("set_congestion_control", &Socket::set_congestion_control,
+         socket_set_congestion_control(args("name", "params")))
+    .def("congestion_control", &Socket::congestion_control)
+    .def("setblocking", &Socket::setblocking)
+    .def("settimeout", &Socket::settimeout)
+    .def("perfmon", &Socket::perfmon,
+         socket_perfmon(args("clear"),
+                        "Sample the socket's performance into a reusable "
+                        "snapshot.")[return_internal_reference<>()])
+    .def("perfmon_into", &Socket::perfmon_into,
+         socket_perfmon_into(args("buffer", "clear"),
+                             "Sample the socket's performance into a "
+                             "buffer."))
     .def("close", &Socket::close)
     .def("__str__", &Socket::str)
     .def("send", socket_send)
@@ -226,6 +320,30 @@ BOOST_PYTHON_MODULE(udt4_ext)
     .def("send", socket_send_str)
     .def("recv", socket_recv)
     .def("recv", socket_recv_obj)
+    .def("try_send", &Socket::try_send,
+         "Send without blocking. Return the number of bytes sent, or -1 if "
+         "the send buffer is full.")
+    .def("try_recv_into", &Socket::try_recv_into,
+         socket_try_recv_into(args("buffer", "nbytes"),
+                              "Receive without blocking. Return the number "
+                              "of bytes received, or -1 if no data is "
+                              "available."))
+    .def("sendall", &Socket::sendall,
+         socket_sendall(args("data", "deadline"),
+                        "Send the whole buffer, before the deadline "
+                        "(pyudt.monotonic() time) if any."))
+    .def("recv_into", &Socket::recv_into,
+         socket_recv_into(args("buffer", "nbytes", "deadline"),
+                          "Receive into a buffer, before the deadline "
+                          "(pyudt.monotonic() time) if any."))
+    .def("sendmsg", &Socket::sendmsg,
+         socket_sendmsg(args("data", "ttl_ms", "in_order"),
+                        "Send a message (SOCK_DGRAM sockets)."))
+    .def("recvmsg", &Socket::recvmsg)
+    .def("timestamping", &Socket::setTimestamping)
+    .def("timestamping", &Socket::getTimestamping)
+    .def("latency", &Socket::latency)
+    .def("reset_latency", &Socket::reset_latency)
     .def("bind", socket_bind)
     .def("bind", socket_bind_obj)
     .def("bind_to_udp", &Socket::bind_to_udp)
@@ -235,6 +353,18 @@ BOOST_PYTHON_MODULE(udt4_ext)
     .def("accept", &Socket::accept)
     ;
 
+    // PERFMON
+
+    class_<UDT::TRACEINFO>("TraceInfo", no_init)
+#define PYUDT_TRACEINFO_MEMBER(type, name) \
+    .def_readonly(#name, &UDT::TRACEINFO::name)
+    PYUDT_TRACEINFO_FIELDS(PYUDT_TRACEINFO_MEMBER)
+#undef PYUDT_TRACEINFO_MEMBER
+    ;
+
+    def("perfmon_layout", perfmon::layout);
+    def("perfmon_record_layout", perfmon::record_layout);
+
     // EPOLL
 
     // Member function pointer variables
@@ -257,12 +387,159 @@ BOOST_PYTHON_MODULE(udt4_ext)
          epoll_wait(args("ms_timeout", "do_uread", "do_uwrite",
                                        "do_sread", "do_swrite"),
                     "Wait for an epoll event. A timeout can be set."))
+    .def("perfmon_all", &Epoll::perfmon_all,
+         epoll_perfmon_all(args("out", "clear"),
+                           "Sample every socket of the epoll into an array."))
     .def("get_read_udt", &Epoll::get_read_udt)
     .def("get_write_udt", &Epoll::get_write_udt)
     .def("get_read_tcp", &Epoll::get_read_tcp)
     .def("get_write_tcp", &Epoll::get_write_tcp)
     ;
 
+    // MULTIPLEXER
+
+    class_<Multiplexer, boost::noncopyable>("Multiplexer", init<>())
+    .def(init<const char*, uint16_t, optional<int, int> >())
+    .def("socket", &Multiplexer::socket)
+    .def("udp_socket", &Multiplexer::getUDPSocket, return_value_policy<copy_const_reference>())
+    .def("port", &Multiplexer::getPort, return_value_policy<copy_const_reference>())
+    .def("stats", &Multiplexer::stats)
+    .def("close", &Multiplexer::close)
+    ;
+
+    // TUNER
+
+    class_<Tuner, boost::noncopyable>("Tuner",
+        init<optional<int, int, int64_t, double> >(
+            args("interval_ms", "max_buffer", "max_memory", "maxbw_headroom")))
+    .def("start", &Tuner::start)
+    .def("stop", &Tuner::stop)
+    .def("running", &Tuner::isRunning)
+    .def("add", &Tuner::add)
+    .def("add_epoll", &Tuner::add_epoll)
+    .def("remove", &Tuner::remove)
+    .def("prepare", &Tuner::prepare)
+    .def("stats", &Tuner::stats)
+    ;
+
+    // SHAPER
+
+    class_<Shaper, boost::noncopyable>("Shaper",
+        init<optional<int> >(args("interval_ms")))
+    .def("start", &Shaper::start)
+    .def("stop", &Shaper::stop)
+    .def("running", &Shaper::isRunning)
+    .def("add_class", &Shaper::add_class,
+         shaper_add_class(args("name", "rate_mbps", "ceil_mbps", "parent",
+                               "weight")))
+    .def("remove_class", &Shaper::remove_class)
+    .def("add", &Shaper::add)
+    .def("remove", &Shaper::remove)
+    .def("stats", &Shaper::stats)
+    ;
+
+    // SCHEDULER
+
+    class_<Scheduler, boost::noncopyable>("Scheduler",
+        init<optional<int, int, int64_t> >(
+            args("threads", "quantum", "max_queue")))
+    .def("start", &Scheduler::start)
+    .def("stop", &Scheduler::stop)
+    .def("running", &Scheduler::isRunning)
+    .def("add_class", &Scheduler::add_class,
+         scheduler_add_class(args("name", "weight", "priority")))
+    .def("add", &Scheduler::add,
+         scheduler_add(args("socket", "name", "weight")))
+    .def("remove", &Scheduler::remove)
+    .def("enqueue", &Scheduler::enqueue)
+    .def("flush", &Scheduler::flush, scheduler_flush(args("ms_timeout")))
+    .def("stats", &Scheduler::stats)
+    ;
+
+    // SAMPLER
+
+    class_<Sampler, boost::noncopyable>("Sampler",
+        init<std::string, optional<int, int> >(
+            args("path", "capacity", "period_ms")))
+    .def("start", &Sampler::start)
+    .def("stop", &Sampler::stop)
+    .def("running", &Sampler::isRunning)
+    .def("add", &Sampler::add)
+    .def("add_epoll", &Sampler::add_epoll)
+    .def("remove", &Sampler::remove)
+    .def("path", &Sampler::getPath, return_value_policy<copy_const_reference>())
+    .def("capacity", &Sampler::getCapacity)
+    .def("written", &Sampler::written)
+    ;
+
+    // METRICS
+
+    class_<MetricsExporter, boost::noncopyable>("MetricsExporter",
+        init<optional<std::string, uint16_t> >(args("ip", "port")))
+    .def("start", &MetricsExporter::start)
+    .def("stop", &MetricsExporter::stop)
+    .def("running", &MetricsExporter::isRunning)
+    .def("add", &MetricsExporter::add)
+    .def("add_epoll", &MetricsExporter::add_epoll)
+    .def("remove", &MetricsExporter::remove)
+    .def("port", &MetricsExporter::getPort)
+    .def("render", &MetricsExporter::render)
+    ;
+
+    // IMPAIRMENT PROXY
+
+    class_<ImpairmentProxy, boost::noncopyable>("ImpairmentProxy",
+        init<std::string, uint16_t, optional<std::string, uint16_t, uint64_t> >(
+            args("target_ip", "target_port", "ip", "port", "seed")))
+    .def("start", &ImpairmentProxy::start)
+    .def("stop", &ImpairmentProxy::stop)
+    .def("running", &ImpairmentProxy::isRunning)
+    .def("configure", &ImpairmentProxy::configure,
+         proxy_configure(args("params", "direction"),
+                         "Replace the impairments of \"forward\", "
+                         "\"reverse\" or \"both\" directions."))
+    .def("impairment", &ImpairmentProxy::impairment)
+    .def("stats", &ImpairmentProxy::stats)
+    .def("port", &ImpairmentProxy::getPort)
+    ;
+
+    def("counters", binding_counters);
+    def("monotonic", monotonic);
+
+    // STATS
+
+    def("stats", stats::to_python);
+    def("reset_stats", stats::reset);
+    def("set_gil_tracking", stats::set_gil_tracking,
+        set_gil_tracking_overloads(args("enabled", "threshold_us"),
+            "Measure how long threads wait to reacquire the GIL after UDT "
+            "returns, counting the waits over threshold_us as slow."));
+    def("gil_tracking", stats::gil_tracking);
+
+    // TRACE
+
+    def("set_tracing", trace::set_tracing,
+        set_tracing_overloads(args("enabled", "capacity"),
+            "Start a new binary event trace keeping the last capacity events "
+            "of every thread, or stop tracing."));
+    def("tracing", trace::enabled);
+    def("dump_trace", trace::dump,
+        "Write the traced events to a file, see pyudt.trace2json. Return the "
+        "number of events written.");
+    def("clear_trace", trace::clear);
+
+    // Constants
+    scope().attr("AF_INET")     = int(AF_INET);
+    scope().attr("AF_INET6")    = int(AF_INET6);
+    scope().attr("SOCK_STREAM") = int(SOCK_STREAM);
+    scope().attr("SOCK_DGRAM")  = int(SOCK_DGRAM);
+
+#ifdef PYUDT_HAVE_SDT
+    scope().attr("HAVE_PROBES") = true;
+#else
+    scope().attr("HAVE_PROBES") = false;
+#endif
+
     // Enums
     enum_<EPOLLOpt>("EPOLLOpt")
     .value("UDT_EPOLL_IN", UDT_EPOLL_IN)
@@ -271,9 +548,20 @@ BOOST_PYTHON_MODULE(udt4_ext)
     .export_values()
     ;
 
+    enum_<UDTOpt>("UDTOpt")
+#define PYUDT_OPTION_VALUE(opt, kind, ctype, min, max, ro) .value(#opt, opt)
+    PYUDT_SOCKET_OPTIONS(PYUDT_OPTION_VALUE)
+#undef PYUDT_OPTION_VALUE
+    .export_values()
+    ;
+
+    def("profiles", options::profiles);
+    def("congestion_controls", cc::algorithms);
+
     // EXCEPTION
 
     register_exception_translator<Exception>(translateException);
+    registerUDTExceptions();
 
     // LOGGER
 
@@ -282,10 +570,35 @@ BOOST_PYTHON_MODULE(udt4_ext)
     .staticmethod("init_logger")
     .def("load_logger_configuration", &Logger::load_logger_configuration)
     .staticmethod("load_logger_configuration")
+    .def("set_level", &Logger::set_level)
+    .staticmethod("set_level")
+    .def("level", &Logger::get_level)
+    .staticmethod("level")
+    .def("set_async", &Logger::set_async)
+    .staticmethod("set_async")
+    .def("is_async", &Logger::get_async)
+    .staticmethod("is_async")
+    .def("dropped", &Logger::dropped)
+    .staticmethod("dropped")
     ;
 
      // GENERAL FUNCTIONS
 
     def("startup", udt_startup);
     def("cleanup", udt_cleanup);
+
+    // UDP SOCKETS
+
+    def("reuseport_socket", reuseport_socket,
+        reuseport_socket_overloads(args("ip", "port", "udp_sndbuf",
+                                        "udp_rcvbuf")));
+    def("attach_reuseport_bpf", udp::attach_reuseport_bpf);
+
+    // RENDEZ-VOUS
+
+    def("rendezvous_many", rendezvous_many,
+        rendezvous_many_overloads(args("peers", "local_port", "callback",
+                                       "ms_timeout"),
+                                  "Set up rendez-vous connections to many "
+                                  "peers at once over one UDP port."));
 }
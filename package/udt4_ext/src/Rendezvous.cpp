@@ -0,0 +1,187 @@
+#include "Rendezvous.hh"
+
+#include <udt/udt.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <arpa/inet.h> // inet_pton
+
+#include "Multiplexer.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * Release a UDT epoll when leaving the scope, even on exceptions.
+ */
+struct EpollGuard
+{
+    explicit EpollGuard(int eid) : eid_(eid) {}
+    ~EpollGuard() { UDT::epoll_release(eid_); }
+
+    int eid_;
+};
+
+} // namespace detail
+
+
+py::list rendezvous_many(py::object py_peers, uint16_t local_port,
+                         py::object py_callback, int64_t ms_timeout) throw()
+{
+    std::vector<py::object> peers;
+    std::vector<sockaddr_in> addrs;
+
+    try
+    {
+        for (py::ssize_t i = 0; i < py::len(py_peers); ++i)
+        {
+            py::tuple addr_tuple = py::extract<py::tuple>(py_peers[i]);
+            const char* ip = py::extract<const char*>(addr_tuple[0]);
+            uint16_t port = py::extract<uint16_t>(addr_tuple[1]);
+
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            inet_pton(AF_INET, ip, &addr.sin_addr);
+
+            peers.push_back(addr_tuple);
+            addrs.push_back(addr);
+        }
+    }
+    catch (...)
+    {
+        translateError("Wrong arguments: rendezvous_many([(addr, port), ...], "
+                       "(int)local_port)");
+    }
+
+    py::list results;
+    if (peers.empty()) return results;
+
+    // All the connections share one UDP port
+    Multiplexer mux(nullptr, local_port);
+
+    int eid = UDT::epoll_create();
+    if (eid < 0)
+    {
+        translateUDTError();
+        return results;
+    }
+    detail::EpollGuard guard(eid);
+
+    // Start every handshake asynchronously
+    std::vector<Socket_ptr> sockets(peers.size());
+    std::map<UDTSOCKET, size_t> pending;
+    bool blocking_recv = false;
+    int events = UDT_EPOLL_OUT | UDT_EPOLL_ERR;
+
+    for (size_t i = 0; i < peers.size(); ++i)
+    {
+        sockets[i] = mux.socket();
+        sockets[i]->setRendezvous(true);
+
+        UDTSOCKET u = sockets[i]->getDescriptor();
+        if (UDT::ERROR == UDT::setsockopt(u, 0, UDT_RCVSYN,
+                                          &blocking_recv, sizeof(blocking_recv))
+         || UDT::ERROR == UDT::epoll_add_usock(eid, u, &events)
+         || UDT::ERROR == UDT::connect(u, (sockaddr*) &addrs[i],
+                                       sizeof(addrs[i])))
+        {
+            translateUDTError();
+            return results;
+        }
+
+        pending[u] = i;
+        results.append(py::object());
+    }
+
+    PYUDT_LOG_TRACE("Started " << peers.size()
+                    << " rendez-vous handshakes on port " << mux.getPort());
+
+    // Report the connections as UDT completes them
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(ms_timeout);
+    std::set<UDTSOCKET> ready;
+    blocking_recv = true;
+
+    while (!pending.empty())
+    {
+        int64_t wait_ms = -1;
+        if (ms_timeout >= 0)
+        {
+            wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>
+                      (deadline - std::chrono::steady_clock::now()).count();
+            if (wait_ms <= 0) break;
+        }
+
+        int res;
+        Py_BEGIN_ALLOW_THREADS;
+        res = UDT::epoll_wait(eid, nullptr, &ready, wait_ms);
+        Py_END_ALLOW_THREADS;
+
+        if (res == UDT::ERROR)
+        {
+            if (UDT::getlasterror().getErrorCode() != CUDTException::ETIMEOUT)
+            {
+                translateUDTError();
+                return results;
+            }
+            UDT::getlasterror().clear();
+            continue;
+        }
+
+        for (std::set<UDTSOCKET>::const_iterator iter = ready.begin();
+             iter != ready.end();
+             ++iter)
+        {
+            std::map<UDTSOCKET, size_t>::iterator p = pending.find(*iter);
+            if (p == pending.end()) continue;
+
+            size_t i = p->second;
+            pending.erase(p);
+            UDT::epoll_remove_usock(eid, *iter);
+
+            if (UDT::getsockstate(*iter) == CONNECTED
+             && UDT::ERROR != UDT::setsockopt(*iter, 0, UDT_RCVSYN,
+                                              &blocking_recv,
+                                              sizeof(blocking_recv)))
+            {
+                results[i] = py::object(sockets[i]);
+                PYUDT_LOG_TRACE("Rendez-vous socket " << *iter << " connected");
+            }
+            else
+            {
+                UDT::getlasterror().clear();
+                sockets[i].reset();
+                PYUDT_LOG_ERROR("Rendez-vous socket " << *iter
+                                << " failed to connect");
+            }
+
+            if (!py_callback.is_none())
+                py::call<void>(py_callback.ptr(), peers[i], results[i]);
+        }
+    }
+
+    // Whatever is still pending has timed out
+    for (std::map<UDTSOCKET, size_t>::const_iterator iter = pending.begin();
+         iter != pending.end();
+         ++iter)
+    {
+        size_t i = iter->second;
+        sockets[i].reset();
+
+        if (!py_callback.is_none())
+            py::call<void>(py_callback.ptr(), peers[i], results[i]);
+    }
+
+    return results;
+}
+
+} // namespace pyudt4
@@ -0,0 +1,259 @@
+#include "Sampler.hh"
+
+#include <udt/udt.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdio.h>    // rename
+#include <stdlib.h>   // mkstemp
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fchmod
+#include <unistd.h>   // ftruncate, close, unlink
+
+#include "Epoll.hh"
+#include "Socket.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "ring files require plain 64-bit sequence numbers");
+static_assert(offsetof(ring::RingHeader, write_index) == 32,
+              "unexpected ring header layout");
+static_assert(sizeof(ring::RingField) == 48,
+              "unexpected ring field layout");
+
+namespace detail {
+
+/**
+ * Alignment of the first slot of a ring file, in bytes.
+ */
+static const size_t ring_page = 4096;
+
+static
+void set_field(ring::RingField& field, const char* name, const char* format,
+               size_t offset)
+{
+    strncpy(field.name, name, sizeof(field.name) - 1);
+    strncpy(field.format, format, sizeof(field.format) - 1);
+    field.offset = (uint32_t) offset;
+}
+
+static
+int64_t now_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+        system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace detail
+
+
+Sampler::Sampler(std::string path, int capacity, int period_ms)
+: PeriodicTask(period_ms),
+  path_(path),
+  capacity_(capacity),
+  fd_(-1),
+  size_(0),
+  map_(nullptr),
+  header_(nullptr),
+  slots_(nullptr)
+{
+    if (capacity <= 0 || period_ms <= 0)
+    {
+        translateError("Sampler: capacity and period_ms must be positive");
+    }
+
+    // timestamp_us, descriptor, status and every TRACEINFO field
+    const size_t n_fields = 3 + perfmon::field_count;
+    size_t header_size = sizeof(ring::RingHeader)
+                       + n_fields * sizeof(ring::RingField);
+    header_size = (header_size + detail::ring_page - 1)
+                / detail::ring_page * detail::ring_page;
+
+    size_ = header_size + size_t(capacity) * sizeof(ring::RingSlot);
+
+    // Build the file aside: truncating a file mapped by a reader would
+    // fault its next access (SIGBUS)
+    std::string tmp_path = path + ".XXXXXX";
+    std::vector<char> tmp(tmp_path.begin(), tmp_path.end());
+    tmp.push_back('\0');
+
+    fd_ = ::mkstemp(&tmp[0]);
+    if (fd_ < 0)
+    {
+        translateSystemError("Could not create ring file " + path);
+        return;
+    }
+    tmp_path = &tmp[0];
+
+    if (::fchmod(fd_, 0644) != 0 || ::ftruncate(fd_, size_) != 0)
+    {
+        ::close(fd_);
+        ::unlink(tmp_path.c_str());
+        translateSystemError("Could not resize ring file " + path);
+        return;
+    }
+
+    void* map = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd_, 0);
+    if (map == MAP_FAILED)
+    {
+        ::close(fd_);
+        ::unlink(tmp_path.c_str());
+        translateSystemError("Could not map ring file " + path);
+        return;
+    }
+
+    map_    = static_cast<char*>(map);
+    header_ = reinterpret_cast<ring::RingHeader*>(map_);
+    slots_  = reinterpret_cast<ring::RingSlot*>(map_ + header_size);
+
+    ring::RingField* fields = reinterpret_cast<ring::RingField*>(
+        map_ + sizeof(ring::RingHeader));
+    const size_t info = offsetof(ring::RingSlot, record)
+                      + offsetof(perfmon::Record, info);
+
+    detail::set_field(fields[0], "timestamp_us", perfmon::format<int64_t>(),
+                      offsetof(ring::RingSlot, timestamp_us));
+    detail::set_field(fields[1], "descriptor", perfmon::format<int>(),
+                      offsetof(ring::RingSlot, record)
+                      + offsetof(perfmon::Record, descriptor));
+    detail::set_field(fields[2], "status", perfmon::format<int>(),
+                      offsetof(ring::RingSlot, record)
+                      + offsetof(perfmon::Record, status));
+    for (size_t i = 0; i < perfmon::field_count; ++i)
+    {
+        detail::set_field(fields[3 + i], perfmon::fields[i].name,
+                          perfmon::fields[i].format,
+                          info + perfmon::fields[i].offset);
+    }
+
+    header_->version     = ring::version;
+    header_->header_size = (uint32_t) header_size;
+    header_->slot_size   = (uint32_t) sizeof(ring::RingSlot);
+    header_->capacity    = (uint32_t) capacity;
+    header_->field_count = (uint32_t) n_fields;
+    header_->period_ms   = (uint32_t) period_ms;
+    header_->write_index.store(0, std::memory_order_relaxed);
+
+    // The magic is written last: readers ignore incomplete files
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header_->magic, ring::magic, sizeof(ring::magic));
+
+    if (::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        ::munmap(map_, size_);
+        ::close(fd_);
+        ::unlink(tmp_path.c_str());
+        translateSystemError("Could not rename ring file to " + path);
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Created ring file " << path << " (" << capacity
+                    << " records of " << sizeof(ring::RingSlot) << " bytes)");
+}
+
+
+Sampler::~Sampler()
+{
+    stop();
+
+    if (map_) ::munmap(map_, size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+
+void Sampler::add(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket, "Sampler::add((Socket)s)");
+
+    std::unique_lock<std::mutex> lock(acquire());
+    sockets_.insert(socket->getDescriptor());
+}
+
+
+void Sampler::add_epoll(const Epoll& epoll)
+{
+    std::unique_lock<std::mutex> lock(acquire());
+
+    const std::map<UDTSOCKET, Socket*>& sockets = epoll.getSockets();
+    for (std::map<UDTSOCKET, Socket*>::const_iterator iter = sockets.begin();
+         iter != sockets.end();
+         ++iter)
+    {
+        sockets_.insert(iter->first);
+    }
+}
+
+
+void Sampler::remove(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket, "Sampler::remove((Socket)s)");
+
+    std::unique_lock<std::mutex> lock(acquire());
+    sockets_.erase(socket->getDescriptor());
+}
+
+
+const std::string& Sampler::getPath() const
+{
+    return path_;
+}
+
+
+int Sampler::getCapacity() const
+{
+    return capacity_;
+}
+
+
+uint64_t Sampler::written() const
+{
+    return header_->write_index.load(std::memory_order_acquire);
+}
+
+
+void Sampler::append(int64_t timestamp_us, const perfmon::Record& record)
+{
+    uint64_t index = header_->write_index.load(std::memory_order_relaxed);
+    ring::RingSlot& slot = slots_[index % capacity_];
+
+    // Odd sequence: the slot is being written
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.timestamp_us = timestamp_us;
+    memcpy(&slot.record, &record, sizeof(record));
+
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+    header_->write_index.store(index + 1, std::memory_order_release);
+}
+
+
+void Sampler::tick()
+{
+    perfmon::Record record;
+    int64_t timestamp_us = detail::now_us();
+
+    std::set<UDTSOCKET>::iterator iter = sockets_.begin();
+    while (iter != sockets_.end())
+    {
+        perfmon::sample(&*iter, 1, reinterpret_cast<char*>(&record), false);
+        append(timestamp_us, record);
+
+        // The last state of a closed socket is recorded once, then dropped
+        if (record.status == BROKEN || record.status == CLOSED
+         || record.status == NONEXIST)
+            sockets_.erase(iter++);
+        else
+            ++iter;
+    }
+}
+
+} // namespace pyudt4
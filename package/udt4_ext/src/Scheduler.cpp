@@ -0,0 +1,738 @@
+#include "Scheduler.hh"
+
+#include <Python.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <sys/eventfd.h>
+#include <unistd.h>     // read, write, close
+
+#include "Socket.hh"
+#include "SocketOptions.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * How long a sender thread waits in the epoll before checking whether it
+ * should stop, in milliseconds.
+ */
+static const int scheduler_poll_ms = 100;
+
+/**
+ * Largest write handed to UDT at once, in bytes.
+ */
+static const size_t max_write = 1 << 20;
+
+/**
+ * Length of the throughput measurement windows.
+ */
+static const std::chrono::seconds rate_window(1);
+
+/**
+ * Move an element of a round to its end.
+ */
+template <class T>
+void rotate(std::deque<T>& round, const T& item)
+{
+    typename std::deque<T>::iterator iter =
+        std::find(round.begin(), round.end(), item);
+    if (iter == round.end()) return;
+
+    round.erase(iter);
+    round.push_back(item);
+}
+
+
+template <class T>
+void erase(std::deque<T>& round, const T& item)
+{
+    typename std::deque<T>::iterator iter =
+        std::find(round.begin(), round.end(), item);
+    if (iter != round.end()) round.erase(iter);
+}
+
+} // namespace detail
+
+
+/**
+ * Class of sockets, with its round of active sockets.
+ */
+struct Scheduler::Class
+{
+    std::string name;
+    double weight;
+    int priority;
+
+    double deficit;
+    std::deque<std::shared_ptr<Flow> > flows;
+
+    int     sockets;
+    int64_t queued_bytes;
+    int64_t queued_buffers;
+    int64_t sent_bytes;
+    int64_t sent_buffers;
+
+    /**
+     * Throughput over the last complete window, and current window.
+     */
+    double rate;
+    int64_t window_bytes;
+    std::chrono::steady_clock::time_point window_start;
+
+    Class(const std::string& n, double w, int p)
+    : name(n), weight(w), priority(p), deficit(0.), sockets(0),
+      queued_bytes(0), queued_buffers(0), sent_bytes(0), sent_buffers(0),
+      rate(0.), window_bytes(0),
+      window_start(std::chrono::steady_clock::now())
+    {
+    }
+};
+
+
+/**
+ * Queue of a socket.
+ */
+struct Scheduler::Flow
+{
+    UDTSOCKET socket;
+    Class*    cls;
+    double    weight;
+    bool      was_blocking;
+
+    std::deque<std::string> queue;
+    size_t  offset;     // bytes of the first buffer already sent
+    int64_t queued;     // bytes not sent yet
+    double  deficit;
+    int64_t sent_bytes;
+
+    bool writable;      // false while parked in the epoll
+    bool busy;          // a sender thread is writing to it
+    bool removed;
+    std::string error;
+};
+
+
+Scheduler::Scheduler(int threads, int quantum, int64_t max_queue)
+: quantum_(std::max(quantum, 1)),
+  max_queue_(max_queue),
+  thread_count_(std::max(threads, 1)),
+  running_(false),
+  eid_(-1),
+  wake_fd_(-1),
+  queued_bytes_(0),
+  blocked_(0),
+  polling_(false)
+{
+    eid_ = UDT::epoll_create();
+    if (eid_ < 0)
+    {
+        translateUDTError();
+        return;
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0 || UDT::ERROR == UDT::epoll_add_ssock(eid_, wake_fd_))
+    {
+        UDT::getlasterror().clear();
+        if (wake_fd_ >= 0) ::close(wake_fd_);
+        UDT::epoll_release(eid_);
+        translateError("Could not create the scheduler's wake-up event");
+    }
+
+    classes_["default"].reset(new Class("default", 1., 0));
+}
+
+
+Scheduler::~Scheduler()
+{
+    stop();
+
+    UDT::epoll_release(eid_);
+    ::close(wake_fd_);
+
+    // Restore the sending mode of the sockets still registered
+    for (std::map<UDTSOCKET, std::shared_ptr<Flow> >::iterator iter =
+             flows_.begin();
+         iter != flows_.end();
+         ++iter)
+    {
+        if (UDT::ERROR == options::set<UDT_SNDSYN>(iter->first,
+                                                   iter->second->was_blocking))
+            UDT::getlasterror().clear();
+    }
+}
+
+
+void Scheduler::start()
+{
+    if (running_.exchange(true)) return;
+
+    for (size_t i = 0; i < thread_count_; ++i)
+        threads_.push_back(std::thread(&Scheduler::run, this));
+
+    PYUDT_LOG_TRACE("Started scheduler (" << thread_count_ << " threads)");
+}
+
+
+void Scheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) return;
+    }
+    cond_.notify_all();
+    wake();
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (size_t i = 0; i < threads_.size(); ++i)
+        threads_[i].join();
+    Py_END_ALLOW_THREADS;
+    threads_.clear();
+
+    PYUDT_LOG_TRACE("Stopped scheduler");
+}
+
+
+bool Scheduler::isRunning() const
+{
+    return running_;
+}
+
+
+void Scheduler::add_class(std::string name, double weight, int priority) throw()
+{
+    if (name.empty() || weight <= 0.)
+    {
+        translateError("Wrong arguments: Scheduler::add_class("
+                       "(str)name, (float)weight > 0, "
+                       "(int)priority)");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (classes_.count(name))
+        translateError("Scheduler class already exists: " + name);
+
+    classes_[name].reset(new Class(name, weight, priority));
+}
+
+
+void Scheduler::add(py::object py_socket, std::string name, double weight) throw()
+{
+    Socket* socket = extractSocket(py_socket,
+        "Scheduler::add((Socket)s, (str)name, (float)weight)");
+    UDTSOCKET u = socket->getDescriptor();
+
+    if (weight <= 0.)
+        translateError("Wrong arguments: Scheduler::add: weight must be "
+                       "positive");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!classes_.count(name))
+            translateError("Unknown scheduler class: " + name);
+        if (flows_.count(u))
+            translateError("Socket already registered");
+    }
+
+    // Outside the lock: UDT waits for the calls in progress on the socket
+    bool blocking = socket->getSendBlocking();
+    socket->setSendBlocking(false);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<std::string, std::unique_ptr<Class> >::iterator cls =
+        classes_.find(name);
+    if (flows_.count(u))
+        translateError("Socket already registered");
+
+    std::shared_ptr<Flow> flow(new Flow());
+    flow->socket       = u;
+    flow->cls          = cls->second.get();
+    flow->weight       = weight;
+    flow->was_blocking = blocking;
+    flow->offset       = 0;
+    flow->queued       = 0;
+    flow->deficit      = 0.;
+    flow->sent_bytes   = 0;
+    flow->writable     = true;
+    flow->busy         = false;
+    flow->removed      = false;
+    flows_[u] = flow;
+
+    ++cls->second->sockets;
+}
+
+
+void Scheduler::remove(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket, "Scheduler::remove((Socket)s)");
+    UDTSOCKET u = socket->getDescriptor();
+
+    std::shared_ptr<Flow> flow;
+    std::string rest;
+
+    Py_BEGIN_ALLOW_THREADS;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        std::map<UDTSOCKET, std::shared_ptr<Flow> >::iterator iter =
+            flows_.find(u);
+        if (iter != flows_.end())
+        {
+            flow = iter->second;
+            flow->removed = true;
+            --flow->cls->sockets;
+            flows_.erase(iter);
+
+            // Wait for the sender thread writing to the socket, if any
+            idle_.wait(lock, [&flow] { return !flow->busy; });
+
+            if (!flow->queue.empty() && flow->offset > 0)
+                rest = flow->queue.front().substr(flow->offset);
+            drop(*flow);
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (!flow) return;
+
+    socket->setSendBlocking(flow->was_blocking);
+
+    // Complete the buffer cut by the removal
+    if (!rest.empty())
+    {
+        py::object py_rest(py::handle<>(
+            PyBytes_FromStringAndSize(rest.data(), rest.size())));
+        socket->sendall(py_rest);
+    }
+}
+
+
+int64_t Scheduler::enqueue(py::object py_socket, py::object py_data) throw()
+{
+    Socket* socket = extractSocket(py_socket,
+        "Scheduler::enqueue((Socket)s, (bytes)data)");
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(py_data.ptr(), &view, PyBUF_SIMPLE) != 0)
+    {
+        PyErr_Clear();
+        translateError("Wrong arguments: Scheduler::enqueue("
+                       "(Socket)s, (bytes)data)");
+    }
+    std::string data(static_cast<const char*>(view.buf), view.len);
+    PyBuffer_Release(&view);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<UDTSOCKET, std::shared_ptr<Flow> >::iterator iter =
+        flows_.find(socket->getDescriptor());
+    if (iter == flows_.end())
+        translateError("Socket not registered in the scheduler");
+
+    Flow& flow = *iter->second;
+    if (!flow.error.empty())
+        translateError("Scheduled socket failed: " + flow.error);
+    if (data.empty()) return flow.queued;
+
+    // A single buffer is always accepted by an empty queue
+    if (flow.queued > 0 && flow.queued + int64_t(data.size()) > max_queue_)
+        return -1;
+
+    Class& cls = *flow.cls;
+    if (flow.queue.empty())
+    {
+        // Join the rounds
+        if (cls.flows.empty()) levels_[cls.priority].push_back(&cls);
+        cls.flows.push_back(iter->second);
+    }
+
+    flow.queued += data.size();
+    cls.queued_bytes += data.size();
+    ++cls.queued_buffers;
+    queued_bytes_ += data.size();
+    flow.queue.push_back(std::string());
+    flow.queue.back().swap(data);
+
+    if (polling_) wake();
+    cond_.notify_one();
+
+    return flow.queued;
+}
+
+
+bool Scheduler::flush(int64_t ms_timeout)
+{
+    bool empty;
+
+    Py_BEGIN_ALLOW_THREADS;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (ms_timeout < 0)
+        {
+            drained_.wait(lock, [this] { return queued_bytes_ == 0; });
+            empty = true;
+        }
+        else
+        {
+            empty = drained_.wait_for(lock,
+                                      std::chrono::milliseconds(ms_timeout),
+                                      [this] { return queued_bytes_ == 0; });
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    return empty;
+}
+
+
+void Scheduler::wake()
+{
+    uint64_t one = 1;
+    if (::write(wake_fd_, &one, sizeof(one)) < 0)
+    {
+        // Already signaled
+    }
+}
+
+
+std::shared_ptr<Scheduler::Flow> Scheduler::pick(size_t& len)
+{
+    for (std::map<int, std::deque<Class*> >::iterator level = levels_.begin();
+         level != levels_.end();
+         ++level)
+    {
+        std::deque<Class*>& classes = level->second;
+
+        for (size_t i = 0; i < classes.size(); ++i)
+        {
+            Class& cls = *classes.front();
+
+            // First socket of the class that can be written to
+            std::shared_ptr<Flow> flow;
+            for (size_t j = 0; j < cls.flows.size(); ++j)
+            {
+                std::shared_ptr<Flow>& f = cls.flows.front();
+                if (f->writable && !f->busy && !f->removed)
+                {
+                    flow = f;
+                    break;
+                }
+                cls.flows.push_back(f);
+                cls.flows.pop_front();
+            }
+
+            if (!flow)
+            {
+                classes.push_back(classes.front());
+                classes.pop_front();
+                continue;
+            }
+
+            // New turns: grant the quanta
+            if (cls.deficit <= 0.) cls.deficit += quantum_ * cls.weight;
+            if (flow->deficit <= 0.) flow->deficit += quantum_ * flow->weight;
+
+            len = flow->queue.front().size() - flow->offset;
+            len = std::min(len, detail::max_write);
+            len = std::min(len, (size_t) std::max(1., cls.deficit));
+            len = std::min(len, (size_t) std::max(1., flow->deficit));
+            return flow;
+        }
+    }
+
+    return std::shared_ptr<Flow>();
+}
+
+
+void Scheduler::drop(Flow& flow)
+{
+    Class& cls = *flow.cls;
+
+    if (!flow.writable)
+    {
+        if (UDT::ERROR == UDT::epoll_remove_usock(eid_, flow.socket))
+            UDT::getlasterror().clear();
+        flow.writable = true;
+        --blocked_;
+    }
+
+    if (!flow.queue.empty())
+    {
+        cls.queued_bytes -= flow.queued;
+        cls.queued_buffers -= flow.queue.size();
+        queued_bytes_ -= flow.queued;
+
+        std::deque<std::shared_ptr<Flow> >::iterator iter =
+            std::find_if(cls.flows.begin(), cls.flows.end(),
+                         [&flow] (const std::shared_ptr<Flow>& f)
+                         { return f.get() == &flow; });
+        if (iter != cls.flows.end()) cls.flows.erase(iter);
+
+        if (cls.flows.empty())
+        {
+            detail::erase(levels_[cls.priority], &cls);
+            cls.deficit = 0.;
+        }
+    }
+
+    // A sender thread may still be writing the first buffer of a removed
+    // socket: it is released with the socket
+    if (!flow.busy)
+    {
+        flow.queue.clear();
+        flow.offset = 0;
+    }
+    flow.queued = 0;
+    flow.deficit = 0.;
+
+    if (queued_bytes_ == 0) drained_.notify_all();
+}
+
+
+void Scheduler::complete(const std::shared_ptr<Flow>& flow, int res, int code,
+                         const std::string& message)
+{
+    flow->busy = false;
+    if (flow->removed)
+    {
+        // remove() completes the buffer
+        if (res > 0) flow->offset += res;
+        idle_.notify_all();
+        return;
+    }
+
+    Class& cls = *flow->cls;
+
+    if (res == UDT::ERROR)
+    {
+        if (code == CUDTException::EASYNCSND)
+        {
+            // Park the socket until it becomes writable
+            int events = UDT_EPOLL_OUT | UDT_EPOLL_ERR;
+            if (UDT::ERROR == UDT::epoll_add_usock(eid_, flow->socket, &events))
+            {
+                // Left writable, the socket would be retried in a busy loop
+                flow->error = UDT::getlasterror().getErrorMessage();
+                UDT::getlasterror().clear();
+                PYUDT_LOG_ERROR("Scheduler dropped the queue of socket "
+                                << flow->socket << ": " << flow->error);
+                drop(*flow);
+                return;
+            }
+            flow->writable = false;
+            ++blocked_;
+            detail::rotate(cls.flows, flow);
+            return;
+        }
+
+        PYUDT_LOG_ERROR("Scheduler dropped the queue of socket "
+                        << flow->socket << ": " << message);
+        flow->error = message;
+        drop(*flow);
+        return;
+    }
+
+    flow->offset += res;
+    flow->queued -= res;
+    flow->sent_bytes += res;
+    flow->deficit = std::max(0., flow->deficit - res);
+    cls.deficit = std::max(0., cls.deficit - res);
+    cls.queued_bytes -= res;
+    cls.sent_bytes += res;
+    queued_bytes_ -= res;
+
+    if (flow->offset == flow->queue.front().size())
+    {
+        flow->queue.pop_front();
+        flow->offset = 0;
+        --cls.queued_buffers;
+        ++cls.sent_buffers;
+    }
+
+    // Throughput windows
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    cls.window_bytes += res;
+    if (now - cls.window_start >= detail::rate_window)
+    {
+        double seconds = std::chrono::duration<double>(now - cls.window_start)
+                         .count();
+        cls.rate = cls.window_bytes / seconds;
+        cls.window_bytes = 0;
+        cls.window_start = now;
+    }
+
+    // Leave the rounds once empty, or end the turns whose quantum is spent
+    if (flow->queue.empty())
+    {
+        flow->deficit = 0.;
+        detail::erase(cls.flows, flow);
+    }
+    else if (flow->deficit <= 0.)
+    {
+        detail::rotate(cls.flows, flow);
+    }
+
+    if (cls.flows.empty())
+    {
+        cls.deficit = 0.;
+        detail::erase(levels_[cls.priority], &cls);
+    }
+    else if (cls.deficit <= 0.)
+    {
+        detail::rotate(levels_[cls.priority], &cls);
+    }
+
+    if (queued_bytes_ == 0) drained_.notify_all();
+}
+
+
+void Scheduler::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        size_t len = 0;
+        std::shared_ptr<Flow> flow = pick(len);
+        if (flow)
+        {
+            flow->busy = true;
+            const char* data = flow->queue.front().data() + flow->offset;
+
+            // The buffer stays valid: drop() does not release the buffers
+            // of a busy socket
+            lock.unlock();
+            int res = UDT::send(flow->socket, data, (int) len, 0);
+            int code = 0;
+            std::string message;
+            if (res == UDT::ERROR)
+            {
+                code = UDT::getlasterror().getErrorCode();
+                if (code != CUDTException::EASYNCSND)
+                    message = UDT::getlasterror().getErrorMessage();
+                UDT::getlasterror().clear();
+            }
+            lock.lock();
+
+            complete(flow, res, code, message);
+
+            // Other sockets may have become eligible
+            cond_.notify_one();
+            continue;
+        }
+
+        // Nothing to send, or another thread waits for the sockets
+        if (blocked_ == 0 || polling_)
+        {
+            cond_.wait(lock);
+            continue;
+        }
+
+        polling_ = true;
+        lock.unlock();
+
+        std::set<UDTSOCKET> writable;
+        std::set<SYSSOCKET> wakeups;
+        if (UDT::ERROR == UDT::epoll_wait(eid_, nullptr, &writable,
+                                          detail::scheduler_poll_ms,
+                                          &wakeups, nullptr))
+        {
+            UDT::getlasterror().clear();
+        }
+        if (!wakeups.empty())
+        {
+            uint64_t count;
+            if (::read(wake_fd_, &count, sizeof(count)) < 0)
+            {
+                // Already reset
+            }
+        }
+
+        lock.lock();
+        polling_ = false;
+
+        for (std::set<UDTSOCKET>::const_iterator iter = writable.begin();
+             iter != writable.end();
+             ++iter)
+        {
+            std::map<UDTSOCKET, std::shared_ptr<Flow> >::iterator f =
+                flows_.find(*iter);
+            if (f == flows_.end() || f->second->writable) continue;
+
+            if (UDT::ERROR == UDT::epoll_remove_usock(eid_, *iter))
+                UDT::getlasterror().clear();
+            f->second->writable = true;
+            --blocked_;
+        }
+        cond_.notify_all();
+    }
+}
+
+
+py::dict Scheduler::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    py::dict classes;
+    for (std::map<std::string, std::unique_ptr<Class> >::const_iterator iter =
+             classes_.begin();
+         iter != classes_.end();
+         ++iter)
+    {
+        const Class& c = *iter->second;
+
+        // Current window once it is longer than the last complete one
+        double rate = c.rate;
+        double seconds = std::chrono::duration<double>(now - c.window_start)
+                         .count();
+        if (now - c.window_start >= detail::rate_window)
+            rate = c.window_bytes / seconds;
+
+        py::dict d;
+        d["weight"]          = c.weight;
+        d["priority"]        = c.priority;
+        d["sockets"]         = c.sockets;
+        d["active_sockets"]  = c.flows.size();
+        d["queued_bytes"]    = c.queued_bytes;
+        d["queued_buffers"]  = c.queued_buffers;
+        d["sent_bytes"]      = c.sent_bytes;
+        d["sent_buffers"]    = c.sent_buffers;
+        d["throughput_mbps"] = rate * 8. / 1e6;
+        classes[iter->first] = d;
+    }
+
+    py::dict sockets;
+    for (std::map<UDTSOCKET, std::shared_ptr<Flow> >::const_iterator iter =
+             flows_.begin();
+         iter != flows_.end();
+         ++iter)
+    {
+        const Flow& f = *iter->second;
+
+        py::dict d;
+        d["class"]          = f.cls->name;
+        d["weight"]         = f.weight;
+        d["queued_bytes"]   = f.queued;
+        d["queued_buffers"] = f.queue.size();
+        d["sent_bytes"]     = f.sent_bytes;
+        d["writable"]       = f.writable;
+        if (!f.error.empty()) d["error"] = f.error;
+        sockets[iter->first] = d;
+    }
+
+    py::dict res;
+    res["classes"] = classes;
+    res["sockets"] = sockets;
+    res["queued_bytes"] = queued_bytes_;
+    res["blocked_sockets"] = blocked_;
+    return res;
+}
+
+} // namespace pyudt4
@@ -0,0 +1,543 @@
+#include "Shaper.hh"
+
+#include <Python.h>
+#include <udt/udt.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "SocketOptions.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * Demand of a socket sending at its cap: unbounded.
+ */
+static const double unbounded = std::numeric_limits<double>::infinity();
+
+/**
+ * A socket sending at this fraction of its allocation is limited by the
+ * shaper, and wants more.
+ */
+static const double greedy_ratio = 0.8;
+
+/**
+ * Margin given to the sockets below their allocation, so that they can
+ * grow until they reach greedy_ratio.
+ */
+static const double demand_headroom = 1.25;
+
+/**
+ * Demand of an idle socket, in bytes/s (1 Mb/s): enough to start sending.
+ */
+static const double min_demand = 125000.;
+
+/**
+ * Smallest UDT_MAXBW applied, in bytes/s (0 would mean no limit).
+ */
+static const int64_t min_maxbw = 12500;
+
+static
+double to_bytes(double mbps)
+{
+    return mbps * 1e6 / 8.;
+}
+
+
+static
+double to_mbps(double bytes)
+{
+    return bytes * 8. / 1e6;
+}
+
+
+/**
+ * Claim of a child class or socket on the allocation of its parent.
+ */
+struct Share
+{
+    double rate;
+    double ceil;
+    double weight;
+    double demand;
+    double alloc;
+};
+
+/**
+ * Share a capacity: every claim first gets its guaranteed rate (within its
+ * demand), then the surplus is shared in proportion to the weights, up to
+ * the ceil and the demand of each claim (weighted max-min fairness).
+ */
+static
+void water_fill(std::vector<Share>& shares, double capacity)
+{
+    double guaranteed = 0.;
+    for (size_t i = 0; i < shares.size(); ++i)
+    {
+        shares[i].alloc = std::min(shares[i].rate, shares[i].demand);
+        guaranteed += shares[i].alloc;
+    }
+
+    // Guarantees above the capacity of the parent: scale them down
+    if (guaranteed > capacity)
+    {
+        double scale = (guaranteed > 0.)? capacity / guaranteed : 0.;
+        for (size_t i = 0; i < shares.size(); ++i)
+            shares[i].alloc *= scale;
+        return;
+    }
+
+    std::vector<size_t> wanting;
+    for (size_t i = 0; i < shares.size(); ++i)
+    {
+        if (std::min(shares[i].ceil, shares[i].demand) > shares[i].alloc)
+            wanting.push_back(i);
+    }
+
+    double surplus = capacity - guaranteed;
+    while (surplus > 0. && !wanting.empty())
+    {
+        double total_weight = 0.;
+        for (size_t i = 0; i < wanting.size(); ++i)
+            total_weight += shares[wanting[i]].weight;
+
+        // Satisfy the claims that want less than their share, and retry
+        // with what they leave
+        std::vector<size_t> still_wanting;
+        double given = 0.;
+        for (size_t i = 0; i < wanting.size(); ++i)
+        {
+            Share& s = shares[wanting[i]];
+            double want = std::min(s.ceil, s.demand) - s.alloc;
+            if (want <= surplus * s.weight / total_weight)
+            {
+                s.alloc += want;
+                given += want;
+            }
+            else
+            {
+                still_wanting.push_back(wanting[i]);
+            }
+        }
+
+        if (still_wanting.size() == wanting.size())
+        {
+            for (size_t i = 0; i < wanting.size(); ++i)
+            {
+                Share& s = shares[wanting[i]];
+                s.alloc += surplus * s.weight / total_weight;
+            }
+            break;
+        }
+
+        surplus -= given;
+        wanting.swap(still_wanting);
+    }
+}
+
+} // namespace detail
+
+
+Shaper::Shaper(int interval_ms)
+: PeriodicTask(interval_ms),
+  last_sample_(std::chrono::steady_clock::now())
+{
+}
+
+
+Shaper::~Shaper()
+{
+    stop();
+}
+
+
+void Shaper::add_class(std::string name, double rate_mbps, double ceil_mbps,
+                       std::string parent, double weight) throw()
+{
+    if (ceil_mbps == 0.) ceil_mbps = rate_mbps;
+
+    if (name.empty() || rate_mbps < 0. || ceil_mbps < rate_mbps || weight <= 0.)
+    {
+        translateError("Wrong arguments: Shaper::add_class("
+                       "(str)name, (float)rate_mbps >= 0, "
+                       "(float)ceil_mbps >= rate_mbps, "
+                       "(str)parent, (float)weight > 0)");
+    }
+
+    std::unique_lock<std::mutex> lock(acquire());
+
+    if (classes_.count(name))
+        translateError("Shaper class already exists: " + name);
+    if (!parent.empty() && !classes_.count(parent))
+        translateError("Unknown shaper class: " + parent);
+
+    Class cls = Class();
+    cls.parent = parent;
+    cls.rate   = detail::to_bytes(rate_mbps);
+    cls.ceil   = detail::to_bytes(ceil_mbps);
+    cls.weight = weight;
+    classes_[name] = cls;
+
+    if (!parent.empty()) classes_[parent].children.push_back(name);
+
+    rebalance();
+    lock.unlock();
+
+    apply_released();
+}
+
+
+void Shaper::remove_class(std::string name) throw()
+{
+    std::unique_lock<std::mutex> lock(acquire());
+
+    std::map<std::string, Class>::iterator iter = classes_.find(name);
+    if (iter == classes_.end())
+        translateError("Unknown shaper class: " + name);
+    if (!iter->second.children.empty() || !iter->second.sockets.empty())
+        translateError("Shaper class is not empty: " + name);
+
+    if (!iter->second.parent.empty())
+    {
+        std::vector<std::string>& siblings =
+            classes_[iter->second.parent].children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), name));
+    }
+    classes_.erase(iter);
+
+    rebalance();
+    lock.unlock();
+
+    apply_released();
+}
+
+
+void Shaper::add(py::object py_socket, std::string name) throw()
+{
+    Socket* socket = extractSocket(py_socket,
+        "Shaper::add((Socket)s, (str)name)");
+    UDTSOCKET u = socket->getDescriptor();
+
+    int mss = 0;
+    if (UDT::ERROR == options::get<UDT_MSS>(u, mss))
+    {
+        translateUDTError();
+        return;
+    }
+
+    // Count the packets sent from now on (none if not connected yet)
+    UDT::TRACEINFO perf;
+    int64_t packets = 0;
+    if (UDT::ERROR != UDT::perfmon(u, &perf, false))
+        packets = perf.pktSentTotal;
+    else
+        UDT::getlasterror().clear();
+
+    std::unique_lock<std::mutex> lock(acquire());
+
+    std::map<std::string, Class>::iterator cls = classes_.find(name);
+    if (cls == classes_.end())
+        translateError("Unknown shaper class: " + name);
+
+    if (members_.count(u)) detach(u);
+
+    Member member = Member();
+    member.cls     = name;
+    member.mss     = mss;
+    member.packets = packets;
+    member.demand  = detail::unbounded;
+    member.maxbw   = -1;
+    members_[u] = member;
+    cls->second.sockets.push_back(u);
+    released_.erase(std::remove(released_.begin(), released_.end(), u),
+                    released_.end());
+
+    rebalance();
+    lock.unlock();
+
+    apply_released();
+
+    PYUDT_LOG_TRACE("Shaper attached socket " << u << " to class " << name);
+}
+
+
+void Shaper::remove(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket,
+        "Shaper::remove((Socket)s)");
+    UDTSOCKET u = socket->getDescriptor();
+
+    std::unique_lock<std::mutex> lock(acquire());
+    if (!members_.count(u)) return;
+
+    detach(u);
+    members_.erase(u);
+    released_.push_back(u);
+
+    rebalance();
+    lock.unlock();
+
+    apply_released();
+}
+
+
+void Shaper::detach(UDTSOCKET u)
+{
+    std::vector<UDTSOCKET>& sockets = classes_[members_[u].cls].sockets;
+    sockets.erase(std::find(sockets.begin(), sockets.end(), u));
+}
+
+
+void Shaper::tick()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_sample_).count();
+    last_sample_ = now;
+    if (seconds <= 0.) return;
+
+    UDT::TRACEINFO perf;
+
+    std::map<UDTSOCKET, Member>::iterator iter = members_.begin();
+    while (iter != members_.end())
+    {
+        UDTSOCKET u = iter->first;
+        Member& member = iter->second;
+
+        UDTSTATUS status = UDT::getsockstate(u);
+        if (status == BROKEN || status == CLOSED || status == NONEXIST)
+        {
+            detach(u);
+            members_.erase(iter++);
+            continue;
+        }
+
+        if (status != CONNECTED || UDT::ERROR == UDT::perfmon(u, &perf, false))
+        {
+            UDT::getlasterror().clear();
+            ++iter;
+            continue;
+        }
+
+        // UDT_MAXBW paces MSS-sized packets: measure in the same unit
+        int64_t packets = perf.pktSentTotal - member.packets;
+        member.packets = perf.pktSentTotal;
+        member.throughput = double(packets) * member.mss / seconds;
+        classes_[member.cls].packets += packets;
+
+        if (member.alloc <= 0.
+         || member.throughput >= detail::greedy_ratio * member.alloc)
+        {
+            member.demand = detail::unbounded;
+        }
+        else
+        {
+            member.demand = std::max(detail::min_demand,
+                                     member.throughput * detail::demand_headroom);
+        }
+
+        ++iter;
+    }
+
+    rebalance();
+}
+
+
+void Shaper::after_tick()
+{
+    apply();
+}
+
+
+double Shaper::update_demand(Class& cls)
+{
+    double demand = 0.;
+    for (size_t i = 0; i < cls.children.size(); ++i)
+        demand += update_demand(classes_[cls.children[i]]);
+    for (size_t i = 0; i < cls.sockets.size(); ++i)
+        demand += members_[cls.sockets[i]].demand;
+
+    cls.demand = std::min(cls.ceil, demand);
+    return cls.demand;
+}
+
+
+double Shaper::update_throughput(Class& cls)
+{
+    double throughput = 0.;
+    for (size_t i = 0; i < cls.children.size(); ++i)
+        throughput += update_throughput(classes_[cls.children[i]]);
+    for (size_t i = 0; i < cls.sockets.size(); ++i)
+        throughput += members_[cls.sockets[i]].throughput;
+
+    cls.throughput = throughput;
+    return throughput;
+}
+
+
+void Shaper::distribute(Class& cls)
+{
+    // Child classes first, then the sockets (no guarantee, equal weights)
+    std::vector<detail::Share> shares;
+    for (size_t i = 0; i < cls.children.size(); ++i)
+    {
+        const Class& child = classes_[cls.children[i]];
+        detail::Share s = { child.rate, child.ceil, child.weight,
+                            child.demand, 0. };
+        shares.push_back(s);
+    }
+    for (size_t i = 0; i < cls.sockets.size(); ++i)
+    {
+        detail::Share s = { 0., detail::unbounded, 1.,
+                            members_[cls.sockets[i]].demand, 0. };
+        shares.push_back(s);
+    }
+
+    detail::water_fill(shares, cls.alloc);
+
+    size_t n = cls.children.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        Class& child = classes_[cls.children[i]];
+        child.alloc = shares[i].alloc;
+        distribute(child);
+    }
+    for (size_t i = 0; i < cls.sockets.size(); ++i)
+        members_[cls.sockets[i]].alloc = shares[n + i].alloc;
+}
+
+
+void Shaper::rebalance()
+{
+    for (std::map<std::string, Class>::iterator iter = classes_.begin();
+         iter != classes_.end();
+         ++iter)
+    {
+        Class& cls = iter->second;
+        if (!cls.parent.empty()) continue;
+
+        // A root class has nothing to borrow from: its rate is its capacity
+        update_demand(cls);
+        cls.alloc = cls.rate;
+        distribute(cls);
+        update_throughput(cls);
+    }
+}
+
+
+void Shaper::apply()
+{
+    std::lock_guard<std::mutex> applying(apply_mutex_);
+
+    std::vector<std::pair<UDTSOCKET, int64_t> > changes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (size_t i = 0; i < released_.size(); ++i)
+            changes.push_back(std::make_pair(released_[i], int64_t(-1)));
+        released_.clear();
+
+        for (std::map<UDTSOCKET, Member>::const_iterator iter =
+                 members_.begin();
+             iter != members_.end();
+             ++iter)
+        {
+            const Member& member = iter->second;
+            int64_t maxbw = std::max(detail::min_maxbw,
+                                     (int64_t) member.alloc);
+
+            // Skip the changes below 1%
+            if (member.maxbw > 0
+             && std::abs(maxbw - member.maxbw) * 100 < member.maxbw)
+            {
+                continue;
+            }
+            changes.push_back(std::make_pair(iter->first, maxbw));
+        }
+    }
+    if (changes.empty()) return;
+
+    std::vector<bool> applied(changes.size(), false);
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        if (UDT::ERROR == options::set<UDT_MAXBW>(changes[i].first,
+                                                  changes[i].second))
+            UDT::getlasterror().clear();
+        else
+            applied[i] = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        std::map<UDTSOCKET, Member>::iterator iter =
+            members_.find(changes[i].first);
+        if (applied[i] && changes[i].second > 0 && iter != members_.end())
+            iter->second.maxbw = changes[i].second;
+    }
+}
+
+
+void Shaper::apply_released()
+{
+    Py_BEGIN_ALLOW_THREADS;
+    apply();
+    Py_END_ALLOW_THREADS;
+}
+
+
+py::dict Shaper::stats()
+{
+    std::unique_lock<std::mutex> lock(acquire());
+
+    py::dict classes;
+    for (std::map<std::string, Class>::const_iterator iter = classes_.begin();
+         iter != classes_.end();
+         ++iter)
+    {
+        const Class& c = iter->second;
+
+        py::dict d;
+        d["parent"]          = c.parent;
+        d["rate_mbps"]       = detail::to_mbps(c.rate);
+        d["ceil_mbps"]       = detail::to_mbps(c.ceil);
+        d["weight"]          = c.weight;
+        d["children"]        = c.children.size();
+        d["sockets"]         = c.sockets.size();
+        d["demand_mbps"]     = detail::to_mbps(c.demand);
+        d["allocated_mbps"]  = detail::to_mbps(c.alloc);
+        d["borrowed_mbps"]   = detail::to_mbps(std::max(0., c.alloc - c.rate));
+        d["throughput_mbps"] = detail::to_mbps(c.throughput);
+        d["sent_packets"]    = c.packets;
+        classes[iter->first] = d;
+    }
+
+    py::dict sockets;
+    for (std::map<UDTSOCKET, Member>::const_iterator iter = members_.begin();
+         iter != members_.end();
+         ++iter)
+    {
+        const Member& m = iter->second;
+
+        py::dict d;
+        d["class"]           = m.cls;
+        d["demand_mbps"]     = detail::to_mbps(m.demand);
+        d["allocated_mbps"]  = detail::to_mbps(m.alloc);
+        d["throughput_mbps"] = detail::to_mbps(m.throughput);
+        d["maxbw"]           = m.maxbw;
+        sockets[iter->first] = d;
+    }
+
+    py::dict res;
+    res["classes"] = classes;
+    res["sockets"] = sockets;
+    return res;
+}
+
+} // namespace pyudt4
@@ -1,12 +1,25 @@
 #include "Socket.hh"
 
 #include <udt/udt.h>
+#include <set>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <time.h>
 #include <arpa/inet.h> // inet_pton
 #include <netdb.h> // getnameinfo
 #include <boost/tuple/tuple.hpp>
 
+#include "SocketOptions.hh"
+#include "CongestionControl.hh"
+#include "Perfmon.hh"
+#include "Counters.hh"
+#include "Stats.hh"
+#include "Trace.hh"
+#include "Probes.hh"
 #include "Exception.hh"
 #include "Debug.hh"
 
@@ -44,6 +57,192 @@ std::string type_to_string(int type)
     }
 }
 
+/**
+ * Header prefixed to timestamped messages.
+ */
+struct MessageStamp
+{
+    uint32_t magic;
+    uint32_t reserved;
+
+    /**
+     * Send time, in nanoseconds since the epoch.
+     */
+    int64_t  ns;
+};
+
+/**
+ * "PYTS" in little-endian order.
+ */
+static const uint32_t stamp_magic = 0x53545950;
+
+/**
+ * Wall-clock time, in nanoseconds. The wall clock is used instead of the
+ * monotonic clock so that latencies remain meaningful between hosts whose
+ * clocks are synchronized.
+ */
+static
+int64_t wall_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Read-only view over a Python buffer, released when leaving the scope.
+ */
+class ReadBuffer
+{
+public:
+    ReadBuffer(py::object py_data, const char* what)
+    {
+        if (PyObject_GetBuffer(py_data.ptr(), &view_, PyBUF_SIMPLE) != 0)
+        {
+            PyErr_Clear();
+            Exception e(std::string("Wrong arguments: ") + what, "");
+            translateException(e);
+            throw e;
+        }
+    }
+
+    ~ReadBuffer()
+    {
+        PyBuffer_Release(&view_);
+    }
+
+    const char* data() const { return static_cast<const char*>(view_.buf); }
+    int size() const { return (int) view_.len; }
+
+private:
+    Py_buffer view_;
+};
+
+/**
+ * Convert a duration to a UDT timeout, rounded up to the millisecond.
+ */
+static
+int to_timeout_ms(double ns)
+{
+    if (ns <= 0) return 0;
+    return (int) std::min<double>(std::ceil(ns / 1e6), INT_MAX);
+}
+
+/**
+ * Time left until a deadline (seconds on the monotonic clock), as a UDT
+ * timeout. 0 once the deadline passed.
+ */
+static
+int remaining_ms(double deadline)
+{
+    return to_timeout_ms(deadline * 1e9 - (double) stats::now_ns());
+}
+
+/**
+ * Whether the last UDT error only means that the call would block, in
+ * which case it is cleared.
+ */
+static
+bool would_block()
+{
+    int code = UDT::getlasterror().getErrorCode();
+    if (code != CUDTException::EASYNCSND && code != CUDTException::EASYNCRCV)
+        return false;
+
+    UDT::getlasterror().clear();
+    return true;
+}
+
+/**
+ * Free space of the send buffer, in bytes, or -1 on error. Only reads the
+ * options: changing them would wait for the calls in progress on the
+ * socket.
+ */
+static
+int send_space(UDTSOCKET u)
+{
+    int sndbuf = 0, mss = 0, pending = 0;
+    if (UDT::ERROR == options::get<UDT_SNDBUF>(u, sndbuf)
+     || UDT::ERROR == options::get<UDT_MSS>(u, mss)
+     || UDT::ERROR == options::get<UDT_SNDDATA>(u, pending))
+    {
+        return -1;
+    }
+
+    // UDT_SNDBUF is in bytes, UDT_SNDDATA in payload-sized blocks
+    int payload = std::max(1, mss - 28);
+    return std::max(0, sndbuf / payload - pending) * payload;
+}
+
+/**
+ * Whether a call on a socket that is not connected (anymore) fails at once
+ * rather than blocking, which reports the error.
+ */
+static
+bool fails_at_once(UDTSOCKET u)
+{
+    return UDT::getsockstate(u) != CONNECTED;
+}
+
+/**
+ * UDT epoll of a single socket, created on first use, to wait until it is
+ * readable or writable without changing its options.
+ */
+class Readiness
+{
+public:
+    Readiness(UDTSOCKET u, int events)
+    : u_(u),
+      events_(events),
+      eid_(-1)
+    {
+    }
+
+    ~Readiness()
+    {
+        if (eid_ >= 0) UDT::epoll_release(eid_);
+    }
+
+    /**
+     * Wait for the events (or an error on the socket), without the GIL.
+     * @param timeout_ms timeout in milliseconds, negative to wait forever.
+     * @return 1 once ready, 0 on timeout, or UDT::ERROR.
+     */
+    int wait(int timeout_ms)
+    {
+        if (eid_ < 0)
+        {
+            eid_ = UDT::epoll_create();
+            if (eid_ < 0) return UDT::ERROR;
+
+            int events = events_ | UDT_EPOLL_ERR;
+            if (UDT::ERROR == UDT::epoll_add_usock(eid_, u_, &events))
+            {
+                UDT::epoll_release(eid_);
+                eid_ = -1;
+                return UDT::ERROR;
+            }
+        }
+
+        std::set<UDTSOCKET> readable, writable;
+        int res = UDT::epoll_wait(eid_,
+                                  (events_ & UDT_EPOLL_IN)? &readable:nullptr,
+                                  (events_ & UDT_EPOLL_OUT)? &writable:nullptr,
+                                  timeout_ms);
+        if (res != UDT::ERROR) return 1;
+
+        if (UDT::getlasterror().getErrorCode() != CUDTException::ETIMEOUT)
+            return UDT::ERROR;
+        UDT::getlasterror().clear();
+        return 0;
+    }
+
+private:
+    UDTSOCKET u_;
+    int events_;
+    int eid_;
+};
+
 } // namespace detail
 
 sockaddr_in Socket::build_sockaddr_in(const char* ip, uint16_t port,
@@ -80,7 +279,13 @@ Socket::Socket()
   type_(SOCK_STREAM),
   protocol_(0),
   close_on_delete_(true),
-  is_alive_(false)
+  is_alive_(false),
+  snd_blocking_(false),
+  rcv_blocking_(true),
+  snd_timeout_ms_(-1),
+  rcv_timeout_ms_(-1),
+  timestamping_(false),
+  unstamped_(0)
 {
     // Create a UDT socket
     descriptor_ = UDT::socket(addr_family_, type_, protocol_);
@@ -92,20 +297,11 @@ Socket::Socket()
         return;
     }
 
+    counters::add(counters::sockets_created);
+    trace::event(trace::socket_create, descriptor_);
     PYUDT_LOG_TRACE("Created UDT socket " << descriptor_);
 
-    // Set default socket options
-    bool blocking_send = false;
-    bool blocking_recv = true;
-    if (UDT::ERROR == UDT::setsockopt(descriptor_, 0, UDT_SNDSYN,
-                                      &blocking_send, sizeof(blocking_send))
-     || UDT::ERROR == UDT::setsockopt(descriptor_, 0, UDT_RCVSYN,
-                                      &blocking_recv, sizeof(blocking_recv))
-       )
-    {
-        translateUDTError();
-        return;
-    }
+    setDefaultOptions();
 
     PYUDT_LOG_TRACE("Set default options for UDT socket " << descriptor_);
 }
@@ -117,7 +313,13 @@ Socket::Socket(UDTSOCKET descriptor, bool close_on_delete)
   type_(0),
   protocol_(0),
   close_on_delete_(close_on_delete),
-  is_alive_(true)
+  is_alive_(true),
+  snd_blocking_(false),
+  rcv_blocking_(true),
+  snd_timeout_ms_(-1),
+  rcv_timeout_ms_(-1),
+  timestamping_(false),
+  unstamped_(0)
 {
     PYUDT_LOG_TRACE("Created Socket object from existing socket " << descriptor_);
 
@@ -128,20 +330,131 @@ Socket::Socket(UDTSOCKET descriptor, bool close_on_delete)
     addr_family_ = AF_INET;
     type_ = SOCK_STREAM;
 
-    // Set default socket options
-    bool blocking_send = false;
-    bool blocking_recv = true;
-    if (UDT::ERROR == UDT::setsockopt(descriptor_, 0, UDT_SNDSYN,
-                                      &blocking_send, sizeof(blocking_send))
-     || UDT::ERROR == UDT::setsockopt(descriptor_, 0, UDT_RCVSYN,
-                                      &blocking_recv, sizeof(blocking_recv))
-       )
+    setDefaultOptions();
+
+    PYUDT_LOG_TRACE("Default options set for UDT socket " << descriptor_);
+}
+
+
+Socket::Socket(int addr_family, int type, int protocol)
+: descriptor_(0),
+  addr_family_(addr_family),
+  type_(type),
+  protocol_(protocol),
+  close_on_delete_(true),
+  is_alive_(false),
+  snd_blocking_(false),
+  rcv_blocking_(true),
+  snd_timeout_ms_(-1),
+  rcv_timeout_ms_(-1),
+  timestamping_(false),
+  unstamped_(0)
+{
+    descriptor_ = UDT::socket(addr_family_, type_, protocol_);
+
+    if (descriptor_ == UDT::INVALID_SOCK)
     {
         translateUDTError();
         return;
     }
 
-    PYUDT_LOG_TRACE("Default options set for UDT socket " << descriptor_);
+    counters::add(counters::sockets_created);
+    trace::event(trace::socket_create, descriptor_, type_);
+    PYUDT_LOG_TRACE("Created UDT socket " << descriptor_ << " of type "
+                    << detail::type_to_string(type_));
+
+    setDefaultOptions();
+}
+
+
+void Socket::setDefaultOptions() throw()
+{
+    if (UDT::ERROR == options::set<UDT_SNDSYN>(descriptor_, false)
+     || UDT::ERROR == options::set<UDT_RCVSYN>(descriptor_, true))
+    {
+        translateUDTError();
+        return;
+    }
+
+    snd_blocking_ = false;
+    rcv_blocking_ = true;
+}
+
+
+void Socket::setSendMode(bool blocking, int timeout_ms) throw()
+{
+    int res = 0;
+
+    if (blocking != snd_blocking_)
+    {
+        Py_BEGIN_ALLOW_THREADS;
+        res = options::set<UDT_SNDSYN>(descriptor_, blocking);
+        Py_END_ALLOW_THREADS;
+        if (res == UDT::ERROR)
+        {
+            translateUDTError();
+            return;
+        }
+        snd_blocking_ = blocking;
+    }
+
+    if (timeout_ms != snd_timeout_ms_)
+    {
+        Py_BEGIN_ALLOW_THREADS;
+        res = options::set<UDT_SNDTIMEO>(descriptor_, timeout_ms);
+        Py_END_ALLOW_THREADS;
+        if (res == UDT::ERROR)
+        {
+            translateUDTError();
+            return;
+        }
+        snd_timeout_ms_ = timeout_ms;
+    }
+}
+
+
+void Socket::setRecvMode(bool blocking, int timeout_ms) throw()
+{
+    int res = 0;
+
+    if (blocking != rcv_blocking_)
+    {
+        Py_BEGIN_ALLOW_THREADS;
+        res = options::set<UDT_RCVSYN>(descriptor_, blocking);
+        Py_END_ALLOW_THREADS;
+        if (res == UDT::ERROR)
+        {
+            translateUDTError();
+            return;
+        }
+        rcv_blocking_ = blocking;
+    }
+
+    if (timeout_ms != rcv_timeout_ms_)
+    {
+        Py_BEGIN_ALLOW_THREADS;
+        res = options::set<UDT_RCVTIMEO>(descriptor_, timeout_ms);
+        Py_END_ALLOW_THREADS;
+        if (res == UDT::ERROR)
+        {
+            translateUDTError();
+            return;
+        }
+        rcv_timeout_ms_ = timeout_ms;
+    }
+}
+
+
+void Socket::loadModes() throw()
+{
+    if (UDT::ERROR == options::get<UDT_SNDSYN>(descriptor_, snd_blocking_)
+     || UDT::ERROR == options::get<UDT_RCVSYN>(descriptor_, rcv_blocking_)
+     || UDT::ERROR == options::get<UDT_SNDTIMEO>(descriptor_, snd_timeout_ms_)
+     || UDT::ERROR == options::get<UDT_RCVTIMEO>(descriptor_, rcv_timeout_ms_))
+    {
+        translateUDTError();
+        return;
+    }
 }
 
 
@@ -162,7 +475,9 @@ void Socket::close()
 
     if (is_alive_)
     {
+        PYUDT_PROBE1(close_entry, descriptor_);
         res = UDT::close(descriptor_);
+        PYUDT_PROBE2(close_return, descriptor_, res);
 
         // FIXME: currently ignore invalid socket errors
         // This happens when the socket destructor is called after the epoll
@@ -175,6 +490,8 @@ void Socket::close()
         }
         else
         {
+            counters::add(counters::sockets_closed);
+            trace::event(trace::socket_close, descriptor_);
             PYUDT_LOG_TRACE("Closed UDT socket " << descriptor_);
         }
 
@@ -243,6 +560,141 @@ void Socket::setCloseOnDelete(bool close_on_delete)
 }
 
 
+bool Socket::getRendezvous() const throw()
+{
+    bool rendezvous = false;
+
+    if (UDT::ERROR == options::get<UDT_RENDEZVOUS>(descriptor_, rendezvous))
+    {
+        translateUDTError();
+    }
+
+    return rendezvous;
+}
+
+
+void Socket::setRendezvous(bool rendezvous) throw()
+{
+    if (UDT::ERROR == options::set<UDT_RENDEZVOUS>(descriptor_, rendezvous))
+    {
+        translateUDTError();
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Set rendez-vous mode of socket " << descriptor_
+                    << " to " << rendezvous);
+}
+
+
+bool Socket::getSendBlocking() const
+{
+    return snd_blocking_;
+}
+
+
+void Socket::setSendBlocking(bool blocking) throw()
+{
+    setSendMode(blocking, snd_timeout_ms_);
+}
+
+
+void Socket::setsockopt(int opt, py::object py_value) throw()
+{
+    options::set_from_python(descriptor_, opt, py_value);
+
+    // Keep the cached blocking modes in sync
+    if (opt == UDT_SNDSYN || opt == UDT_RCVSYN
+     || opt == UDT_SNDTIMEO || opt == UDT_RCVTIMEO)
+        loadModes();
+}
+
+
+py::object Socket::getsockopt(int opt) const throw()
+{
+    return options::get_as_python(descriptor_, opt);
+}
+
+
+void Socket::apply_profile(std::string name) throw()
+{
+    options::apply_profile(descriptor_, name);
+}
+
+
+void Socket::set_congestion_control(std::string name, py::dict params) throw()
+{
+    cc::set(descriptor_, name, params);
+}
+
+
+py::dict Socket::congestion_control() const throw()
+{
+    return cc::state(descriptor_);
+}
+
+
+void Socket::setblocking(bool blocking) throw()
+{
+    setSendMode(blocking, -1);
+    setRecvMode(blocking, -1);
+}
+
+
+void Socket::settimeout(py::object py_timeout) throw()
+{
+    if (py_timeout.is_none())
+    {
+        setblocking(true);
+        return;
+    }
+
+    py::extract<double> get_timeout(py_timeout);
+    if (!get_timeout.check() || get_timeout() < 0)
+    {
+        Exception e("Wrong arguments: Socket::settimeout(None or "
+                    "(float)seconds >= 0)", "");
+        translateException(e);
+        throw e;
+    }
+
+    double timeout = get_timeout();
+    if (timeout == 0)
+    {
+        setblocking(false);
+        return;
+    }
+
+    int timeout_ms = detail::to_timeout_ms(timeout * 1e9);
+    setSendMode(true, timeout_ms);
+    setRecvMode(true, timeout_ms);
+}
+
+
+const UDT::TRACEINFO& Socket::perfmon(bool clear) throw()
+{
+    stats::CallScope scope(stats::perfmon, descriptor_);
+    int res;
+
+    scope.releaseGIL();
+    res = UDT::perfmon(descriptor_, &perf_, clear);
+    scope.acquireGIL();
+
+    if (res == UDT::ERROR)
+    {
+        scope.setError();
+        translateUDTError();
+    }
+
+    return perf_;
+}
+
+
+void Socket::perfmon_into(py::object py_buffer, bool clear) const throw()
+{
+    perfmon::into(descriptor_, py_buffer, clear);
+}
+
+
 std::string Socket::str() const
 {
     std::stringstream ss;
@@ -263,23 +715,28 @@ void Socket::recv(char* buf, int buf_len) const throw()
         throw Exception("Null buffer provided during Socket::recv", "");
     }
 
+    stats::CallScope scope(stats::recv, descriptor_);
     int res;
 
     // Initialize the buffer to \0
     memset(buf, '\0', buf_len);
 
-    // FIXME: useful python macros?
-    Py_BEGIN_ALLOW_THREADS;
+    PYUDT_PROBE2(recv_entry, descriptor_, buf_len);
+    scope.releaseGIL();
     res = UDT::recv(descriptor_, buf, buf_len, 0);
-    Py_END_ALLOW_THREADS;
+    scope.acquireGIL();
+    PYUDT_PROBE2(recv_return, descriptor_, res);
 
     if (res == UDT::ERROR)
     {
-        PYUDT_LOG_ERROR("Could not receive data from socket " << descriptor_);
+        scope.setError();
+        PYUDT_LOG_DEBUG("Could not receive data from socket " << descriptor_);
         translateUDTError();
         return;
     }
 
+    scope.setBytes(res);
+
     PYUDT_LOG_TRACE("Received " << buf_len << " byte(s) from socket "
                     << descriptor_ << " that are stored in "
                     << static_cast<void *>(&buf));
@@ -288,27 +745,32 @@ void Socket::recv(char* buf, int buf_len) const throw()
 
 py::str Socket::recv(int buf_len) const throw()
 {
+    stats::CallScope scope(stats::recv, descriptor_);
     int res;
     char* buf = (char*) malloc (buf_len * sizeof(char));
 
     // Initialize the buffer to \0
     memset(buf, '\0', buf_len);
 
-    // FIXME: useful python macros?
-    Py_BEGIN_ALLOW_THREADS;
+    PYUDT_PROBE2(recv_entry, descriptor_, buf_len);
+    scope.releaseGIL();
     res = UDT::recv(descriptor_, buf, buf_len, 0);
-    Py_END_ALLOW_THREADS;
+    scope.acquireGIL();
+    PYUDT_PROBE2(recv_return, descriptor_, res);
 
     if (res == UDT::ERROR)
     {
+        scope.setError();
         free(buf);
-        PYUDT_LOG_ERROR("Could not receive data from socket " << descriptor_);
+        PYUDT_LOG_DEBUG("Could not receive data from socket " << descriptor_);
         translateUDTError();
 
         // None
         return py::str();
     }
 
+    scope.setBytes(res);
+
     py::str py_buf = buf;
     free(buf);
 
@@ -332,20 +794,25 @@ void Socket::send(const char* buf, int buf_len) const throw()
         throw Exception("Null buffer provided during Socket::send", "");
     }
 
+    stats::CallScope scope(stats::send, descriptor_);
     int res;
 
-    // FIXME: useful python macros?
-    Py_BEGIN_ALLOW_THREADS;
+    PYUDT_PROBE2(send_entry, descriptor_, buf_len);
+    scope.releaseGIL();
     res = UDT::send(descriptor_, buf, buf_len, 0);
-    Py_END_ALLOW_THREADS;
+    scope.acquireGIL();
+    PYUDT_PROBE2(send_return, descriptor_, res);
 
     if (res == UDT::ERROR)
     {
-        PYUDT_LOG_ERROR("Could not send data through socket " << descriptor_);
+        scope.setError();
+        PYUDT_LOG_DEBUG("Could not send data through socket " << descriptor_);
         translateUDTError();
         return;
     }
 
+    scope.setBytes(res);
+
     PYUDT_LOG_TRACE("Sent " << buf_len << " byte(s) through socket "
                     << descriptor_ << " that were stored in "
                     << static_cast<void *>(&buf));
@@ -387,26 +854,430 @@ void Socket::send(py::object py_buf) const throw()
         throw e;
     }
 
+    stats::CallScope scope(stats::send, descriptor_);
     int res;
 
-    // FIXME: useful python macros?
-    Py_BEGIN_ALLOW_THREADS;
+    PYUDT_PROBE2(send_entry, descriptor_, buf_len);
+    scope.releaseGIL();
     res = UDT::send(descriptor_, buf, buf_len, 0);
-    Py_END_ALLOW_THREADS;
+    scope.acquireGIL();
+    PYUDT_PROBE2(send_return, descriptor_, res);
 
     if (res == UDT::ERROR)
     {
-        PYUDT_LOG_ERROR("Could not send data through socket " << descriptor_);
+        scope.setError();
+        PYUDT_LOG_DEBUG("Could not send data through socket " << descriptor_);
         translateUDTError();
         return;
     }
 
+    scope.setBytes(res);
+
     PYUDT_LOG_TRACE("Sent " << buf_len << " byte(s) through socket "
                     << descriptor_ << " that were stored in "
                     << static_cast<void *>(&buf));
 }
 
 
+int Socket::try_send(py::object py_data) throw()
+{
+    detail::ReadBuffer data(py_data, "Socket::try_send((bytes)data)");
+    stats::CallScope scope(stats::send, descriptor_);
+
+    int len = data.size();
+
+    // A blocking send only waits while the buffer is full: never offer it
+    // more than the free space
+    if (snd_blocking_ && !detail::fails_at_once(descriptor_))
+    {
+        int space = detail::send_space(descriptor_);
+        if (space < 0)
+        {
+            scope.setError();
+            translateUDTError();
+            return -1;
+        }
+        if (space == 0) return -1;
+        len = std::min(len, space);
+    }
+
+    int res;
+
+    PYUDT_PROBE2(send_entry, descriptor_, len);
+    scope.releaseGIL();
+    res = UDT::send(descriptor_, data.data(), len, 0);
+    scope.acquireGIL();
+    PYUDT_PROBE2(send_return, descriptor_, res);
+
+    if (res == UDT::ERROR)
+    {
+        if (detail::would_block()) return -1;
+
+        scope.setError();
+        translateUDTError();
+        return -1;
+    }
+
+    scope.setBytes(res);
+    return res;
+}
+
+
+int Socket::try_recv_into(py::object py_buffer, int nbytes) throw()
+{
+    perfmon::BufferView buffer(py_buffer, std::max(nbytes, 0),
+                               "Socket::try_recv_into(buffer, (int)nbytes)");
+    stats::CallScope scope(stats::recv, descriptor_);
+
+    int len = (nbytes > 0)? nbytes : (int) buffer.size();
+
+    // A blocking receive returns as soon as data is available
+    if (rcv_blocking_ && !detail::fails_at_once(descriptor_))
+    {
+        int available = 0;
+        if (UDT::ERROR == options::get<UDT_RCVDATA>(descriptor_, available))
+        {
+            scope.setError();
+            translateUDTError();
+            return -1;
+        }
+        if (available == 0) return -1;
+    }
+
+    int res;
+
+    PYUDT_PROBE2(recv_entry, descriptor_, len);
+    scope.releaseGIL();
+    res = UDT::recv(descriptor_, buffer.data(), len, 0);
+    scope.acquireGIL();
+    PYUDT_PROBE2(recv_return, descriptor_, res);
+
+    if (res == UDT::ERROR)
+    {
+        if (detail::would_block()) return -1;
+
+        scope.setError();
+        translateUDTError();
+        return -1;
+    }
+
+    scope.setBytes(res);
+    return res;
+}
+
+
+int Socket::sendall(py::object py_data, double deadline) throw()
+{
+    detail::ReadBuffer data(py_data, "Socket::sendall((bytes)data, "
+                                     "(float)deadline)");
+    stats::CallScope scope(stats::send, descriptor_);
+
+    if (deadline >= 0 && detail::remaining_ms(deadline) == 0)
+    {
+        scope.setError();
+        translateTimeout();
+        return 0;
+    }
+
+    // A blocking socket without deadline blocks in UDT, up to its timeout.
+    // Otherwise the sends never block, and the call waits in an epoll until
+    // the socket is writable: changing the options of the socket instead
+    // would wait for the calls in progress on it
+    bool wait = (deadline >= 0 || !snd_blocking_);
+    detail::Readiness writable(descriptor_, UDT_EPOLL_OUT);
+    int sent = 0;
+
+    while (sent < data.size())
+    {
+        int len = data.size() - sent;
+        int res = 0;
+
+        // A blocking send only waits while the buffer is full
+        if (wait && snd_blocking_ && !detail::fails_at_once(descriptor_))
+        {
+            len = std::min(len, detail::send_space(descriptor_));
+            if (len < 0)
+            {
+                scope.setBytes(sent);
+                scope.setError();
+                translateUDTError();
+                return sent;
+            }
+        }
+
+        if (len > 0)
+        {
+            PYUDT_PROBE2(send_entry, descriptor_, len);
+            scope.releaseGIL();
+            res = UDT::send(descriptor_, data.data() + sent, len, 0);
+            scope.acquireGIL();
+            PYUDT_PROBE2(send_return, descriptor_, res);
+
+            if (res == UDT::ERROR && !(wait && detail::would_block()))
+            {
+                scope.setBytes(sent);
+                scope.setError();
+                translateUDTError();
+                return sent;
+            }
+
+            if (res > 0)
+            {
+                sent += res;
+                continue;
+            }
+        }
+
+        int timeout_ms = (deadline >= 0)? detail::remaining_ms(deadline) : -1;
+        if (timeout_ms != 0)
+        {
+            scope.releaseGIL();
+            res = writable.wait(timeout_ms);
+            scope.acquireGIL();
+        }
+        else
+        {
+            res = 0;
+        }
+
+        if (res != 1)
+        {
+            scope.setBytes(sent);
+            scope.setError();
+            if (res == 0)
+                translateTimeout();
+            else
+                translateUDTError();
+            return sent;
+        }
+    }
+
+    scope.setBytes(sent);
+    return sent;
+}
+
+
+int Socket::recv_into(py::object py_buffer, int nbytes, double deadline) throw()
+{
+    perfmon::BufferView buffer(py_buffer, std::max(nbytes, 0),
+                               "Socket::recv_into(buffer, (int)nbytes, "
+                               "(float)deadline)");
+    stats::CallScope scope(stats::recv, descriptor_);
+
+    int len = (nbytes > 0)? nbytes : (int) buffer.size();
+
+    // Without deadline, the mode of the socket applies. With one, the
+    // receive never blocks, and the call waits in an epoll until the socket
+    // is readable, without changing its options
+    bool wait = (deadline >= 0);
+    detail::Readiness readable(descriptor_, UDT_EPOLL_IN);
+    int res;
+
+    for (;;)
+    {
+        if (wait && detail::remaining_ms(deadline) == 0)
+        {
+            scope.setError();
+            translateTimeout();
+            return 0;
+        }
+
+        // A blocking receive returns as soon as data is available
+        bool ready = true;
+        if (wait && rcv_blocking_ && !detail::fails_at_once(descriptor_))
+        {
+            int available = 0;
+            if (UDT::ERROR == options::get<UDT_RCVDATA>(descriptor_, available))
+            {
+                scope.setError();
+                translateUDTError();
+                return 0;
+            }
+            ready = (available > 0);
+        }
+
+        if (ready)
+        {
+            PYUDT_PROBE2(recv_entry, descriptor_, len);
+            scope.releaseGIL();
+            res = UDT::recv(descriptor_, buffer.data(), len, 0);
+            scope.acquireGIL();
+            PYUDT_PROBE2(recv_return, descriptor_, res);
+
+            if (res != UDT::ERROR) break;
+            if (!(wait && detail::would_block()))
+            {
+                scope.setError();
+                translateUDTError();
+                return 0;
+            }
+        }
+
+        int timeout_ms = detail::remaining_ms(deadline);
+        res = 0;
+        if (timeout_ms != 0)
+        {
+            scope.releaseGIL();
+            res = readable.wait(timeout_ms);
+            scope.acquireGIL();
+        }
+
+        if (res != 1)
+        {
+            scope.setError();
+            if (res == 0)
+                translateTimeout();
+            else
+                translateUDTError();
+            return 0;
+        }
+    }
+
+    scope.setBytes(res);
+    return res;
+}
+
+
+int Socket::sendmsg(py::object py_data, int ttl_ms, bool in_order) const throw()
+{
+    detail::ReadBuffer data(py_data, "Socket::sendmsg((bytes)data, "
+                                     "(int)ttl_ms, (bool)in_order)");
+    stats::CallScope scope(stats::sendmsg, descriptor_);
+
+    // Reused by every message sent from this thread
+    static thread_local std::vector<char> scratch;
+
+    const char* buf = data.data();
+    int len = data.size();
+    int header = 0;
+
+    if (timestamping_)
+    {
+        header = sizeof(detail::MessageStamp);
+        scratch.resize(header + len);
+        memcpy(scratch.data() + header, buf, len);
+
+        detail::MessageStamp stamp = { detail::stamp_magic, 0, 0 };
+        stamp.ns = detail::wall_ns();
+        memcpy(scratch.data(), &stamp, sizeof(stamp));
+
+        buf = scratch.data();
+        len += header;
+    }
+
+    int res;
+
+    scope.releaseGIL();
+    res = UDT::sendmsg(descriptor_, buf, len, ttl_ms, in_order);
+    scope.acquireGIL();
+
+    if (res == UDT::ERROR)
+    {
+        scope.setError();
+        PYUDT_LOG_DEBUG("Could not send message through socket " << descriptor_);
+        translateUDTError();
+        return 0;
+    }
+
+    scope.setBytes(res);
+
+    PYUDT_LOG_TRACE("Sent message of " << res << " byte(s) through socket "
+                    << descriptor_);
+
+    return res - header;
+}
+
+
+py::object Socket::recvmsg(int max_len) throw()
+{
+    stats::CallScope scope(stats::recvmsg, descriptor_);
+
+    // Reused by every message received by this thread
+    static thread_local std::vector<char> scratch;
+
+    int header = timestamping_? sizeof(detail::MessageStamp) : 0;
+    scratch.resize(header + std::max(max_len, 0));
+
+    int res;
+    int64_t received_ns;
+
+    scope.releaseGIL();
+    res = UDT::recvmsg(descriptor_, scratch.data(), (int) scratch.size());
+    received_ns = detail::wall_ns();
+    scope.acquireGIL();
+
+    if (res == UDT::ERROR)
+    {
+        scope.setError();
+        PYUDT_LOG_DEBUG("Could not receive message from socket " << descriptor_);
+        translateUDTError();
+        return py::object();
+    }
+
+    scope.setBytes(res);
+
+    const char* buf = scratch.data();
+
+    if (header)
+    {
+        // Both peers must agree on timestamping. UDT already consumed an
+        // unstamped message: return it whole, counted as unstamped, and
+        // truncated to max_len like UDT truncates the messages
+        detail::MessageStamp stamp;
+        if (res >= header) memcpy(&stamp, buf, sizeof(stamp));
+
+        if (res < header || stamp.magic != detail::stamp_magic)
+        {
+            PYUDT_LOG_DEBUG("Received unstamped message from socket "
+                            << descriptor_);
+            ++unstamped_;
+            res = std::min(res, std::max(max_len, 0));
+        }
+        else
+        {
+            // Clocks may be slightly off between hosts: clamp at zero
+            latency_->record(std::max<int64_t>(received_ns - stamp.ns, 0));
+            buf += header;
+            res -= header;
+        }
+    }
+
+    PYUDT_LOG_TRACE("Received message of " << res << " byte(s) from socket "
+                    << descriptor_);
+
+    return py::object(py::handle<>(PyBytes_FromStringAndSize(buf, res)));
+}
+
+
+bool Socket::getTimestamping() const
+{
+    return timestamping_;
+}
+
+
+void Socket::setTimestamping(bool timestamping)
+{
+    if (timestamping && !latency_) latency_ = make_shared<Histogram>();
+    timestamping_ = timestamping;
+}
+
+
+py::dict Socket::latency() const
+{
+    py::dict res = latency_? latency_->toPython(1e-9)
+                           : Histogram().toPython(1e-9);
+    res["unstamped"] = unstamped_;
+    return res;
+}
+
+
+void Socket::reset_latency()
+{
+    if (latency_) latency_->clear();
+    unstamped_ = 0;
+}
+
+
 void Socket::bind(py::object py_address) throw()
 {
     char* ip = 0x0;
@@ -441,6 +1312,7 @@ void Socket::bind(const char* ip, uint16_t port) throw()
     }
 
     is_alive_ = true;
+    trace::event(trace::socket_bind, descriptor_, port);
     PYUDT_LOG_TRACE("Bound socket " << descriptor_ << " to address "
                     << ip << ":" << port);
 }
@@ -455,6 +1327,7 @@ void Socket::bind_to_udp(UDPSOCKET udp_socket) throw()
     }
 
     is_alive_ = true;
+    trace::event(trace::socket_bind, descriptor_);
     PYUDT_LOG_TRACE("Bound UDT socket " << descriptor_
                     << " to UDP socket " << udp_socket);
 }
@@ -498,14 +1371,25 @@ void Socket::connect(py::object py_address) throw()
 
 void Socket::connect(const char* ip, uint16_t port) throw()
 {
+    stats::CallScope scope(stats::connect, descriptor_);
     sockaddr_in addr = build_sockaddr_in(ip, port);
+    int res;
 
-    if (UDT::ERROR == UDT::connect(descriptor_, (sockaddr*) &addr, sizeof(addr)))
+    PYUDT_PROBE2(connect_entry, descriptor_, port);
+    scope.releaseGIL();
+    res = UDT::connect(descriptor_, (sockaddr*) &addr, sizeof(addr));
+    scope.acquireGIL();
+    PYUDT_PROBE2(connect_return, descriptor_, res);
+
+    if (res == UDT::ERROR)
     {
+        scope.setError();
         translateUDTError();
         return;
     }
 
+    counters::add(counters::connections_established);
+    trace::event(trace::socket_connect, descriptor_, port);
     is_alive_ = true;
     PYUDT_LOG_TRACE("Connect socket " << descriptor_ << " to address "
                     << ip << ":" << port);
@@ -517,25 +1401,33 @@ Socket::accept() throw()
 {
     PYUDT_LOG_TRACE("Accepting connection to socket " << descriptor_ << "...");
 
+    stats::CallScope scope(stats::accept, descriptor_);
+
     // Parameters of the incoming connection
     sockaddr_in client_addr;
     int client_addrlen;
     UDTSOCKET client_descriptor;
 
     // Retrieve an incoming connection
-    Py_BEGIN_ALLOW_THREADS;
+    PYUDT_PROBE1(accept_entry, descriptor_);
+    scope.releaseGIL();
     client_descriptor = UDT::accept(descriptor_,
                                     (sockaddr*)&client_addr,
                                     &client_addrlen);
-    Py_END_ALLOW_THREADS;
+    scope.acquireGIL();
+    PYUDT_PROBE2(accept_return, descriptor_, client_descriptor);
 
     if (client_descriptor == UDT::ERROR)
     {
+        scope.setError();
         translateUDTError();
         return boost::tuple<Socket_ptr, boost::tuple<const char*,uint16_t> >
                (Socket_ptr(), boost::tuple<const char*,uint16_t>("", 0));
     }
 
+    counters::add(counters::connections_accepted);
+    trace::event(trace::socket_accept, descriptor_, client_descriptor);
+
     Socket_ptr client = make_shared<Socket>(client_descriptor);
 
     client->descriptor_  = client_descriptor;
@@ -569,4 +1461,13 @@ Socket::accept() throw()
             (client_host, client_addr.sin_port));
 }
 
+
+Socket* extractSocket(py::object py_socket, const char* what)
+{
+    py::extract<Socket*> get_socket(py_socket);
+    if (!get_socket.check())
+        translateError(std::string("Wrong arguments: ") + what);
+    return get_socket();
+}
+
 } // namespace pyudt4
@@ -0,0 +1,237 @@
+#include "SocketOptions.hh"
+
+#include <udt/udt.h>
+#include <string>
+#include <boost/lexical_cast.hpp>
+
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace options {
+
+namespace detail {
+
+/**
+ * Tuning profiles. Buffer sizes are in bytes, FC in packets, MAXBW in bytes
+ * per second (-1 for unlimited). UDT caps the receive buffer to FC packets
+ * of MSS - 28 bytes, so FC must cover UDT_RCVBUF.
+ */
+static const Profile profiles[] = {
+    // name            MSS   FC      UDT snd/rcv buffers     UDP snd/rcv buffers     MAXBW
+    { "lan_10g",       9000, 65536,  64 << 20,  64 << 20,    32 << 20,  32 << 20,    -1 },
+    { "wan_high_bdp",  1500, 114688, 160 << 20, 160 << 20,   64 << 20,  64 << 20,    -1 },
+    { "low_latency",   1500, 2048,   1 << 20,   1 << 20,     1 << 20,   1 << 20,     -1 },
+};
+
+static const int profile_count = sizeof(profiles) / sizeof(profiles[0]);
+
+static
+const Option& lookup(int opt)
+{
+    if (opt < 0 || opt >= count)
+    {
+        translateError("Unknown UDT option "
+                       + boost::lexical_cast<std::string>(opt));
+    }
+
+    return table[opt];
+}
+
+static
+int64_t extract_checked(const Option& o, py::object py_value)
+{
+    py::extract<int64_t> get_value(py_value);
+    if (!get_value.check())
+    {
+        translateError(std::string("Option ") + o.name
+                       + " requires an integer value");
+    }
+
+    int64_t value = get_value();
+    if (value < o.min || value > o.max)
+    {
+        translateError(std::string("Option ") + o.name + " out of range ["
+                       + boost::lexical_cast<std::string>(o.min) + ", "
+                       + boost::lexical_cast<std::string>(o.max) + "]");
+    }
+
+    return value;
+}
+
+} // namespace detail
+
+
+void set_from_python(UDTSOCKET u, int opt, py::object py_value) throw()
+{
+    const Option& o = detail::lookup(opt);
+
+    if (o.read_only || o.kind == OPAQUE)
+    {
+        translateError(std::string("Option ") + o.name
+                       + " cannot be set from Python");
+    }
+
+    union
+    {
+        bool    b;
+        int     i;
+        int64_t l;
+        linger  lg;
+    } value;
+
+    switch (o.kind)
+    {
+    case BOOL:
+        value.b = py::extract<bool>(py_value);
+        break;
+
+    case INT:
+        value.i = (int) detail::extract_checked(o, py_value);
+        break;
+
+    case INT64:
+        value.l = detail::extract_checked(o, py_value);
+        break;
+
+    case LINGER:
+        try
+        {
+            py::tuple t = py::extract<py::tuple>(py_value);
+            value.lg.l_onoff  = py::extract<int>(t[0]);
+            value.lg.l_linger = (int) detail::extract_checked(o, t[1]);
+        }
+        catch (py::error_already_set&)
+        {
+            PyErr_Clear();
+            translateError("Option UDT_LINGER requires an "
+                           "(onoff, seconds) tuple");
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (UDT::ERROR == UDT::setsockopt(u, 0, o.opt, &value, o.size))
+    {
+        translateUDTError();
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Set option " << o.name << " of socket " << u);
+}
+
+
+py::object get_as_python(UDTSOCKET u, int opt) throw()
+{
+    const Option& o = detail::lookup(opt);
+
+    if (o.kind == OPAQUE)
+    {
+        translateError(std::string("Option ") + o.name
+                       + " cannot be read from Python");
+    }
+
+    union
+    {
+        bool    b;
+        int     i;
+        int64_t l;
+        linger  lg;
+    } value;
+    int len = o.size;
+
+    if (UDT::ERROR == UDT::getsockopt(u, 0, o.opt, &value, &len))
+    {
+        translateUDTError();
+        return py::object();
+    }
+
+    switch (o.kind)
+    {
+    case BOOL:
+        return py::object(value.b);
+
+    case INT:
+        return py::object(value.i);
+
+    case INT64:
+        return py::object(value.l);
+
+    case LINGER:
+        return py::make_tuple(value.lg.l_onoff, value.lg.l_linger);
+
+    default:
+        return py::object();
+    }
+}
+
+
+void apply_profile(UDTSOCKET u, const std::string& name) throw()
+{
+    const Profile* p = nullptr;
+    for (int i = 0; i < detail::profile_count; ++i)
+    {
+        if (name == detail::profiles[i].name) p = &detail::profiles[i];
+    }
+
+    if (p == nullptr)
+    {
+        translateError("Unknown socket profile: " + name);
+    }
+
+    if (UDT::getsockstate(u) != INIT)
+    {
+        translateError("Socket profiles must be applied before the "
+                       "socket is bound or connected");
+    }
+
+    // FC first: UDT caps the receive buffer to the flight flag size
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS;
+    ok = UDT::ERROR != set<UDT_MSS>(u, p->mss)
+      && UDT::ERROR != set<UDT_FC>(u, p->fc)
+      && UDT::ERROR != set<UDT_SNDBUF>(u, p->udt_sndbuf)
+      && UDT::ERROR != set<UDT_RCVBUF>(u, p->udt_rcvbuf)
+      && UDT::ERROR != set<UDP_SNDBUF>(u, p->udp_sndbuf)
+      && UDT::ERROR != set<UDP_RCVBUF>(u, p->udp_rcvbuf)
+      && UDT::ERROR != set<UDT_MAXBW>(u, p->maxbw);
+    Py_END_ALLOW_THREADS;
+
+    if (!ok)
+    {
+        translateUDTError();
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Applied profile " << name << " to socket " << u);
+}
+
+
+py::dict profiles()
+{
+    py::dict res;
+    for (int i = 0; i < detail::profile_count; ++i)
+    {
+        const Profile& p = detail::profiles[i];
+
+        py::dict values;
+        values["UDT_MSS"]    = p.mss;
+        values["UDT_FC"]     = p.fc;
+        values["UDT_SNDBUF"] = p.udt_sndbuf;
+        values["UDT_RCVBUF"] = p.udt_rcvbuf;
+        values["UDP_SNDBUF"] = p.udp_sndbuf;
+        values["UDP_RCVBUF"] = p.udp_rcvbuf;
+        values["UDT_MAXBW"]  = p.maxbw;
+        res[p.name] = values;
+    }
+    return res;
+}
+
+} // namespace options
+
+} // namespace pyudt4
@@ -2,8 +2,26 @@ set(currentFolder "package/udt4_ext/src")
 
 set(PYUDT_SOURCE
 ${PYUDT_SOURCE}
+${currentFolder}/CongestionControl.cpp
+${currentFolder}/Counters.cpp
+${currentFolder}/Debug.cpp
 ${currentFolder}/Epoll.cpp
 ${currentFolder}/Exception.cpp
+${currentFolder}/Histogram.cpp
+${currentFolder}/ImpairmentProxy.cpp
+${currentFolder}/MetricsExporter.cpp
+${currentFolder}/Multiplexer.cpp
+${currentFolder}/PeriodicTask.cpp
+${currentFolder}/Perfmon.cpp
 ${currentFolder}/PyUDT.cpp
+${currentFolder}/Rendezvous.cpp
+${currentFolder}/Sampler.cpp
+${currentFolder}/Scheduler.cpp
+${currentFolder}/Shaper.cpp
 ${currentFolder}/Socket.cpp
+${currentFolder}/SocketOptions.cpp
+${currentFolder}/Stats.cpp
+${currentFolder}/Trace.cpp
+${currentFolder}/Tuner.cpp
+${currentFolder}/UDPSocket.cpp
 )
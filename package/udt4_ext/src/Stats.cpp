@@ -0,0 +1,359 @@
+#include "Stats.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace stats {
+
+#define PYUDT_CALL_SITE_NAME(name) #name,
+
+const char* const site_names[site_count] = {
+    PYUDT_CALL_SITES(PYUDT_CALL_SITE_NAME)
+};
+
+#undef PYUDT_CALL_SITE_NAME
+
+namespace detail {
+
+/**
+ * Statistics of a call site, written by a single thread.
+ */
+struct ShardSite
+{
+    ShardSite()
+    : calls(0),
+      errors(0),
+      bytes(0),
+      gil_slow(0)
+    {
+    }
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytes;
+    ShardHistogram        inside_ns;
+    ShardHistogram        outside_ns;
+    ShardHistogram        gil_ns;
+    std::atomic<uint64_t> gil_slow;
+};
+
+/**
+ * Statistics of one thread.
+ */
+struct Shard
+{
+    ShardSite sites[site_count];
+};
+
+/**
+ * Every live shard, plus what the threads that exited recorded.
+ */
+struct Registry
+{
+    std::mutex       mutex;
+    std::set<Shard*> live;
+    Snapshot         retired;
+    Snapshot         baseline;
+};
+
+/**
+ * GIL tracking settings.
+ */
+static std::atomic<bool>    gil_enabled(false);
+static std::atomic<int64_t> gil_threshold_ns(1000000);
+
+static
+Registry& registry()
+{
+    // Never destroyed: threads may exit after the static destructors ran
+    static Registry* r = new Registry();
+    return *r;
+}
+
+static
+void increment(std::atomic<uint64_t>& c, uint64_t n)
+{
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static
+void merge(const Shard& shard, Snapshot& out)
+{
+    for (int i = 0; i < site_count; ++i)
+    {
+        const ShardSite& src = shard.sites[i];
+        SiteStats& dst = out.sites[i];
+
+        dst.calls  += src.calls.load(std::memory_order_relaxed);
+        dst.errors += src.errors.load(std::memory_order_relaxed);
+        dst.bytes  += src.bytes.load(std::memory_order_relaxed);
+        src.inside_ns.mergeInto(dst.inside_ns);
+        src.outside_ns.mergeInto(dst.outside_ns);
+        src.gil_ns.mergeInto(dst.gil_ns);
+        dst.gil_slow += src.gil_slow.load(std::memory_order_relaxed);
+    }
+}
+
+static
+void merge(const Snapshot& src, Snapshot& out)
+{
+    for (int i = 0; i < site_count; ++i)
+    {
+        out.sites[i].calls  += src.sites[i].calls;
+        out.sites[i].errors += src.sites[i].errors;
+        out.sites[i].bytes  += src.sites[i].bytes;
+        out.sites[i].inside_ns.merge(src.sites[i].inside_ns);
+        out.sites[i].outside_ns.merge(src.sites[i].outside_ns);
+        out.sites[i].gil_ns.merge(src.sites[i].gil_ns);
+        out.sites[i].gil_slow += src.sites[i].gil_slow;
+    }
+}
+
+static
+void clear(Snapshot& s)
+{
+    for (int i = 0; i < site_count; ++i)
+    {
+        s.sites[i].calls  = 0;
+        s.sites[i].errors = 0;
+        s.sites[i].bytes  = 0;
+        s.sites[i].inside_ns.clear();
+        s.sites[i].outside_ns.clear();
+        s.sites[i].gil_ns.clear();
+        s.sites[i].gil_slow = 0;
+    }
+}
+
+/**
+ * Aggregate of every shard since the process started. Requires the registry
+ * lock.
+ */
+static
+void aggregate(Registry& r, Snapshot& out)
+{
+    clear(out);
+    merge(r.retired, out);
+    for (std::set<Shard*>::const_iterator iter = r.live.begin();
+         iter != r.live.end();
+         ++iter)
+    {
+        merge(**iter, out);
+    }
+}
+
+/**
+ * Owner of the shard of a thread, folded into the registry on thread exit.
+ */
+struct ShardHolder
+{
+    ShardHolder()
+    : shard(new Shard())
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.insert(shard);
+    }
+
+    ~ShardHolder()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        merge(*shard, r.retired);
+        r.live.erase(shard);
+        delete shard;
+    }
+
+    Shard* shard;
+};
+
+static
+Shard& local_shard()
+{
+    static thread_local ShardHolder holder;
+    return *holder.shard;
+}
+
+} // namespace detail
+
+
+void record(Site site, int64_t inside_ns, int64_t outside_ns,
+            int64_t bytes, bool error, int64_t gil_ns)
+{
+    detail::ShardSite& s = detail::local_shard().sites[site];
+
+    detail::increment(s.calls, 1);
+    if (error) detail::increment(s.errors, 1);
+    if (bytes > 0) detail::increment(s.bytes, bytes);
+    s.inside_ns.record(inside_ns > 0? inside_ns : 0);
+    s.outside_ns.record(outside_ns > 0? outside_ns : 0);
+
+    if (gil_ns >= 0)
+    {
+        s.gil_ns.record(gil_ns);
+        if (gil_ns > detail::gil_threshold_ns.load(std::memory_order_relaxed))
+            detail::increment(s.gil_slow, 1);
+    }
+}
+
+
+void set_gil_tracking(bool enabled, int64_t threshold_us)
+{
+    detail::gil_threshold_ns = threshold_us * 1000;
+    detail::gil_enabled = enabled;
+}
+
+
+bool gil_tracking()
+{
+    return detail::gil_enabled.load(std::memory_order_relaxed);
+}
+
+
+void snapshot(Snapshot& out)
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    detail::aggregate(r, out);
+    for (int i = 0; i < site_count; ++i)
+    {
+        SiteStats& s = out.sites[i];
+        const SiteStats& b = r.baseline.sites[i];
+
+        s.calls  -= std::min(s.calls, b.calls);
+        s.errors -= std::min(s.errors, b.errors);
+        s.bytes  -= std::min(s.bytes, b.bytes);
+        s.inside_ns.subtract(b.inside_ns);
+        s.outside_ns.subtract(b.outside_ns);
+        s.gil_ns.subtract(b.gil_ns);
+        s.gil_slow -= std::min(s.gil_slow, b.gil_slow);
+    }
+}
+
+
+void reset()
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    detail::aggregate(r, r.baseline);
+}
+
+
+py::dict to_python()
+{
+    std::unique_ptr<Snapshot> s(new Snapshot());
+
+    Py_BEGIN_ALLOW_THREADS;
+    snapshot(*s);
+    Py_END_ALLOW_THREADS;
+
+    py::dict res;
+    for (int i = 0; i < site_count; ++i)
+    {
+        const SiteStats& site = s->sites[i];
+
+        py::dict d;
+        d["calls"]    = site.calls;
+        d["errors"]   = site.errors;
+        d["bytes"]    = site.bytes;
+        d["inside"]   = site.inside_ns.toPython(1e-9);
+        d["outside"]  = site.outside_ns.toPython(1e-9);
+        d["gil"]      = site.gil_ns.toPython(1e-9);
+        d["gil_slow"] = site.gil_slow;
+        res[site_names[i]] = d;
+    }
+    return res;
+}
+
+
+CallScope::CallScope(Site site, int64_t socket)
+: site_(site),
+  socket_(socket),
+  state_(nullptr),
+  start_(now_ns()),
+  released_(0),
+  inside_(0),
+  gil_(-1),
+  bytes_(0),
+  result_(0),
+  error_(false)
+{
+    trace::event(trace::call_begin, socket_, 0, site_);
+}
+
+
+CallScope::~CallScope()
+{
+    if (state_) acquireGIL();
+
+    int64_t total = now_ns() - start_;
+
+    record(site_, inside_, total - inside_, bytes_, error_, gil_);
+
+    trace::event(trace::call_end, socket_, error_? -1 : result_, site_);
+}
+
+
+void CallScope::releaseGIL()
+{
+    trace::event(trace::gil_release, socket_, 0, site_);
+
+    released_ = now_ns();
+    state_ = PyEval_SaveThread();
+}
+
+
+void CallScope::acquireGIL()
+{
+    int64_t returned = now_ns();
+    inside_ += returned - released_;
+
+    PyEval_RestoreThread(state_);
+    state_ = nullptr;
+
+    int64_t reacquired = -1;
+    if (gil_tracking())
+    {
+        reacquired = now_ns();
+        gil_ = std::max<int64_t>(gil_, 0) + (reacquired - returned);
+    }
+
+    if (trace::enabled())
+    {
+        if (reacquired < 0) reacquired = now_ns();
+        trace::emit(trace::gil_acquire, socket_, reacquired - returned,
+                    site_);
+    }
+}
+
+
+void CallScope::setBytes(int64_t bytes)
+{
+    bytes_ = bytes;
+    result_ = bytes;
+}
+
+
+void CallScope::setResult(int64_t result)
+{
+    result_ = result;
+}
+
+
+void CallScope::setError()
+{
+    error_ = true;
+}
+
+} // namespace stats
+
+} // namespace pyudt4
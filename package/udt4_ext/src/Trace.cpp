@@ -0,0 +1,386 @@
+#include "Trace.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/syscall.h> // SYS_gettid
+#include <time.h>
+#include <unistd.h>
+
+#include "Stats.hh"
+#include "Exception.hh"
+
+namespace pyudt4 {
+
+namespace trace {
+
+#define PYUDT_TRACE_EVENT_NAME(name) #name,
+
+const char* const type_names[type_count] = {
+    PYUDT_TRACE_EVENTS(PYUDT_TRACE_EVENT_NAME)
+};
+
+#undef PYUDT_TRACE_EVENT_NAME
+
+std::atomic<bool> active(false);
+
+static_assert(sizeof(Event) == 32, "unexpected trace event layout");
+
+namespace detail {
+
+/**
+ * Dump file layout (little endian):
+ *
+ *   FileHeader
+ *   char[32] name of every event type, then of every call site
+ *   for every thread: ThreadHeader, then its events, oldest first
+ */
+struct FileHeader
+{
+    char     magic[8];       // "PYUDTTRC"
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t type_count;
+    uint32_t site_count;
+    uint32_t thread_count;
+    uint32_t pid;
+    int64_t  clock_offset_ns; // CLOCK_REALTIME - CLOCK_MONOTONIC
+    uint8_t  reserved[24];
+};
+
+struct ThreadHeader
+{
+    uint32_t tid;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t lost;            // events overwritten before the dump
+};
+
+static_assert(sizeof(FileHeader) == 64, "unexpected trace header layout");
+static_assert(sizeof(ThreadHeader) == 24, "unexpected thread header layout");
+
+static const uint32_t file_version = 1;
+static const size_t   name_size = 32;
+
+/**
+ * Ring of events written by a single thread.
+ */
+struct Ring
+{
+    Ring(size_t capacity, uint64_t generation)
+    : tid((uint32_t) syscall(SYS_gettid)),
+      generation(generation),
+      head(0),
+      exited(false),
+      events(capacity)
+    {
+    }
+
+    const uint32_t tid;
+    const uint64_t generation;
+
+    /**
+     * Number of events ever written. The event of index i is stored in
+     * events[i % capacity].
+     */
+    std::atomic<uint64_t> head;
+
+    /**
+     * Whether the thread exited: the ring is freed once dumped.
+     */
+    std::atomic<bool> exited;
+
+    std::vector<Event> events;
+};
+
+typedef std::shared_ptr<Ring> Ring_ptr;
+
+/**
+ * Rings of the current trace, including the ones of exited threads that
+ * were not dumped yet.
+ */
+struct Registry
+{
+    Registry()
+    : generation(0),
+      capacity(65536)
+    {
+    }
+
+    std::mutex            mutex;
+    std::vector<Ring_ptr> rings;
+
+    /**
+     * Incremented by clear(): threads then allocate a new ring.
+     */
+    std::atomic<uint64_t> generation;
+    size_t                capacity;
+};
+
+static
+Registry& registry()
+{
+    // Never destroyed: threads may trace after the static destructors ran
+    static Registry* r = new Registry();
+    return *r;
+}
+
+static
+size_t round_capacity(size_t capacity)
+{
+    size_t res = 1;
+    while (res < capacity) res <<= 1;
+    return res;
+}
+
+/**
+ * Forget a ring, unless it was already cleared. Called with the registry
+ * mutex held.
+ */
+static
+void unregister(Registry& r, const Ring_ptr& ring)
+{
+    std::vector<Ring_ptr>::iterator iter =
+        std::find(r.rings.begin(), r.rings.end(), ring);
+    if (iter != r.rings.end()) r.rings.erase(iter);
+}
+
+/**
+ * Ring of the current thread, marked as exited with the thread.
+ */
+struct LocalRing
+{
+    ~LocalRing()
+    {
+        if (!ring) return;
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        ring->exited.store(true, std::memory_order_release);
+
+        // Nothing to drain: free it right away
+        if (ring->head.load(std::memory_order_relaxed) == 0)
+            unregister(r, ring);
+    }
+
+    Ring_ptr ring;
+};
+
+static
+Ring& local_ring()
+{
+    static thread_local LocalRing local;
+    Ring_ptr& ring = local.ring;
+
+    Registry& r = registry();
+    if (!ring || ring->generation != r.generation.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        ring = std::make_shared<Ring>(r.capacity, r.generation.load());
+        r.rings.push_back(ring);
+    }
+    return *ring;
+}
+
+/**
+ * Copy the events of a ring, oldest first.
+ *
+ * The writer is never blocked: events are copied while it may overwrite
+ * them, then the ones it could have overwritten during the copy are dropped.
+ */
+static
+void copy_events(const Ring& ring, std::vector<Event>& out, uint64_t& lost)
+{
+    const uint64_t capacity = ring.events.size();
+
+    uint64_t before = ring.head.load(std::memory_order_acquire);
+    uint64_t first = (before > capacity)? before - capacity : 0;
+
+    std::vector<Event> copy(before - first);
+    for (uint64_t i = first; i < before; ++i)
+        copy[i - first] = ring.events[i % capacity];
+
+    // Slots of index "after" and above may have been reused during the copy
+    uint64_t after = ring.head.load(std::memory_order_acquire);
+    uint64_t valid = (after + 1 > capacity)? after + 1 - capacity : 0;
+    if (valid < first) valid = first;
+    if (valid > before) valid = before;
+
+    out.assign(copy.begin() + (valid - first), copy.end());
+    lost = valid;
+}
+
+static
+int64_t clock_offset_ns()
+{
+    timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    return (int64_t(real.tv_sec) - mono.tv_sec) * 1000000000
+         + (real.tv_nsec - mono.tv_nsec);
+}
+
+static
+bool write_name(FILE* file, const char* name)
+{
+    char buffer[name_size];
+    memset(buffer, 0, sizeof(buffer));
+    strncpy(buffer, name, sizeof(buffer) - 1);
+    return fwrite(buffer, sizeof(buffer), 1, file) == 1;
+}
+
+/**
+ * Write a dump file, without the GIL.
+ * @return false on failure, with errno set.
+ */
+static
+bool write_dump(const std::string& path, uint64_t& written)
+{
+    std::vector<Ring_ptr> rings;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        rings = r.rings;
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "PYUDTTRC", sizeof(header.magic));
+    header.version         = file_version;
+    header.event_size      = sizeof(Event);
+    header.type_count      = type_count;
+    header.site_count      = stats::site_count;
+    header.thread_count    = (uint32_t) rings.size();
+    header.pid             = (uint32_t) getpid();
+    header.clock_offset_ns = clock_offset_ns();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (int i = 0; ok && i < type_count; ++i)
+        ok = write_name(file, type_names[i]);
+    for (int i = 0; ok && i < stats::site_count; ++i)
+        ok = write_name(file, stats::site_names[i]);
+
+    // Rings of exited threads are complete once copied
+    std::vector<Ring_ptr> drained;
+
+    std::vector<Event> events;
+    for (size_t i = 0; ok && i < rings.size(); ++i)
+    {
+        if (rings[i]->exited.load(std::memory_order_acquire))
+            drained.push_back(rings[i]);
+
+        ThreadHeader thread;
+        memset(&thread, 0, sizeof(thread));
+        copy_events(*rings[i], events, thread.lost);
+        thread.tid   = rings[i]->tid;
+        thread.count = events.size();
+
+        ok = fwrite(&thread, sizeof(thread), 1, file) == 1
+          && (events.empty()
+              || fwrite(events.data(), sizeof(Event), events.size(), file)
+                 == events.size());
+        written += events.size();
+    }
+
+    int error = errno;
+    if (fclose(file) != 0 && ok)
+    {
+        ok = false;
+        error = errno;
+    }
+
+    if (ok && !drained.empty())
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t i = 0; i < drained.size(); ++i)
+            unregister(r, drained[i]);
+    }
+
+    errno = error;
+    return ok;
+}
+
+} // namespace detail
+
+
+void emit(Type type, int64_t socket, int64_t value, int site)
+{
+    detail::Ring& ring = detail::local_ring();
+
+    uint64_t index = ring.head.load(std::memory_order_relaxed);
+    Event& e = ring.events[index & (ring.events.size() - 1)];
+
+    e.time_ns  = stats::now_ns();
+    e.socket   = socket;
+    e.value    = value;
+    e.type     = (uint16_t) type;
+    e.site     = (uint16_t) site;
+    e.reserved = 0;
+
+    ring.head.store(index + 1, std::memory_order_release);
+}
+
+
+void start(size_t capacity)
+{
+    detail::Registry& r = detail::registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.capacity = detail::round_capacity(capacity > 0? capacity : 1);
+    }
+    clear();
+    active = true;
+}
+
+
+void stop()
+{
+    active = false;
+}
+
+
+void clear()
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    r.rings.clear();
+    ++r.generation;
+}
+
+
+uint64_t dump(const std::string& path)
+{
+    uint64_t written = 0;
+    bool ok;
+
+    Py_BEGIN_ALLOW_THREADS;
+    ok = detail::write_dump(path, written);
+    Py_END_ALLOW_THREADS;
+
+    if (!ok)
+        translateSystemError("Could not write trace file " + path);
+
+    return written;
+}
+
+
+void set_tracing(bool enabled, size_t capacity)
+{
+    if (enabled) start(capacity);
+    else stop();
+}
+
+} // namespace trace
+
+} // namespace pyudt4
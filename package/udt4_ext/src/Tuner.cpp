@@ -0,0 +1,328 @@
+#include "Tuner.hh"
+
+#include <udt/udt.h>
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+#include <arpa/inet.h> // inet_ntop
+
+#include "Epoll.hh"
+#include "SocketOptions.hh"
+#include "Exception.hh"
+#include "Debug.hh"
+
+namespace py = boost::python;
+
+namespace pyudt4 {
+
+namespace detail {
+
+/**
+ * Smallest buffer the tuner will size a socket with, in bytes.
+ */
+static const int min_buffer = 1 << 20;
+
+/**
+ * Weight of a new sample in the per-peer estimates.
+ */
+static const double link_alpha = 0.2;
+
+static
+std::string peer_ip(UDTSOCKET u)
+{
+    sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    char ip[INET_ADDRSTRLEN] = { '\0' };
+
+    if (UDT::ERROR == UDT::getpeername(u, (sockaddr*) &addr, &addrlen))
+    {
+        UDT::getlasterror().clear();
+        return std::string();
+    }
+
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return ip;
+}
+
+} // namespace detail
+
+
+Tuner::Tuner(int interval_ms, int max_buffer, int64_t max_memory,
+             double maxbw_headroom)
+: PeriodicTask(interval_ms),
+  max_buffer_(max_buffer),
+  max_memory_(max_memory),
+  maxbw_headroom_(maxbw_headroom),
+  memory_(0)
+{
+}
+
+
+Tuner::~Tuner()
+{
+    stop();
+}
+
+
+void Tuner::add_descriptor(UDTSOCKET u)
+{
+    if (entries_.count(u)) return;
+
+    Entry entry = Entry();
+    entry.maxbw = -1;
+    entries_[u] = entry;
+}
+
+
+void Tuner::add(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket, "Tuner::add((Socket)s)");
+
+    std::unique_lock<std::mutex> lock(acquire());
+    add_descriptor(socket->getDescriptor());
+}
+
+
+void Tuner::add_epoll(const Epoll& epoll)
+{
+    std::unique_lock<std::mutex> lock(acquire());
+
+    const std::map<UDTSOCKET, Socket*>& sockets = epoll.getSockets();
+    for (std::map<UDTSOCKET, Socket*>::const_iterator iter = sockets.begin();
+         iter != sockets.end();
+         ++iter)
+    {
+        add_descriptor(iter->first);
+    }
+}
+
+
+void Tuner::remove(py::object py_socket) throw()
+{
+    Socket* socket = extractSocket(py_socket, "Tuner::remove((Socket)s)");
+
+    std::unique_lock<std::mutex> lock(acquire());
+
+    std::map<UDTSOCKET, Entry>::iterator iter =
+        entries_.find(socket->getDescriptor());
+    if (iter == entries_.end()) return;
+
+    memory_ -= 2 * int64_t(iter->second.buffer);
+    entries_.erase(iter);
+}
+
+
+int Tuner::target_buffer(double bdp) const
+{
+    // Twice the BDP leaves room for retransmissions after a loss
+    double buffer = 2. * bdp;
+    return (int) std::max<double>(detail::min_buffer,
+                                  std::min<double>(buffer, max_buffer_));
+}
+
+
+int Tuner::prepare(py::object py_socket, std::string ip) throw()
+{
+    Socket* socket = extractSocket(py_socket,
+                                   "Tuner::prepare((Socket)s, (str)ip)");
+    UDTSOCKET u = socket->getDescriptor();
+
+    if (UDT::getsockstate(u) != INIT)
+    {
+        translateError("Tuner::prepare must be called before the socket is "
+                       "bound or connected");
+    }
+
+    int mss = 0, sndbuf = 0, rcvbuf = 0;
+    if (UDT::ERROR == options::get<UDT_MSS>(u, mss)
+     || UDT::ERROR == options::get<UDT_SNDBUF>(u, sndbuf)
+     || UDT::ERROR == options::get<UDT_RCVBUF>(u, rcvbuf))
+    {
+        translateUDTError();
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(acquire());
+
+    // Nothing learned on this link yet: keep UDT's default size, but count
+    // it against the budget like the others
+    std::map<std::string, Link>::const_iterator link = links_.find(ip);
+    double bdp = (link != links_.end())? link->second.bdp : 0.;
+    int buffer = (link != links_.end())? target_buffer(bdp)
+                                       : std::max(sndbuf, rcvbuf);
+
+    // Stay within the memory budget (send and receive buffers)
+    std::map<UDTSOCKET, Entry>::const_iterator known = entries_.find(u);
+    int64_t used = memory_;
+    if (known != entries_.end()) used -= 2 * int64_t(known->second.buffer);
+    int64_t available = (max_memory_ - used) / 2;
+    if (available < detail::min_buffer)
+        translateError("Tuner::prepare: the memory budget is exhausted");
+    buffer = (int) std::min<int64_t>(buffer, available);
+    int fc = std::max(32, buffer / std::max(1, mss - 28));
+
+    // FC first: UDT caps the receive buffer to the flight flag size
+    if (UDT::ERROR == options::set<UDT_FC>(u, fc)
+     || UDT::ERROR == options::set<UDT_SNDBUF>(u, buffer)
+     || UDT::ERROR == options::set<UDT_RCVBUF>(u, buffer))
+    {
+        translateUDTError();
+        return 0;
+    }
+
+    add_descriptor(u);
+    Entry& entry = entries_[u];
+    memory_ = used + 2 * int64_t(buffer);
+    entry.peer = ip;
+    entry.buffer = buffer;
+    entry.bdp = bdp;
+
+    PYUDT_LOG_TRACE("Tuner sized socket " << u << " for peer " << ip
+                    << ": buffers " << buffer << " bytes, FC " << fc);
+
+    return buffer;
+}
+
+
+void Tuner::tick()
+{
+    UDT::TRACEINFO perf;
+
+    std::map<UDTSOCKET, Entry>::iterator iter = entries_.begin();
+    while (iter != entries_.end())
+    {
+        UDTSOCKET u = iter->first;
+        Entry& entry = iter->second;
+
+        UDTSTATUS status = UDT::getsockstate(u);
+        if (status == BROKEN || status == CLOSED || status == NONEXIST)
+        {
+            memory_ -= 2 * int64_t(entry.buffer);
+            entries_.erase(iter++);
+            continue;
+        }
+
+        if (status != CONNECTED || UDT::ERROR == UDT::perfmon(u, &perf, false))
+        {
+            UDT::getlasterror().clear();
+            ++iter;
+            continue;
+        }
+
+        if (entry.peer.empty()) entry.peer = detail::peer_ip(u);
+
+        entry.ms_rtt         = perf.msRTT;
+        entry.mbps_bandwidth = perf.mbpsBandwidth;
+        entry.flight_size    = perf.pktFlightSize;
+        entry.avail_snd_buf  = perf.byteAvailSndBuf;
+
+        if (perf.msRTT > 0. && perf.mbpsBandwidth > 0.)
+        {
+            double bytes_per_sec = perf.mbpsBandwidth * 1e6 / 8.;
+            entry.bdp = bytes_per_sec * perf.msRTT / 1e3;
+
+            // Learn the link for the next connections to this peer
+            std::map<std::string, Link>::iterator link = links_.find(entry.peer);
+            if (link == links_.end())
+            {
+                Link l = { perf.msRTT, perf.mbpsBandwidth, entry.bdp };
+                links_[entry.peer] = l;
+            }
+            else
+            {
+                double a = detail::link_alpha;
+                link->second.ms_rtt = (1-a) * link->second.ms_rtt + a * perf.msRTT;
+                link->second.mbps_bandwidth = (1-a) * link->second.mbps_bandwidth
+                                            + a * perf.mbpsBandwidth;
+                link->second.bdp = (1-a) * link->second.bdp + a * entry.bdp;
+            }
+
+            // Live connections can only be adjusted through UDT_MAXBW,
+            // applied after the tick: skip the changes below 1%
+            if (maxbw_headroom_ > 0.)
+            {
+                int64_t maxbw = (int64_t) (bytes_per_sec * maxbw_headroom_);
+                if (entry.maxbw <= 0
+                 || std::abs(maxbw - entry.maxbw) * 100 >= entry.maxbw)
+                {
+                    pending_.push_back(std::make_pair(u, maxbw));
+                }
+            }
+        }
+
+        ++iter;
+    }
+}
+
+
+void Tuner::after_tick()
+{
+    if (pending_.empty()) return;
+
+    std::vector<bool> applied(pending_.size(), false);
+    for (size_t i = 0; i < pending_.size(); ++i)
+    {
+        if (UDT::ERROR == options::set<UDT_MAXBW>(pending_[i].first,
+                                                  pending_[i].second))
+            UDT::getlasterror().clear();
+        else
+            applied[i] = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < pending_.size(); ++i)
+    {
+        std::map<UDTSOCKET, Entry>::iterator iter =
+            entries_.find(pending_[i].first);
+        if (applied[i] && iter != entries_.end())
+            iter->second.maxbw = pending_[i].second;
+    }
+    pending_.clear();
+}
+
+
+py::dict Tuner::stats()
+{
+    std::unique_lock<std::mutex> lock(acquire());
+
+    py::dict sockets;
+    for (std::map<UDTSOCKET, Entry>::const_iterator iter = entries_.begin();
+         iter != entries_.end();
+         ++iter)
+    {
+        const Entry& e = iter->second;
+
+        py::dict d;
+        d["peer"]            = e.peer;
+        d["ms_rtt"]          = e.ms_rtt;
+        d["mbps_bandwidth"]  = e.mbps_bandwidth;
+        d["pkt_flight_size"] = e.flight_size;
+        d["byte_avail_snd_buf"] = e.avail_snd_buf;
+        d["bdp"]             = e.bdp;
+        d["target_buffer"]   = target_buffer(e.bdp);
+        d["buffer"]          = e.buffer;
+        d["maxbw"]           = e.maxbw;
+        sockets[iter->first] = d;
+    }
+
+    py::dict links;
+    for (std::map<std::string, Link>::const_iterator iter = links_.begin();
+         iter != links_.end();
+         ++iter)
+    {
+        py::dict d;
+        d["ms_rtt"]         = iter->second.ms_rtt;
+        d["mbps_bandwidth"] = iter->second.mbps_bandwidth;
+        d["bdp"]            = iter->second.bdp;
+        d["target_buffer"]  = target_buffer(iter->second.bdp);
+        links[iter->first] = d;
+    }
+
+    py::dict res;
+    res["sockets"] = sockets;
+    res["links"]   = links;
+    res["memory"]  = memory_;
+    return res;
+}
+
+} // namespace pyudt4
@@ -0,0 +1,145 @@
+#include "UDPSocket.hh"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h> // inet_pton
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "Exception.hh"
+#include "Debug.hh"
+
+#ifndef SO_REUSEPORT
+#   define SO_REUSEPORT 15
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#   define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+namespace pyudt4 {
+
+namespace udp {
+
+SYSSOCKET open(const char* ip, uint16_t port, int sndbuf, int rcvbuf,
+               bool reuseport)
+{
+    SYSSOCKET sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        translateSystemError("Could not create UDP socket");
+        return -1;
+    }
+
+    int one = 1;
+    if (reuseport
+     && ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+    {
+        ::close(sock);
+        translateSystemError("Could not set SO_REUSEPORT");
+        return -1;
+    }
+
+    if (set_kernel_buffer(sock, SO_SNDBUF, sndbuf) != 0
+     || set_kernel_buffer(sock, SO_RCVBUF, rcvbuf) != 0)
+    {
+        PYUDT_LOG_ERROR("Could not set kernel buffers of UDP socket " << sock);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (ip != nullptr) inet_pton(AF_INET, ip, &addr.sin_addr);
+    else addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (::bind(sock, (sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        int err = errno;
+        ::close(sock);
+        errno = err;
+        translateSystemError("Could not bind UDP socket");
+        return -1;
+    }
+
+    PYUDT_LOG_TRACE("Created UDP socket " << sock << " on port "
+                    << get_port(sock));
+
+    return sock;
+}
+
+
+uint16_t get_port(SYSSOCKET sock)
+{
+    sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+
+    if (::getsockname(sock, (sockaddr*) &addr, &addrlen) != 0)
+        return 0;
+
+    return ntohs(addr.sin_port);
+}
+
+
+int set_kernel_buffer(SYSSOCKET sock, int opt, int size)
+{
+    // The *FORCE variants require CAP_NET_ADMIN
+    int force_opt = (opt == SO_SNDBUF)? SO_SNDBUFFORCE : SO_RCVBUFFORCE;
+
+    if (::setsockopt(sock, SOL_SOCKET, force_opt, &size, sizeof(size)) == 0)
+        return 0;
+
+    return ::setsockopt(sock, SOL_SOCKET, opt, &size, sizeof(size));
+}
+
+
+int get_kernel_buffer(SYSSOCKET sock, int opt)
+{
+    int size = 0;
+    socklen_t len = sizeof(size);
+
+    if (::getsockopt(sock, SOL_SOCKET, opt, &size, &len) != 0)
+        return -1;
+
+    return size;
+}
+
+
+void attach_reuseport_bpf(SYSSOCKET sock, unsigned int group_size)
+{
+    if (group_size == 0)
+    {
+        translateError("Wrong arguments: attach_reuseport_bpf: empty group");
+    }
+
+    // The socket buffer starts at the UDP payload, so the peer address is
+    // read relative to the network header (assuming no IPv4 options):
+    //   index = (saddr ^ sport) % group_size
+    sock_filter code[] = {
+        { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (uint32_t) (SKF_NET_OFF + 12) },
+        { BPF_MISC | BPF_TAX,          0, 0, 0 },
+        { BPF_LD  | BPF_H   | BPF_ABS, 0, 0, (uint32_t) (SKF_NET_OFF + 20) },
+        { BPF_ALU | BPF_XOR | BPF_X,   0, 0, 0 },
+        { BPF_ALU | BPF_MOD | BPF_K,   0, 0, group_size },
+        { BPF_RET | BPF_A,             0, 0, 0 },
+    };
+
+    sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (::setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                     &prog, sizeof(prog)) != 0)
+    {
+        translateSystemError("Could not attach SO_REUSEPORT BPF program");
+        return;
+    }
+
+    PYUDT_LOG_TRACE("Attached SO_REUSEPORT BPF program to UDP socket " << sock
+                    << " (group of " << group_size << ")");
+}
+
+} // namespace udp
+
+} // namespace pyudt4
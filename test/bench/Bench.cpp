@@ -0,0 +1,266 @@
+#include "Bench.hh"
+#include "Histogram.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <sys/resource.h>
+#include <time.h>
+
+namespace pyudt4 {
+
+namespace bench {
+
+namespace detail {
+
+static
+int64_t parse_int(const std::string& s)
+{
+    char* end = nullptr;
+    int64_t value = strtoll(s.c_str(), &end, 10);
+
+    switch (*end)
+    {
+    case 'k': case 'K': return value << 10;
+    case 'm': case 'M': return value << 20;
+    case 'g': case 'G': return value << 30;
+    default:            return value;
+    }
+}
+
+static
+std::string quote(const std::string& s)
+{
+    std::string res = "\"";
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '"' || s[i] == '\\') res += '\\';
+        res += s[i];
+    }
+    return res + "\"";
+}
+
+static
+void print_fields(const std::vector<std::pair<std::string, std::string> >& f)
+{
+    printf("{");
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        printf("%s%s: %s", i? ", " : "", quote(f[i].first).c_str(),
+               f[i].second.c_str());
+    }
+    printf("}");
+}
+
+} // namespace detail
+
+
+Args::Args(int argc, char** argv)
+{
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--", 2) != 0) continue;
+
+        std::string name = argv[i] + 2;
+        if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+            values_[name] = argv[++i];
+        else
+            values_[name] = "";
+    }
+}
+
+
+bool Args::has(const std::string& name) const
+{
+    return values_.count(name) > 0;
+}
+
+
+std::string Args::get(const std::string& name, const std::string& def) const
+{
+    std::map<std::string, std::string>::const_iterator iter
+        = values_.find(name);
+    return (iter != values_.end())? iter->second : def;
+}
+
+
+int64_t Args::getInt(const std::string& name, int64_t def) const
+{
+    return has(name)? detail::parse_int(get(name, "")) : def;
+}
+
+
+double Args::getDouble(const std::string& name, double def) const
+{
+    return has(name)? atof(get(name, "").c_str()) : def;
+}
+
+
+std::vector<int64_t> Args::getList(const std::string& name,
+                                   const std::string& def) const
+{
+    std::vector<int64_t> res;
+    std::stringstream ss(get(name, def));
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty()) res.push_back(detail::parse_int(item));
+    }
+    return res;
+}
+
+
+Result::Result(const std::string& bench)
+: bench_(bench)
+{
+}
+
+
+Result& Result::param(const std::string& name, const std::string& value)
+{
+    params_.push_back(std::make_pair(name, detail::quote(value)));
+    return *this;
+}
+
+
+Result& Result::param(const std::string& name, int64_t value)
+{
+    std::ostringstream ss;
+    ss << value;
+    params_.push_back(std::make_pair(name, ss.str()));
+    return *this;
+}
+
+
+Result& Result::metric(const std::string& name, double value)
+{
+    std::ostringstream ss;
+    ss.precision(9);
+    ss << value;
+    metrics_.push_back(std::make_pair(name, ss.str()));
+    return *this;
+}
+
+
+Result& Result::histogram(const Histogram& h, double scale,
+                          const std::string& unit, const std::string& prefix)
+{
+    static const struct { const char* name; double q; } quantiles[] =
+    {
+        { "p50",  0.5   },
+        { "p90",  0.9   },
+        { "p99",  0.99  },
+        { "p999", 0.999 },
+    };
+
+    metric(prefix + "count", double(h.total));
+    metric(prefix + "mean_" + unit, h.total? scale * h.sum / h.total : 0.);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+    {
+        metric(prefix + quantiles[i].name + "_" + unit,
+               scale * h.quantile(quantiles[i].q));
+    }
+    return metric(prefix + "max_" + unit, scale * h.max);
+}
+
+
+void Result::print() const
+{
+    printf("{\"bench\": %s, \"params\": ", detail::quote(bench_).c_str());
+    detail::print_fields(params_);
+    printf(", \"metrics\": ");
+    detail::print_fields(metrics_);
+    printf("}\n");
+    fflush(stdout);
+}
+
+
+int64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+
+void check(int res, const char* what)
+{
+    if (res != UDT::ERROR) return;
+
+    fprintf(stderr, "%s: [UDT error %d] %s\n", what,
+            UDT::getlasterror().getErrorCode(),
+            UDT::getlasterror().getErrorMessage());
+    exit(1);
+}
+
+
+void loopback_pair(int type, int port, UDTSOCKET& client, UDTSOCKET& peer)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    UDTSOCKET server = UDT::socket(AF_INET, type, 0);
+    bool reuse = true;
+    check(UDT::setsockopt(server, 0, UDT_REUSEADDR, &reuse, sizeof(reuse)),
+          "setsockopt");
+    check(UDT::bind(server, (sockaddr*) &addr, sizeof(addr)), "bind");
+    check(UDT::listen(server, 16), "listen");
+
+    std::thread acceptor([&]()
+    {
+        sockaddr_in peer_addr;
+        int len = sizeof(peer_addr);
+        peer = UDT::accept(server, (sockaddr*) &peer_addr, &len);
+    });
+
+    client = UDT::socket(AF_INET, type, 0);
+    check(UDT::connect(client, (sockaddr*) &addr, sizeof(addr)), "connect");
+    acceptor.join();
+    check(peer, "accept");
+
+    UDT::close(server);
+}
+
+
+void send_all(UDTSOCKET u, const char* buf, int64_t len)
+{
+    while (len > 0)
+    {
+        int res = UDT::send(u, buf, (int) std::min<int64_t>(len, 1 << 30), 0);
+        check(res, "send");
+        buf += res;
+        len -= res;
+    }
+}
+
+
+void recv_all(UDTSOCKET u, char* buf, int64_t len)
+{
+    while (len > 0)
+    {
+        int res = UDT::recv(u, buf, (int) std::min<int64_t>(len, 1 << 30), 0);
+        check(res, "recv");
+        buf += res;
+        len -= res;
+    }
+}
+
+} // namespace bench
+
+} // namespace pyudt4
@@ -0,0 +1,141 @@
+#ifndef __PYUDT_BENCH_HH_
+#define __PYUDT_BENCH_HH_
+
+#include <udt/udt.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pyudt4 {
+
+class Histogram;
+
+/**
+ * Native benchmark driver (pyudt_bench target).
+ *
+ * Every benchmark prints one JSON object per line and per measurement:
+ *
+ *     {"bench": "throughput", "params": {...}, "metrics": {...}}
+ *
+ * The Python drivers in this directory run the same measurements through
+ * the bindings, merge both and add the machine information.
+ */
+namespace bench {
+
+/**
+ * Command line options: "--name value" pairs and "--flag" switches.
+ */
+class Args
+{
+public:
+    Args(int argc, char** argv);
+
+    bool has(const std::string& name) const;
+
+    std::string get(const std::string& name, const std::string& def) const;
+
+    /**
+     * Integer option, with an optional K, M or G (binary) suffix.
+     */
+    int64_t getInt(const std::string& name, int64_t def) const;
+
+    double getDouble(const std::string& name, double def) const;
+
+    /**
+     * Comma-separated list of integers, with optional suffixes.
+     */
+    std::vector<int64_t> getList(const std::string& name,
+                                 const std::string& def) const;
+
+private:
+    std::map<std::string, std::string> values_;
+};
+
+/**
+ * A measurement, printed as a JSON line.
+ */
+class Result
+{
+public:
+    explicit Result(const std::string& bench);
+
+    Result& param(const std::string& name, const std::string& value);
+    Result& param(const std::string& name, int64_t value);
+    Result& metric(const std::string& name, double value);
+
+    /**
+     * Add the count, mean, p50, p90, p99, p999 and max of a histogram as
+     * metrics named e.g. "p99_us", or "wait_p99_us" with a "wait_" prefix.
+     * @param scale  factor applied to the recorded values.
+     * @param unit   suffix of the metric names.
+     * @param prefix prefix of the metric names.
+     */
+    Result& histogram(const Histogram& h, double scale,
+                      const std::string& unit,
+                      const std::string& prefix = "");
+
+    /**
+     * Print the result on stdout and flush it.
+     */
+    void print() const;
+
+private:
+    typedef std::vector<std::pair<std::string, std::string> > Fields;
+
+    std::string bench_;
+    Fields params_;
+    Fields metrics_;
+};
+
+/**
+ * Monotonic time, in nanoseconds.
+ */
+int64_t now_ns();
+
+/**
+ * CPU time of the process (user and system, every thread), in seconds.
+ */
+double cpu_seconds();
+
+/**
+ * Exit with the last UDT error if res is UDT::ERROR.
+ */
+void check(int res, const char* what);
+
+/**
+ * Connect a (client, server-side) pair of UDT sockets on loopback.
+ * @param type SOCK_STREAM or SOCK_DGRAM.
+ * @param port port of the listening socket.
+ */
+void loopback_pair(int type, int port, UDTSOCKET& client, UDTSOCKET& peer);
+
+/**
+ * Send a whole buffer on a blocking stream socket.
+ */
+void send_all(UDTSOCKET u, const char* buf, int64_t len);
+
+/**
+ * Receive exactly len bytes on a blocking stream socket.
+ */
+void recv_all(UDTSOCKET u, char* buf, int64_t len);
+
+/**
+ * X-macro listing every benchmark: X(name, description)
+ */
+#define PYUDT_BENCHMARKS(X)                                                 \
+    X(throughput, "stream and message throughput over loopback")           \
+    X(latency,    "request/response latency over loopback")                \
+    X(epoll,      "epoll wait and churn cost from 10 to 10k sockets")
+
+#define PYUDT_BENCHMARK_DECL(name, description) \
+    int run_##name(const Args& args);
+PYUDT_BENCHMARKS(PYUDT_BENCHMARK_DECL)
+#undef PYUDT_BENCHMARK_DECL
+
+} // namespace bench
+
+} // namespace pyudt4
+
+#endif // __PYUDT_BENCH_HH_
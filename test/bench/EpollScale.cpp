@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Bench.hh"
+#include "Histogram.hh"
+
+namespace pyudt4 {
+
+namespace bench {
+
+namespace detail {
+
+/**
+ * Costs measured over the rounds of one configuration, in nanoseconds.
+ */
+struct EpollStats
+{
+    Histogram wait;
+    Histogram ready;
+    Histogram add;
+    Histogram remove;
+    int64_t events;
+
+    EpollStats() : events(0) {}
+};
+
+/**
+ * Keep the per-socket memory low enough for 10k connections.
+ */
+static
+void set_buffers(UDTSOCKET u, int buffer)
+{
+    int fc = std::max(32, buffer / 1500);
+    bool reuse = true;
+
+    check(UDT::setsockopt(u, 0, UDT_REUSEADDR, &reuse, sizeof(reuse)),
+          "setsockopt");
+    check(UDT::setsockopt(u, 0, UDT_FC, &fc, sizeof(fc)), "setsockopt");
+    check(UDT::setsockopt(u, 0, UDT_SNDBUF, &buffer, sizeof(buffer)),
+          "setsockopt");
+    check(UDT::setsockopt(u, 0, UDT_RCVBUF, &buffer, sizeof(buffer)),
+          "setsockopt");
+}
+
+/**
+ * Connect n (client, server-side) pairs through a single listener. The
+ * clients share a local port, hence a single UDP socket.
+ */
+static
+void connect_pairs(int port, int64_t n, int buffer,
+                   std::vector<UDTSOCKET>& clients,
+                   std::vector<UDTSOCKET>& peers)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    UDTSOCKET server = UDT::socket(AF_INET, SOCK_STREAM, 0);
+    set_buffers(server, buffer);
+    addr.sin_port = htons(port);
+    check(UDT::bind(server, (sockaddr*) &addr, sizeof(addr)), "bind");
+    check(UDT::listen(server, (int) std::min<int64_t>(n, 1024)), "listen");
+
+    peers.resize(n);
+    std::thread acceptor([&]()
+    {
+        for (int64_t i = 0; i < n; ++i)
+        {
+            sockaddr_in peer_addr;
+            int len = sizeof(peer_addr);
+            peers[i] = UDT::accept(server, (sockaddr*) &peer_addr, &len);
+            check(peers[i], "accept");
+
+            bool blocking = false;
+            UDT::setsockopt(peers[i], 0, UDT_RCVSYN, &blocking,
+                            sizeof(blocking));
+        }
+    });
+
+    sockaddr_in local = addr;
+    local.sin_port = htons(port + 1);
+    clients.resize(n);
+    for (int64_t i = 0; i < n; ++i)
+    {
+        clients[i] = UDT::socket(AF_INET, SOCK_STREAM, 0);
+        set_buffers(clients[i], buffer);
+        check(UDT::bind(clients[i], (sockaddr*) &local, sizeof(local)),
+              "bind");
+        addr.sin_port = htons(port);
+        check(UDT::connect(clients[i], (sockaddr*) &addr, sizeof(addr)),
+              "connect");
+    }
+
+    acceptor.join();
+    UDT::close(server);
+}
+
+/**
+ * One round: remove and re-add `churn` registered sockets, write a byte on
+ * `active` clients, then wait until the epoll has delivered every byte.
+ */
+static
+void run_round(int eid, const std::vector<UDTSOCKET>& clients,
+               const std::vector<UDTSOCKET>& peers,
+               const std::map<UDTSOCKET, size_t>& index,
+               int64_t active, int64_t churn, size_t& cursor,
+               EpollStats& stats)
+{
+    int events = UDT_EPOLL_IN;
+    for (int64_t i = 0; i < churn; ++i)
+    {
+        UDTSOCKET u = peers[cursor++ % peers.size()];
+
+        int64_t start = now_ns();
+        check(UDT::epoll_remove_usock(eid, u), "epoll_remove_usock");
+        int64_t removed = now_ns();
+        check(UDT::epoll_add_usock(eid, u, &events), "epoll_add_usock");
+        stats.remove.record(removed - start);
+        stats.add.record(now_ns() - removed);
+    }
+
+    int64_t n = (int64_t) clients.size();
+    for (int64_t i = 0; i < active; ++i)
+        send_all(clients[i * n / active], "x", 1);
+
+    std::set<UDTSOCKET> ready;
+    std::vector<size_t> handles;
+    char buf[256];
+
+    int64_t pending = active;
+    while (pending > 0)
+    {
+        ready.clear();
+        int64_t start = now_ns();
+        int res = UDT::epoll_wait(eid, &ready, nullptr, 1000);
+        int64_t waited = now_ns();
+        stats.wait.record(waited - start);
+        if (res <= 0) continue;
+
+        // Map the ready set back to the registered sockets, as the bindings
+        // do to build the Python objects
+        handles.clear();
+        for (std::set<UDTSOCKET>::const_iterator iter = ready.begin();
+             iter != ready.end();
+             ++iter)
+        {
+            std::map<UDTSOCKET, size_t>::const_iterator h = index.find(*iter);
+            if (h != index.end()) handles.push_back(h->second);
+        }
+        stats.ready.record(now_ns() - waited);
+        stats.events += handles.size();
+
+        for (size_t i = 0; i < handles.size(); ++i)
+        {
+            int got;
+            UDTSOCKET u = peers[handles[i]];
+            while ((got = UDT::recv(u, buf, sizeof(buf), 0)) > 0)
+                pending -= got;
+        }
+    }
+}
+
+} // namespace detail
+
+
+int run_epoll(const Args& args)
+{
+    std::vector<int64_t> counts = args.getList("sockets", "10,100,1000,10000");
+    std::vector<int64_t> active_pcts = args.getList("active", "1,10,100");
+    int64_t churn_pct = args.getInt("churn", 10);
+    int64_t rounds    = args.getInt("rounds", 100);
+    int64_t warmup    = args.getInt("warmup", 10);
+    int buffer        = (int) args.getInt("buffer", 64 << 10);
+    int port          = (int) args.getInt("port", 9400);
+
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        int64_t n = counts[c];
+
+        std::vector<UDTSOCKET> clients, peers;
+        detail::connect_pairs(port, n, buffer, clients, peers);
+        port += 2;
+
+        std::map<UDTSOCKET, size_t> index;
+        int eid = UDT::epoll_create();
+        int events = UDT_EPOLL_IN;
+        for (size_t i = 0; i < peers.size(); ++i)
+        {
+            index[peers[i]] = i;
+            check(UDT::epoll_add_usock(eid, peers[i], &events),
+                  "epoll_add_usock");
+        }
+
+        size_t cursor = 0;
+        for (size_t a = 0; a < active_pcts.size(); ++a)
+        for (int phase = 0; phase < (churn_pct? 2 : 1); ++phase)
+        {
+            int64_t active = std::max<int64_t>(1, n * active_pcts[a] / 100);
+            int64_t churn = phase? std::max<int64_t>(1, n * churn_pct / 100)
+                                 : 0;
+
+            detail::EpollStats stats;
+            for (int64_t r = 0; r < warmup; ++r)
+                detail::run_round(eid, clients, peers, index, active,
+                                  churn, cursor, stats);
+            stats = detail::EpollStats();
+
+            double cpu = cpu_seconds();
+            int64_t start = now_ns();
+            for (int64_t r = 0; r < rounds; ++r)
+                detail::run_round(eid, clients, peers, index, active,
+                                  churn, cursor, stats);
+            double seconds = (now_ns() - start) * 1e-9;
+            cpu = cpu_seconds() - cpu;
+
+            Result result("epoll");
+            result.param("impl", "native")
+                  .param("phase", phase? "churn" : "steady")
+                  .param("sockets", n)
+                  .param("active_pct", active_pcts[a])
+                  .histogram(stats.wait, 1e-3, "us", "wait_")
+                  .histogram(stats.ready, 1e-3, "us", "ready_")
+                  .metric("events", double(stats.events))
+                  .metric("events_per_sec", stats.events / seconds)
+                  .metric("cpu_us_per_event",
+                          stats.events? cpu * 1e6 / stats.events : 0.);
+            if (churn)
+            {
+                result.histogram(stats.add, 1e-3, "us", "add_")
+                      .histogram(stats.remove, 1e-3, "us", "remove_");
+            }
+            result.print();
+        }
+
+        UDT::epoll_release(eid);
+        for (int64_t i = 0; i < n; ++i)
+        {
+            UDT::close(clients[i]);
+            UDT::close(peers[i]);
+        }
+    }
+    return 0;
+}
+
+} // namespace bench
+
+} // namespace pyudt4
@@ -0,0 +1,232 @@
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Bench.hh"
+#include "Histogram.hh"
+
+namespace pyudt4 {
+
+namespace bench {
+
+namespace detail {
+
+/**
+ * Receive one payload (stream) or message into buf.
+ */
+static
+void receive(UDTSOCKET u, bool message, char* buf, int size)
+{
+    if (message) check(UDT::recvmsg(u, buf, size), "recvmsg");
+    else recv_all(u, buf, size);
+}
+
+static
+void reply(UDTSOCKET u, bool message, const char* buf, int size)
+{
+    if (message) check(UDT::sendmsg(u, buf, size, -1, true), "sendmsg");
+    else send_all(u, buf, size);
+}
+
+/**
+ * Echo every payload until the connection is closed (blocking receive).
+ */
+static
+void echo_blocking(UDTSOCKET u, bool message, int size)
+{
+    std::vector<char> buf(size);
+    for (;;)
+    {
+        int res = message? UDT::recvmsg(u, buf.data(), size)
+                         : UDT::recv(u, buf.data(), size, 0);
+        if (res == UDT::ERROR) return;
+
+        // Complete partial stream payloads
+        if (!message && res < size) recv_all(u, buf.data() + res, size - res);
+        reply(u, message, buf.data(), size);
+    }
+}
+
+/**
+ * Echo the payloads of every connection from a single epoll-driven thread.
+ */
+static
+void echo_epoll(const std::vector<UDTSOCKET>& peers, bool message, int size,
+                const std::atomic<bool>& done)
+{
+    int eid = UDT::epoll_create();
+    std::map<UDTSOCKET, std::pair<std::vector<char>, int> > state;
+
+    for (size_t i = 0; i < peers.size(); ++i)
+    {
+        bool blocking = false;
+        UDT::setsockopt(peers[i], 0, UDT_RCVSYN, &blocking, sizeof(blocking));
+        UDT::epoll_add_usock(eid, peers[i]);
+        state[peers[i]] = std::make_pair(std::vector<char>(size), 0);
+    }
+
+    std::set<UDTSOCKET> ready;
+    while (!done.load())
+    {
+        ready.clear();
+        if (UDT::epoll_wait(eid, &ready, nullptr, 100) <= 0) continue;
+
+        for (std::set<UDTSOCKET>::const_iterator iter = ready.begin();
+             iter != ready.end();
+             ++iter)
+        {
+            std::vector<char>& buf = state[*iter].first;
+            int& received = state[*iter].second;
+
+            int res = message? UDT::recvmsg(*iter, buf.data(), size)
+                             : UDT::recv(*iter, buf.data() + received,
+                                         size - received, 0);
+            if (res == UDT::ERROR) continue;
+
+            received = message? size : received + res;
+            if (received == size)
+            {
+                reply(*iter, message, buf.data(), size);
+                received = 0;
+            }
+        }
+    }
+
+    UDT::epoll_release(eid);
+}
+
+/**
+ * Ping-pong from one client connection.
+ */
+static
+void ping(UDTSOCKET u, bool message, bool use_epoll, int size,
+          int64_t warmup, int64_t iterations, Histogram& out, std::mutex& m)
+{
+    std::vector<char> request(size, 'x');
+    std::vector<char> response(size);
+    Histogram h;
+
+    int eid = -1;
+    if (use_epoll)
+    {
+        eid = UDT::epoll_create();
+        UDT::epoll_add_usock(eid, u);
+    }
+
+    std::set<UDTSOCKET> ready;
+    for (int64_t i = 0; i < warmup + iterations; ++i)
+    {
+        int64_t start = now_ns();
+        reply(u, message, request.data(), size);
+
+        if (use_epoll)
+        {
+            do
+            {
+                ready.clear();
+                UDT::epoll_wait(eid, &ready, nullptr, -1);
+            } while (ready.empty());
+        }
+        receive(u, message, response.data(), size);
+
+        if (i >= warmup) h.record(now_ns() - start);
+    }
+
+    if (eid >= 0) UDT::epoll_release(eid);
+
+    std::lock_guard<std::mutex> lock(m);
+    out.merge(h);
+}
+
+} // namespace detail
+
+
+int run_latency(const Args& args)
+{
+    std::vector<int64_t> sizes = args.getList("sizes", "16,256,4K,64K");
+    std::vector<int64_t> concurrencies = args.getList("concurrency", "1,4,16");
+    int64_t iterations = args.getInt("iterations", 10000);
+    int64_t warmup     = args.getInt("warmup", 100);
+    int port           = (int) args.getInt("port", 9200);
+    std::string modes    = args.get("modes", "stream,message");
+    std::string receives = args.get("receive", "blocking,epoll");
+
+    const char* mode_names[] = { "stream", "message" };
+    const char* receive_names[] = { "blocking", "epoll" };
+
+    for (int m = 0; m < 2; ++m)
+    for (int r = 0; r < 2; ++r)
+    for (size_t c = 0; c < concurrencies.size(); ++c)
+    for (size_t s = 0; s < sizes.size(); ++s)
+    {
+        if (modes.find(mode_names[m]) == std::string::npos
+         || receives.find(receive_names[r]) == std::string::npos)
+            continue;
+
+        bool message = (m == 1);
+        bool use_epoll = (r == 1);
+        int size = (int) sizes[s];
+        int64_t concurrency = concurrencies[c];
+
+        std::vector<UDTSOCKET> clients(concurrency), peers(concurrency);
+        for (int64_t i = 0; i < concurrency; ++i)
+        {
+            loopback_pair(message? SOCK_DGRAM : SOCK_STREAM, port++,
+                          clients[i], peers[i]);
+        }
+
+        // Server side
+        std::atomic<bool> done(false);
+        std::vector<std::thread> servers;
+        if (use_epoll)
+        {
+            servers.push_back(std::thread(detail::echo_epoll,
+                                          std::cref(peers), message, size,
+                                          std::cref(done)));
+        }
+        else
+        {
+            for (int64_t i = 0; i < concurrency; ++i)
+                servers.push_back(std::thread(detail::echo_blocking, peers[i],
+                                              message, size));
+        }
+
+        // Client side
+        Histogram rtt;
+        std::mutex mutex;
+        std::vector<std::thread> pingers;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < concurrency; ++i)
+        {
+            pingers.push_back(std::thread(detail::ping, clients[i], message,
+                                          use_epoll, size, warmup, iterations,
+                                          std::ref(rtt), std::ref(mutex)));
+        }
+        for (size_t i = 0; i < pingers.size(); ++i) pingers[i].join();
+        double seconds = (now_ns() - start) * 1e-9;
+
+        done = true;
+        for (int64_t i = 0; i < concurrency; ++i) UDT::close(clients[i]);
+        for (size_t i = 0; i < servers.size(); ++i) servers[i].join();
+        for (int64_t i = 0; i < concurrency; ++i) UDT::close(peers[i]);
+
+        Result("latency")
+            .param("impl", "native")
+            .param("mode", mode_names[m])
+            .param("receive", receive_names[r])
+            .param("size", size)
+            .param("concurrency", concurrency)
+            .histogram(rtt, 1e-3, "us")
+            .metric("requests_per_sec",
+                    concurrency * (warmup + iterations) / seconds)
+            .print();
+    }
+    return 0;
+}
+
+} // namespace bench
+
+} // namespace pyudt4
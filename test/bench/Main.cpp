@@ -0,0 +1,45 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Bench.hh"
+
+using namespace pyudt4::bench;
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s <benchmark> [--option value...]\n\n"
+                    "Benchmarks:\n", program);
+
+#define PYUDT_BENCHMARK_USAGE(name, description) \
+    fprintf(stderr, "  %-12s %s\n", #name, description);
+    PYUDT_BENCHMARKS(PYUDT_BENCHMARK_USAGE)
+#undef PYUDT_BENCHMARK_USAGE
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Args args(argc - 2, argv + 2);
+    int res = -1;
+
+    UDT::startup();
+
+#define PYUDT_BENCHMARK_RUN(name, description) \
+    if (strcmp(argv[1], #name) == 0) res = run_##name(args);
+    PYUDT_BENCHMARKS(PYUDT_BENCHMARK_RUN)
+#undef PYUDT_BENCHMARK_RUN
+
+    UDT::cleanup();
+
+    if (res < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    return res;
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Bench.hh"
+
+namespace pyudt4 {
+
+namespace bench {
+
+namespace detail {
+
+/**
+ * Transfer count payloads of a given size from client to peer.
+ * @return elapsed time, in seconds.
+ */
+static
+double transfer(UDTSOCKET client, UDTSOCKET peer, bool message,
+                int64_t size, int64_t count)
+{
+    std::vector<char> out(size, 'x');
+    std::vector<char> in(message? size : std::min<int64_t>(size, 4 << 20));
+
+    int64_t start = now_ns();
+
+    std::thread receiver([&]()
+    {
+        if (message)
+        {
+            for (int64_t i = 0; i < count; ++i)
+                check(UDT::recvmsg(peer, in.data(), (int) in.size()),
+                      "recvmsg");
+        }
+        else
+        {
+            int64_t left = size * count;
+            while (left > 0)
+            {
+                int64_t chunk = std::min<int64_t>(left, in.size());
+                recv_all(peer, in.data(), chunk);
+                left -= chunk;
+            }
+        }
+    });
+
+    for (int64_t i = 0; i < count; ++i)
+    {
+        if (message)
+            check(UDT::sendmsg(client, out.data(), (int) size, -1, true),
+                  "sendmsg");
+        else
+            send_all(client, out.data(), size);
+    }
+
+    receiver.join();
+    return (now_ns() - start) * 1e-9;
+}
+
+} // namespace detail
+
+
+int run_throughput(const Args& args)
+{
+    std::vector<int64_t> sizes =
+        args.getList("sizes", "64,256,1K,4K,16K,64K,256K,1M,4M,16M,64M");
+    int64_t bytes       = args.getInt("bytes", 256 << 20);
+    int64_t max_message = args.getInt("max-message", 1 << 20);
+    int port            = (int) args.getInt("port", 9000);
+    std::string modes   = args.get("modes", "stream,message");
+
+    const char* names[] = { "stream", "message" };
+    for (int m = 0; m < 2; ++m)
+    {
+        if (modes.find(names[m]) == std::string::npos) continue;
+
+        bool message = (m == 1);
+        UDTSOCKET client, peer;
+        loopback_pair(message? SOCK_DGRAM : SOCK_STREAM, port + m,
+                      client, peer);
+
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            int64_t size = sizes[i];
+
+            // Messages must fit in the UDT buffers
+            if (message && size > max_message) continue;
+
+            int64_t count = std::max<int64_t>(1, bytes / size);
+            double seconds = detail::transfer(client, peer, message,
+                                              size, count);
+
+            Result("throughput")
+                .param("impl", "native")
+                .param("mode", names[m])
+                .param("size", size)
+                .metric("bytes", double(size * count))
+                .metric("seconds", seconds)
+                .metric("mbps", size * count * 8 / seconds / 1e6)
+                .metric("ops_per_sec", count / seconds)
+                .print();
+        }
+
+        UDT::close(client);
+        UDT::close(peer);
+    }
+    return 0;
+}
+
+} // namespace bench
+
+} // namespace pyudt4
@@ -0,0 +1,259 @@
+#!/usr/bin/env python
+"""
+Scalability of pyudt.Epoll from 10 to 10,000 registered sockets.
+
+N connected pairs are registered in one epoll (server side), and every round
+writes a byte on a fraction of the clients then waits until the epoll has
+delivered all of them. The "churn" phase also removes and re-adds a fraction
+of the registered sockets before every round. Reported per configuration:
+wait() latency, cost of the ready set conversion (get_read_udt()), events
+per second, process CPU time per event and, for churn, add_usock() and
+remove_usock() latency.
+
+The native driver runs the same rounds on raw UDT:
+
+    make pyudt_bench
+    test/bench/bench_epoll.py --native ./pyudt_bench -o new.json
+    test/bench/bench_epoll.py --compare old.json -o new.json
+    test/bench/bench_epoll.py compare new.json old.json
+
+10k connections need about 20k UDT sockets: the per-socket buffers are
+shrunk (--buffer) and every client shares a single local port.
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import resource
+import sys
+import time
+from threading import Thread
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchutil
+
+import pyudt
+
+
+# Compared metrics: name -> 1 if higher is better, -1 if lower is better
+METRICS = { 'wait_p99_us': -1, 'ready_p99_us': -1, 'events_per_sec': 1,
+            'cpu_us_per_event': -1 }
+
+
+def parse_list(s):
+    return [int(item) for item in s.split(',') if item]
+
+
+def now_ns():
+    return int(pyudt.monotonic() * 1e9)
+
+
+def cpu_seconds():
+    usage = resource.getrusage(resource.RUSAGE_SELF)
+    return usage.ru_utime + usage.ru_stime
+
+
+def set_buffers(sock, buffer):
+    """
+    Keep the per-socket memory low enough for 10k connections.
+    """
+    sock.setsockopt(pyudt.UDT_REUSEADDR, True)
+    sock.setsockopt(pyudt.UDT_FC, max(32, buffer // 1500))
+    sock.setsockopt(pyudt.UDT_SNDBUF, buffer)
+    sock.setsockopt(pyudt.UDT_RCVBUF, buffer)
+
+
+def connect_pairs(port, n, buffer):
+    """
+    Connect n (client, server-side) pairs through a single listener. The
+    clients share a local port, hence a single UDP socket.
+    """
+    server = pyudt.Socket(pyudt.AF_INET, pyudt.SOCK_STREAM, 0)
+    set_buffers(server, buffer)
+    server.bind('127.0.0.1', port)
+    server.listen(min(n, 1024))
+
+    peers = []
+    def acceptor():
+        for i in range(n):
+            peer = server.accept()[0]
+            peer.setblocking(False)
+            peers.append(peer)
+
+    t = Thread(target = acceptor)
+    t.start()
+
+    clients = []
+    for i in range(n):
+        client = pyudt.Socket(pyudt.AF_INET, pyudt.SOCK_STREAM, 0)
+        set_buffers(client, buffer)
+        client.bind('127.0.0.1', port + 1)
+        client.connect('127.0.0.1', port)
+        client.setblocking(True)
+        clients.append(client)
+
+    t.join()
+    server.close()
+    return clients, peers
+
+
+class Stats(object):
+    """
+    Costs measured over the rounds of one configuration, in nanoseconds.
+    """
+    def __init__(self):
+        self.wait = benchutil.Histogram()
+        self.ready = benchutil.Histogram()
+        self.add = benchutil.Histogram()
+        self.remove = benchutil.Histogram()
+        self.events = 0
+
+
+def run_round(epoll, clients, peers, index, active, churn, cursor, stats):
+    """
+    One round: remove and re-add `churn` registered sockets, write a byte on
+    `active` clients, then wait until the epoll has delivered every byte.
+    :return: the new churn cursor.
+    """
+    for i in range(churn):
+        sock = peers[cursor % len(peers)]
+        cursor += 1
+
+        start = now_ns()
+        epoll.remove_usock(sock)
+        removed = now_ns()
+        epoll.add_usock(sock, pyudt.UDT_EPOLL_IN)
+        stats.remove.record(removed - start)
+        stats.add.record(now_ns() - removed)
+
+    n = len(clients)
+    for i in range(active):
+        clients[i * n // active].sendall(b'x')
+
+    buf = bytearray(256)
+    pending = active
+    while pending > 0:
+        start = now_ns()
+        res = epoll.wait(1000, True, False, False, False)
+        waited = now_ns()
+        stats.wait.record(waited - start)
+        if res <= 0:
+            continue
+
+        ready = [index[fd] for fd in epoll.get_read_udt() if fd in index]
+        stats.ready.record(now_ns() - waited)
+        stats.events += len(ready)
+
+        for sock in ready:
+            while True:
+                got = sock.try_recv_into(buf)
+                if got <= 0:
+                    break
+                pending -= got
+
+    return cursor
+
+
+def measure(epoll, clients, peers, index, active_pct, churn_pct, args, cursor):
+    n = len(clients)
+    active = max(1, n * active_pct // 100)
+    churn = max(1, n * churn_pct // 100) if churn_pct else 0
+
+    stats = Stats()
+    for r in range(args.warmup):
+        cursor = run_round(epoll, clients, peers, index, active, churn,
+                           cursor, stats)
+    stats = Stats()
+
+    cpu = cpu_seconds()
+    start = time.time()
+    for r in range(args.rounds):
+        cursor = run_round(epoll, clients, peers, index, active, churn,
+                           cursor, stats)
+    seconds = time.time() - start
+    cpu = cpu_seconds() - cpu
+
+    metrics = {}
+    metrics.update(stats.wait.metrics(1e-3, 'us', 'wait_'))
+    metrics.update(stats.ready.metrics(1e-3, 'us', 'ready_'))
+    metrics['events'] = stats.events
+    metrics['events_per_sec'] = stats.events / seconds
+    metrics['cpu_us_per_event'] = (cpu * 1e6 / stats.events
+                                   if stats.events else 0.)
+    if churn:
+        metrics.update(stats.add.metrics(1e-3, 'us', 'add_'))
+        metrics.update(stats.remove.metrics(1e-3, 'us', 'remove_'))
+
+    r = benchutil.result('epoll',
+                         { 'impl': 'udt4_ext',
+                           'phase': 'churn' if churn else 'steady',
+                           'sockets': n, 'active_pct': active_pct },
+                         metrics)
+    return r, cursor
+
+
+def main(argv):
+    if argv and argv[0] == 'compare':
+        benchutil.compare_main(argv[1:], METRICS)
+
+    parser = argparse.ArgumentParser(
+        description = 'Scalability of pyudt.Epoll with the number of sockets.')
+    parser.add_argument('--sockets', default = '10,100,1000,10000',
+                        help = 'registered sockets (default: 10,100,1000,10000)')
+    parser.add_argument('--active', default = '1,10,100',
+                        help = 'percentages of active sockets per round '
+                               '(default: 1,10,100)')
+    parser.add_argument('--churn', type = int, default = 10,
+                        help = 'percentage of sockets removed and re-added '
+                               'per round in the churn phase (default: 10)')
+    parser.add_argument('--rounds', type = int, default = 100,
+                        help = 'measured rounds (default: 100)')
+    parser.add_argument('--warmup', type = int, default = 10,
+                        help = 'rounds not measured (default: 10)')
+    parser.add_argument('--buffer', type = int, default = 64 << 10,
+                        help = 'UDT buffer size per socket (default: 64K)')
+    parser.add_argument('--port', type = int, default = 9500,
+                        help = 'first loopback port (default: 9500)')
+    benchutil.add_arguments(parser)
+    args = parser.parse_args(argv)
+
+    results = []
+    port = args.port
+    for n in parse_list(args.sockets):
+        clients, peers = connect_pairs(port, n, args.buffer)
+        port += 2
+
+        epoll = pyudt.Epoll()
+        index = {}
+        for sock in peers:
+            index[sock.descriptor()] = sock
+            epoll.add_usock(sock, pyudt.UDT_EPOLL_IN)
+
+        cursor = 0
+        for active_pct in parse_list(args.active):
+            for churn_pct in [0] + ([args.churn] if args.churn else []):
+                r, cursor = measure(epoll, clients, peers, index, active_pct,
+                                    churn_pct, args, cursor)
+                benchutil.print_result(r)
+                results.append(r)
+
+        del epoll
+        for sock in clients + peers:
+            sock.close()
+
+    if args.native:
+        native = benchutil.run_native(args.native, 'epoll', [
+            '--sockets', args.sockets, '--active', args.active,
+            '--churn', str(args.churn), '--rounds', str(args.rounds),
+            '--warmup', str(args.warmup), '--buffer', str(args.buffer),
+            '--port', str(port)])
+        for r in native:
+            benchutil.print_result(r)
+        results += native
+
+    benchutil.finish(args, results, METRICS)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
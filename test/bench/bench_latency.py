@@ -0,0 +1,293 @@
+#!/usr/bin/env python
+"""
+Request/response latency of the udt4_ext bindings over loopback.
+
+Every client connection sends a payload and waits for its echo, in stream
+and message modes, with the echo server reading either from blocking sockets
+(one thread per connection) or from a single epoll-driven thread. The round
+trip times are reported as percentiles, with the same histogram as the
+native driver (raw UDT):
+
+    make pyudt_bench
+    test/bench/bench_latency.py --native ./pyudt_bench -o new.json
+    test/bench/bench_latency.py --compare old.json -o new.json
+    test/bench/bench_latency.py compare new.json old.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import sys
+import threading
+import time
+from threading import Thread
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchutil
+
+import pyudt
+
+
+# Compared metrics: lower is better
+METRICS = { 'p50_us': -1, 'p99_us': -1 }
+
+# Client epoll waits, in milliseconds
+WAIT_MS = 1000
+
+
+def parse_size(s):
+    units = { 'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30 }
+    s = s.strip().upper()
+    if s[-1] in units:
+        return int(s[:-1]) * units[s[-1]]
+    return int(s)
+
+
+def parse_list(s):
+    return [parse_size(item) for item in s.split(',') if item]
+
+
+def now_ns():
+    return int(pyudt.monotonic() * 1e9)
+
+
+def pair(message, port, connect_port):
+    """
+    Connect a (client, server-side) pair of sockets on loopback, the client
+    connecting to connect_port (the server port or an impairment proxy).
+    """
+    type = pyudt.SOCK_DGRAM if message else pyudt.SOCK_STREAM
+
+    server = pyudt.Socket(pyudt.AF_INET, type, 0)
+    server.setsockopt(pyudt.UDT_REUSEADDR, True)
+    server.bind('127.0.0.1', port)
+    server.listen(16)
+
+    accepted = []
+    t = Thread(target = lambda: accepted.append(server.accept()[0]))
+    t.start()
+    client = pyudt.Socket(pyudt.AF_INET, type, 0)
+    client.connect('127.0.0.1', connect_port)
+    t.join()
+    server.close()
+
+    client.setblocking(True)
+    accepted[0].setblocking(True)
+    return client, accepted[0]
+
+
+def receive(sock, message, buf):
+    """
+    Receive one message, or exactly len(buf) bytes of a stream.
+    """
+    if message:
+        return sock.recvmsg(len(buf))
+
+    view = memoryview(buf)
+    received = 0
+    while received < len(buf):
+        received += sock.recv_into(view[received:])
+    return buf
+
+
+def reply(sock, message, payload):
+    if message:
+        sock.sendmsg(payload, -1, True)
+    else:
+        sock.sendall(payload)
+
+
+def echo_blocking(sock, message, size):
+    """
+    Echo every payload until the connection is closed.
+    """
+    buf = bytearray(size)
+    try:
+        while True:
+            reply(sock, message, receive(sock, message, buf))
+    except pyudt.UDTError:
+        pass
+
+
+def echo_epoll(peers, message, size, done):
+    """
+    Echo the payloads of every connection from a single epoll-driven thread.
+    """
+    epoll = pyudt.Epoll()
+    state = {}
+    for sock in peers:
+        sock.setblocking(False)
+        epoll.add_usock(sock, pyudt.UDT_EPOLL_IN)
+        state[sock.descriptor()] = [sock, bytearray(size), 0]
+
+    while not done.is_set():
+        if epoll.wait(100, True, False, False, False) <= 0:
+            continue
+
+        for fd in epoll.get_read_udt():
+            entry = state.get(fd)
+            if entry is None:
+                continue
+            sock, buf, received = entry
+
+            try:
+                if message:
+                    data = sock.recvmsg(size)
+                    received = size
+                else:
+                    n = sock.try_recv_into(memoryview(buf)[received:],
+                                           size - received)
+                    if n < 0:
+                        continue
+                    received += n
+                    data = buf
+            except pyudt.UDTError:
+                continue
+
+            if received == size:
+                # Replies are sent in blocking mode
+                sock.setblocking(True)
+                reply(sock, message, data)
+                sock.setblocking(False)
+                received = 0
+            entry[2] = received
+
+
+def ping(sock, message, use_epoll, size, warmup, iterations, out, lock):
+    """
+    Ping-pong from one client connection.
+    """
+    payload = b'x' * size
+    buf = bytearray(size)
+    h = benchutil.Histogram()
+
+    epoll = None
+    if use_epoll:
+        epoll = pyudt.Epoll()
+        epoll.add_usock(sock, pyudt.UDT_EPOLL_IN)
+
+    for i in range(warmup + iterations):
+        start = now_ns()
+        reply(sock, message, payload)
+        if epoll is not None:
+            while epoll.wait(WAIT_MS, True, False, False, False) <= 0:
+                pass
+        receive(sock, message, buf)
+        if i >= warmup:
+            h.record(now_ns() - start)
+
+    with lock:
+        out.merge(h)
+
+
+def measure(mode, receive_mode, size, concurrency, args, port):
+    message = (mode == 'message')
+    use_epoll = (receive_mode == 'epoll')
+
+    proxies = []
+    pairs = []
+    for i in range(concurrency):
+        connect_port = port + i
+        if args.impair:
+            proxies.append(benchutil.start_proxy(port + i, args.impair, i + 1))
+            connect_port = proxies[-1].port()
+        pairs.append(pair(message, port + i, connect_port))
+    clients = [c for c, p in pairs]
+    peers = [p for c, p in pairs]
+
+    done = threading.Event()
+    if use_epoll:
+        servers = [Thread(target = echo_epoll,
+                          args = (peers, message, size, done))]
+    else:
+        servers = [Thread(target = echo_blocking, args = (p, message, size))
+                   for p in peers]
+    for t in servers:
+        t.start()
+
+    rtt = benchutil.Histogram()
+    lock = threading.Lock()
+    pingers = [Thread(target = ping,
+                      args = (c, message, use_epoll, size, args.warmup,
+                              args.iterations, rtt, lock))
+               for c in clients]
+
+    start = time.time()
+    for t in pingers:
+        t.start()
+    for t in pingers:
+        t.join()
+    seconds = time.time() - start
+
+    done.set()
+    for sock in clients:
+        sock.close()
+    for t in servers:
+        t.join()
+    for sock in peers:
+        sock.close()
+    for proxy in proxies:
+        proxy.stop()
+
+    metrics = rtt.metrics(1e-3, 'us')
+    metrics['requests_per_sec'] = (concurrency * (args.warmup + args.iterations)
+                                   / seconds)
+    params = { 'impl': 'udt4_ext', 'mode': mode, 'receive': receive_mode,
+               'size': size, 'concurrency': concurrency }
+    if args.impair:
+        params['impair'] = args.impair
+    return benchutil.result('latency', params, metrics)
+
+
+def main(argv):
+    if argv and argv[0] == 'compare':
+        benchutil.compare_main(argv[1:], METRICS)
+
+    parser = argparse.ArgumentParser(
+        description = 'Request/response latency of the UDT bindings.')
+    parser.add_argument('--sizes', default = '16,256,4K,64K',
+                        help = 'payload sizes (default: 16,256,4K,64K)')
+    parser.add_argument('--concurrency', default = '1,4,16',
+                        help = 'concurrent connections (default: 1,4,16)')
+    parser.add_argument('--modes', default = 'stream,message',
+                        help = 'stream, message or both')
+    parser.add_argument('--receive', default = 'blocking,epoll',
+                        help = 'server receive: blocking, epoll or both')
+    parser.add_argument('--iterations', type = int, default = 10000,
+                        help = 'round trips per connection (default: 10000)')
+    parser.add_argument('--warmup', type = int, default = 100,
+                        help = 'round trips not measured (default: 100)')
+    parser.add_argument('--port', type = int, default = 9300,
+                        help = 'first loopback port (default: 9300)')
+    benchutil.add_impair_argument(parser)
+    benchutil.add_arguments(parser)
+    args = parser.parse_args(argv)
+
+    results = []
+    port = args.port
+    for mode in args.modes.split(','):
+        for receive_mode in args.receive.split(','):
+            for concurrency in parse_list(args.concurrency):
+                for size in parse_list(args.sizes):
+                    r = measure(mode, receive_mode, size, concurrency, args,
+                                port)
+                    port += concurrency
+                    benchutil.print_result(r)
+                    results.append(r)
+
+    if args.native:
+        native = benchutil.run_native(args.native, 'latency', [
+            '--sizes', args.sizes, '--concurrency', args.concurrency,
+            '--modes', args.modes, '--receive', args.receive,
+            '--iterations', str(args.iterations),
+            '--warmup', str(args.warmup), '--port', str(port)])
+        for r in native:
+            benchutil.print_result(r)
+        results += native
+
+    benchutil.finish(args, results, METRICS)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
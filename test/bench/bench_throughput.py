@@ -0,0 +1,248 @@
+#!/usr/bin/env python
+"""
+Loopback throughput of the UDT bindings, in stream and message modes.
+
+Measures the udt4_ext bindings (pyudt), the legacy _udt4 module (udt4) when
+it is installed, and raw UDT through the native driver:
+
+    make pyudt_bench
+    test/bench/bench_throughput.py --native ./pyudt_bench -o new.json
+    test/bench/bench_throughput.py --compare old.json -o new.json
+    test/bench/bench_throughput.py compare new.json old.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import sys
+import time
+from threading import Thread
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchutil
+
+
+# Compared metrics: higher is better
+METRICS = { 'mbps': 1 }
+
+DEFAULT_SIZES = '64,256,1K,4K,16K,64K,256K,1M,4M,16M,64M'
+
+
+def parse_size(s):
+    units = { 'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30 }
+    s = s.strip().upper()
+    if s[-1] in units:
+        return int(s[:-1]) * units[s[-1]]
+    return int(s)
+
+
+class Pyudt(object):
+    """
+    udt4_ext bindings.
+    """
+    name = 'udt4_ext'
+
+    def __init__(self):
+        import pyudt
+        self.pyudt = pyudt
+
+    def pair(self, message, port, connect_port):
+        pyudt = self.pyudt
+        type = pyudt.SOCK_DGRAM if message else pyudt.SOCK_STREAM
+
+        server = pyudt.Socket(pyudt.AF_INET, type, 0)
+        server.setsockopt(pyudt.UDT_REUSEADDR, True)
+        server.bind('127.0.0.1', port)
+        server.listen(16)
+
+        accepted = []
+        t = Thread(target = lambda: accepted.append(server.accept()[0]))
+        t.start()
+        client = pyudt.Socket(pyudt.AF_INET, type, 0)
+        client.connect('127.0.0.1', connect_port)
+        t.join()
+        server.close()
+
+        client.setblocking(True)
+        accepted[0].setblocking(True)
+        return client, accepted[0]
+
+    def close(self, sock):
+        sock.close()
+
+    def sender(self, sock, message, payload, count):
+        if message:
+            for i in range(count):
+                sock.sendmsg(payload, -1, True)
+        else:
+            for i in range(count):
+                sock.sendall(payload)
+
+    def receiver(self, sock, message, size, count):
+        if message:
+            for i in range(count):
+                sock.recvmsg(size)
+        else:
+            buf = bytearray(min(size, 4 << 20))
+            left = size * count
+            while left > 0:
+                left -= sock.recv_into(buf, min(left, len(buf)))
+
+
+class Legacy(object):
+    """
+    Legacy _udt4 module.
+    """
+    name = 'legacy'
+
+    def __init__(self):
+        import udt4
+        self.udt4 = udt4
+        udt4.startup()
+
+    def pair(self, message, port, connect_port):
+        import socket as socklib
+        udt4 = self.udt4
+        type = socklib.SOCK_DGRAM if message else socklib.SOCK_STREAM
+
+        server = udt4.socket(socklib.AF_INET, type, 0)
+        udt4.bind(server, '127.0.0.1', port)
+        udt4.listen(server, 16)
+
+        accepted = []
+        t = Thread(target = lambda: accepted.append(udt4.accept(server)[0]))
+        t.start()
+        client = udt4.socket(socklib.AF_INET, type, 0)
+        udt4.connect(client, '127.0.0.1', connect_port)
+        t.join()
+        udt4.close(server)
+        return client, accepted[0]
+
+    def close(self, sock):
+        self.udt4.close(sock)
+
+    def sender(self, sock, message, payload, count):
+        udt4 = self.udt4
+        for i in range(count):
+            if message:
+                udt4.sendmsg(sock, payload, len(payload))
+            else:
+                sent = 0
+                while sent < len(payload):
+                    sent += udt4.send(sock, payload[sent:], len(payload) - sent)
+
+    def receiver(self, sock, message, size, count):
+        udt4 = self.udt4
+        if message:
+            for i in range(count):
+                udt4.recvmsg(sock, size)
+        else:
+            chunk = min(size, 4 << 20)
+            left = size * count
+            while left > 0:
+                left -= len(udt4.recv(sock, min(left, chunk)))
+
+
+def transfer(impl, client, peer, message, size, count):
+    """
+    Transfer count payloads from client to peer, return the elapsed time.
+    """
+    payload = b'x' * size
+    receiver = Thread(target = impl.receiver,
+                      args = (peer, message, size, count))
+
+    start = time.time()
+    receiver.start()
+    impl.sender(client, message, payload, count)
+    receiver.join()
+    return time.time() - start
+
+
+def run(impl, args, port):
+    results = []
+    for mode in args.modes.split(','):
+        message = (mode == 'message')
+        proxy = None
+        connect_port = port
+        if args.impair:
+            proxy = benchutil.start_proxy(port, args.impair)
+            connect_port = proxy.port()
+        client, peer = impl.pair(message, port, connect_port)
+        port += 1
+
+        for size in [parse_size(s) for s in args.sizes.split(',')]:
+            if message and size > args.max_message:
+                continue
+
+            count = max(1, args.bytes // size)
+            seconds = transfer(impl, client, peer, message, size, count)
+            params = { 'impl': impl.name, 'mode': mode, 'size': size }
+            if args.impair:
+                params['impair'] = args.impair
+            r = benchutil.result('throughput', params,
+                                 { 'bytes':       size * count,
+                                   'seconds':     seconds,
+                                   'mbps':        size * count * 8
+                                                  / seconds / 1e6,
+                                   'ops_per_sec': count / seconds })
+            benchutil.print_result(r)
+            results.append(r)
+
+        impl.close(client)
+        impl.close(peer)
+        if proxy is not None:
+            proxy.stop()
+    return results
+
+
+def main(argv):
+    if argv and argv[0] == 'compare':
+        benchutil.compare_main(argv[1:], METRICS)
+
+    parser = argparse.ArgumentParser(
+        description = 'Loopback throughput of the UDT bindings.')
+    parser.add_argument('--sizes', default = DEFAULT_SIZES,
+                        help = 'payload sizes (default: %s)' % DEFAULT_SIZES)
+    parser.add_argument('--bytes', type = parse_size, default = 16 << 20,
+                        help = 'bytes transferred per payload size '
+                               '(default: 16M)')
+    parser.add_argument('--modes', default = 'stream,message',
+                        help = 'stream, message or both')
+    parser.add_argument('--max-message', type = parse_size, default = 1 << 20,
+                        help = 'largest message size (default: 1M)')
+    parser.add_argument('--impls', default = 'udt4_ext,legacy',
+                        help = 'bindings to measure (default: both)')
+    parser.add_argument('--port', type = int, default = 9100,
+                        help = 'first loopback port (default: 9100)')
+    benchutil.add_impair_argument(parser)
+    benchutil.add_arguments(parser)
+    args = parser.parse_args(argv)
+
+    results = []
+    port = args.port
+    for impl_type in (Pyudt, Legacy):
+        if impl_type.name not in args.impls.split(','):
+            continue
+        try:
+            impl = impl_type()
+        except ImportError as e:
+            print('Skipping %s: %s' % (impl_type.name, e), file = sys.stderr)
+            continue
+        results += run(impl, args, port)
+        port += 10
+
+    if args.native:
+        native = benchutil.run_native(args.native, 'throughput', [
+            '--sizes', args.sizes, '--bytes', str(args.bytes),
+            '--modes', args.modes, '--max-message', str(args.max_message),
+            '--port', str(port)])
+        for r in native:
+            benchutil.print_result(r)
+        results += native
+
+    benchutil.finish(args, results, METRICS)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
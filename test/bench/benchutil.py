@@ -0,0 +1,317 @@
+"""
+Shared helpers of the benchmark drivers: native driver invocation, report
+files with machine information, and regression checks between two reports.
+
+A report is a JSON object:
+
+    {
+        "meta":    {"git": {...}, "machine": {...}, "date": ...},
+        "results": [{"bench": ..., "params": {...}, "metrics": {...}}, ...]
+    }
+"""
+
+from __future__ import print_function
+
+import json
+import os
+import platform
+import socket
+import subprocess
+import sys
+import time
+
+
+def git_info():
+    """
+    Return the revision of the source tree and whether it has local changes.
+    """
+    root = os.path.dirname(os.path.abspath(__file__))
+    try:
+        rev = subprocess.check_output(['git', 'rev-parse', 'HEAD'], cwd = root)
+        status = subprocess.check_output(['git', 'status', '--porcelain',
+                                          '--untracked-files=no'], cwd = root)
+    except (OSError, subprocess.CalledProcessError):
+        return { 'revision': None, 'dirty': None }
+    return { 'revision': rev.decode('ascii').strip(),
+             'dirty':    bool(status.strip()) }
+
+
+def _cpu_model():
+    try:
+        with open('/proc/cpuinfo') as f:
+            for line in f:
+                if line.startswith('model name'):
+                    return line.split(':', 1)[1].strip()
+    except IOError:
+        pass
+    return platform.processor()
+
+
+def machine_info():
+    """
+    Return the information needed to tell whether two reports are comparable.
+    """
+    info = { 'hostname':  socket.gethostname(),
+             'platform':  platform.platform(),
+             'machine':   platform.machine(),
+             'cpu':       _cpu_model(),
+             'cpu_count': _cpu_count(),
+             'python':    platform.python_version() }
+    try:
+        import pyudt
+        info['pyudt_probes'] = pyudt.HAVE_PROBES
+    except ImportError:
+        pass
+    return info
+
+
+def _cpu_count():
+    try:
+        import multiprocessing
+        return multiprocessing.cpu_count()
+    except (ImportError, NotImplementedError):
+        return None
+
+
+def run_native(path, bench, options):
+    """
+    Run a benchmark of the native driver (pyudt_bench target).
+
+    :param path:    path of the pyudt_bench executable.
+    :param bench:   benchmark name.
+    :param options: list of command line options.
+    :return: list of results.
+    """
+    out = subprocess.check_output([path, bench] + list(options))
+    return [json.loads(line) for line in out.decode('utf-8').splitlines()
+            if line.strip()]
+
+
+def result(bench, params, metrics):
+    return { 'bench': bench, 'params': params, 'metrics': metrics }
+
+
+def print_result(r):
+    params = ' '.join('%s=%s' % (k, r['params'][k])
+                      for k in sorted(r['params']))
+    metrics = ' '.join('%s=%.4g' % (k, r['metrics'][k])
+                       for k in sorted(r['metrics']))
+    print('%-12s %-50s %s' % (r['bench'], params, metrics), file = sys.stderr)
+
+
+class Histogram(object):
+    """
+    Log-linear histogram with the bucket layout of pyudt4::Histogram, so that
+    the percentiles of the Python and native drivers are comparable.
+    """
+    sub_bits = 3
+    sub_count = 1 << sub_bits
+    max_exponent = 40
+    bucket_count = (max_exponent - sub_bits + 1) * sub_count
+    max_value = (1 << max_exponent) - 1
+
+    def __init__(self):
+        self.counts = [0] * self.bucket_count
+        self.total = 0
+        self.sum = 0
+        self.max = 0
+
+    @classmethod
+    def bucket(cls, value):
+        if value < cls.sub_count:
+            return value
+        value = min(value, cls.max_value)
+        shift = value.bit_length() - 1 - cls.sub_bits
+        return (shift + 1) * cls.sub_count + (value >> shift) - cls.sub_count
+
+    @classmethod
+    def upper_bound(cls, bucket):
+        if bucket + 1 >= cls.bucket_count:
+            return cls.max_value
+        bucket += 1
+        if bucket < cls.sub_count:
+            return bucket - 1
+        shift = bucket // cls.sub_count - 1
+        return ((bucket % cls.sub_count + cls.sub_count) << shift) - 1
+
+    def record(self, value):
+        value = int(value)
+        self.counts[self.bucket(value)] += 1
+        self.total += 1
+        self.sum += value
+        self.max = max(self.max, value)
+
+    def merge(self, other):
+        for i, c in enumerate(other.counts):
+            self.counts[i] += c
+        self.total += other.total
+        self.sum += other.sum
+        self.max = max(self.max, other.max)
+
+    def quantile(self, q):
+        if self.total == 0:
+            return 0
+        rank = min(int(q * self.total), self.total - 1)
+        seen = 0
+        for i, c in enumerate(self.counts):
+            seen += c
+            if seen > rank:
+                return min(self.upper_bound(i), self.max)
+        return self.max
+
+    def metrics(self, scale, unit, prefix = ''):
+        """
+        Return the metrics reported by Result::histogram in the native driver.
+        """
+        res = { 'count': self.total,
+                'mean_' + unit: scale * self.sum / self.total
+                                if self.total else 0.,
+                'max_' + unit: scale * self.max }
+        for name, q in (('p50', 0.5), ('p90', 0.9), ('p99', 0.99),
+                        ('p999', 0.999)):
+            res[name + '_' + unit] = scale * self.quantile(q)
+        return dict((prefix + k, v) for k, v in res.items())
+
+
+def parse_impairment(spec):
+    """
+    Parse "delay_ms=20,loss=0.01" into the dict of pyudt.ImpairmentProxy.
+    """
+    params = {}
+    for item in spec.split(','):
+        if item.strip():
+            name, value = item.split('=', 1)
+            params[name.strip()] = float(value)
+    return params
+
+
+def start_proxy(target_port, spec, seed = 1):
+    """
+    Start an in-process impairment proxy in front of a loopback port.
+
+    :param spec: impairments applied to both directions, see
+                 parse_impairment().
+    :return: the running proxy; connect to proxy.port() instead of
+             target_port.
+    """
+    import pyudt
+    proxy = pyudt.ImpairmentProxy('127.0.0.1', target_port, '127.0.0.1', 0,
+                                  seed)
+    proxy.configure(parse_impairment(spec))
+    proxy.start()
+    return proxy
+
+
+def write_report(path, results):
+    report = { 'meta': { 'git':     git_info(),
+                         'machine': machine_info(),
+                         'date':    time.strftime('%Y-%m-%dT%H:%M:%S%z') },
+               'results': results }
+    if path == '-':
+        json.dump(report, sys.stdout, indent = 1, sort_keys = True)
+        print()
+    else:
+        with open(path, 'w') as f:
+            json.dump(report, f, indent = 1, sort_keys = True)
+
+
+def load_report(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def _key(r):
+    return (r['bench'],) + tuple(sorted(r['params'].items()))
+
+
+def compare(current, baseline, metrics, threshold):
+    """
+    Compare two lists of results and print the differences.
+
+    :param metrics:   dict of the compared metrics: name -> 1 if higher is
+                      better, -1 if lower is better.
+    :param threshold: relative change flagged as a regression.
+    :return: number of regressions.
+    """
+    old = dict((_key(r), r) for r in baseline)
+    regressions = 0
+
+    for r in current:
+        base = old.get(_key(r))
+        if base is None:
+            continue
+
+        for name, direction in sorted(metrics.items()):
+            if name not in r['metrics'] or name not in base['metrics']:
+                continue
+            new_value = float(r['metrics'][name])
+            old_value = float(base['metrics'][name])
+            if old_value == 0:
+                continue
+
+            change = (new_value - old_value) / old_value
+            regressed = change * direction < -threshold
+            regressions += regressed
+
+            params = ' '.join('%s=%s' % kv for kv in _key(r)[1:])
+            print('%-10s %-12s %-45s %12.4g -> %12.4g  %+7.1f%%' % (
+                  'REGRESSION' if regressed else 'ok', r['bench'], params,
+                  old_value, new_value, 100 * change))
+
+    return regressions
+
+
+def add_impair_argument(parser):
+    """
+    Add the --impair option of the drivers relaying their connections
+    through an impairment proxy (the native driver is never impaired).
+    """
+    parser.add_argument('--impair', metavar = 'SPEC',
+                        help = 'relay the connections through an impairment '
+                               'proxy, e.g. delay_ms=20,loss=0.01')
+
+
+def add_arguments(parser):
+    """
+    Add the options shared by every driver.
+    """
+    parser.add_argument('-o', '--output', default = '-',
+                        help = 'report file (default: stdout)')
+    parser.add_argument('--native', metavar = 'PYUDT_BENCH',
+                        help = 'also run the native driver (pyudt_bench)')
+    parser.add_argument('--compare', metavar = 'BASELINE',
+                        help = 'compare with a previous report and exit with '
+                               'status 1 on regressions')
+    parser.add_argument('--threshold', type = float, default = 0.05,
+                        help = 'relative change flagged as a regression '
+                               '(default: 0.05)')
+
+
+def finish(args, results, metrics):
+    """
+    Write the report and compare it with the baseline, if any.
+    """
+    write_report(args.output, results)
+
+    if args.compare:
+        baseline = load_report(args.compare)['results']
+        if compare(results, baseline, metrics, args.threshold):
+            sys.exit(1)
+
+
+def compare_main(argv, metrics):
+    """
+    Compare two existing reports: compare CURRENT BASELINE [--threshold T]
+    """
+    import argparse
+
+    parser = argparse.ArgumentParser(description = 'Compare two reports.')
+    parser.add_argument('current')
+    parser.add_argument('baseline')
+    parser.add_argument('--threshold', type = float, default = 0.05)
+    args = parser.parse_args(argv)
+
+    regressions = compare(load_report(args.current)['results'],
+                          load_report(args.baseline)['results'],
+                          metrics, args.threshold)
+    sys.exit(1 if regressions else 0)
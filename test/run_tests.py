@@ -4,6 +4,53 @@ import sys
 import unittest
 import pyudt
 import socket as socklib
+import os
+import subprocess
+import tempfile
+import time
+from threading import Thread
+from pyudt import ringfile
+from pyudt import trace2json
+
+def new_socket(type = None):
+    if type is None:
+        return pyudt.Socket()
+    return pyudt.Socket(pyudt.AF_INET, type, 0)
+
+def connected_pair(port, type = None, setup = None, via = None):
+    """
+    Return a (client, server-side) pair of connected sockets on loopback.
+    setup(server, client) is called before the sockets are bound and
+    connected, and the client connects to port via (e.g. a proxy) if given.
+    """
+    server = new_socket(type)
+    client = new_socket(type)
+    if setup is not None:
+        setup(server, client)
+
+    server.bind('127.0.0.1', port)
+    server.listen(10)
+
+    accepted = []
+    t = Thread(target = lambda: accepted.append(server.accept()[0]))
+    t.start()
+
+    client.connect('127.0.0.1', port if via is None else via)
+    t.join()
+    server.close()
+
+    return client, accepted[0]
+
+def recv_exactly(sock, n):
+    """
+    Receive exactly n bytes from a connected socket.
+    """
+    buf = bytearray(n)
+    view = memoryview(buf)
+    received = 0
+    while received < n:
+        received += sock.recv_into(view[received:])
+    return bytes(buf)
 
 # Test fixture for the Socket class
 class SocketTest(unittest.TestCase):
@@ -12,6 +59,9 @@ class SocketTest(unittest.TestCase):
         self.destruction()
         self.close()
         self.descriptor()
+        self.rendezvous()
+        self.sockopt()
+        self.profiles()
 
     def creation(self):
         socket = pyudt.Socket()
@@ -35,6 +85,39 @@ class SocketTest(unittest.TestCase):
         socket = pyudt.Socket()
         assert socket.descriptor() != 0
 
+    def rendezvous(self):
+        socket = pyudt.Socket()
+        assert socket.rendezvous() == False
+        socket.rendezvous(True)
+        assert socket.rendezvous() == True
+
+    def sockopt(self):
+        socket = pyudt.Socket()
+        socket.setsockopt(pyudt.UDT_MSS, 1400)
+        assert socket.getsockopt(pyudt.UDT_MSS) == 1400
+        socket.setsockopt(pyudt.UDT_MAXBW, 1000000)
+        assert socket.getsockopt(pyudt.UDT_MAXBW) == 1000000
+        socket.setsockopt(pyudt.UDT_REUSEADDR, False)
+        assert socket.getsockopt(pyudt.UDT_REUSEADDR) == False
+        self.assertRaises(TypeError, socket.setsockopt, pyudt.UDT_MSS, 10)
+        self.assertRaises(TypeError, socket.setsockopt, pyudt.UDT_STATE, 1)
+
+    def profiles(self):
+        assert 'wan_high_bdp' in pyudt.profiles()
+        for name, values in pyudt.profiles().items():
+            socket = pyudt.Socket()
+            socket.apply_profile(name)
+            for opt in ('UDT_MSS', 'UDT_FC', 'UDP_SNDBUF', 'UDP_RCVBUF',
+                        'UDT_MAXBW'):
+                assert socket.getsockopt(getattr(pyudt, opt)) == values[opt]
+            # UDT rounds the buffers down to whole packets
+            payload = values['UDT_MSS'] - 28
+            for opt in ('UDT_SNDBUF', 'UDT_RCVBUF'):
+                size = socket.getsockopt(getattr(pyudt, opt))
+                assert 0 <= values[opt] - size < payload, (name, opt, size)
+        socket = pyudt.Socket()
+        self.assertRaises(TypeError, socket.apply_profile, 'unknown')
+
 # Test fixture for the Epoll class
 class EpollTest(unittest.TestCase):
     def runTest(self):
@@ -49,6 +132,7 @@ class EpollTest(unittest.TestCase):
         self.get_id()
         self.garbage_collect()
         self.get_read_udt()
+        self.perfmon_all()
 
     def creation(self):
         epoll = pyudt.Epoll()
@@ -131,6 +215,895 @@ class EpollTest(unittest.TestCase):
         except:
             self.fail('Error in Epoll.get_read_udt:\n' + str(sys.exc_info()[1]))
 
+    def perfmon_all(self):
+        epoll = pyudt.Epoll()
+        epoll.add_usock(pyudt.Socket())
+        epoll.add_usock(pyudt.Socket())
+        itemsize = pyudt.perfmon_record_layout()['itemsize']
+        assert epoll.perfmon_all(bytearray(2 * itemsize)) == 2
+        assert epoll.perfmon_all(bytearray(itemsize), True) == 1
+
+# Test fixture for the Multiplexer class
+class MultiplexerTest(unittest.TestCase):
+    def runTest(self):
+        self.creation()
+        self.socket()
+        self.stats()
+
+    def creation(self):
+        mux = pyudt.Multiplexer('127.0.0.1', 0)
+        assert mux.port() != 0
+        assert mux.udp_socket() >= 0
+
+    def socket(self):
+        mux = pyudt.Multiplexer()
+        try:
+            s1 = mux.socket()
+            s2 = mux.socket()
+        except:
+            self.fail('Error in Multiplexer.socket\n' + str(sys.exc_info()[1]))
+        assert s1.descriptor() != s2.descriptor()
+
+    def stats(self):
+        mux = pyudt.Multiplexer()
+        socket = mux.socket()
+        stats = mux.stats()
+        assert stats['sockets_created'] == 1
+        assert stats['sockets_active'] == 1
+        assert stats['bind_errors'] == 0
+
+# Test fixture for the SO_REUSEPORT helpers
+class ReusePortTest(unittest.TestCase):
+    def runTest(self):
+        self.group()
+        self.bind_to_udp()
+
+    def group(self):
+        fd1 = pyudt.reuseport_socket('127.0.0.1', 0)
+        port = socklib.fromfd(fd1, socklib.AF_INET, socklib.SOCK_DGRAM).getsockname()[1]
+        try:
+            fd2 = pyudt.reuseport_socket('127.0.0.1', port)
+            pyudt.attach_reuseport_bpf(fd1, 2)
+        except:
+            self.fail('Error in SO_REUSEPORT group\n' + str(sys.exc_info()[1]))
+
+    def bind_to_udp(self):
+        fd = pyudt.reuseport_socket('127.0.0.1', 0)
+        socket = pyudt.Socket()
+        try:
+            socket.bind_to_udp(fd)
+            socket.listen(10)
+        except:
+            self.fail('Error in Socket.bind_to_udp\n' + str(sys.exc_info()[1]))
+
+# Test fixture for the parallel rendez-vous setup
+class RendezvousTest(unittest.TestCase):
+    def runTest(self):
+        self.empty()
+        self.pair()
+
+    def empty(self):
+        assert pyudt.rendezvous_many([], 0) == []
+
+    def pair(self):
+        results = {}
+        connected = []
+
+        def peer(local_port, remote_port):
+            results[local_port] = pyudt.rendezvous_many(
+                    [('127.0.0.1', remote_port)], local_port,
+                    lambda p, s: connected.append(p), 5000)
+
+        threads = [Thread(target = peer, args = (5101, 5102)),
+                   Thread(target = peer, args = (5102, 5101))]
+        for t in threads: t.start()
+        for t in threads: t.join()
+
+        assert results[5101][0] != None
+        assert results[5102][0] != None
+        assert len(connected) == 2
+
+# Test fixture for the Tuner class
+class TunerTest(unittest.TestCase):
+    def runTest(self):
+        self.start_stop()
+        self.register()
+        self.prepare()
+
+    def start_stop(self):
+        tuner = pyudt.Tuner(10)
+        tuner.start()
+        tuner.stop()
+
+    def register(self):
+        tuner = pyudt.Tuner()
+        socket = pyudt.Socket()
+        epoll = pyudt.Epoll()
+        epoll.add_usock(pyudt.Socket())
+        tuner.add(socket)
+        tuner.add_epoll(epoll)
+        assert len(tuner.stats()['sockets']) == 2
+        tuner.remove(socket)
+        assert len(tuner.stats()['sockets']) == 1
+
+    def prepare(self):
+        tuner = pyudt.Tuner(max_memory=6 << 20)
+        socket = pyudt.Socket()
+        # Unknown link: UDT's defaults are kept, within the budget
+        buffer = tuner.prepare(socket, '127.0.0.1')
+        assert 0 < buffer <= 3 << 20
+        assert socket.getsockopt(pyudt.UDT_SNDBUF) <= buffer
+        assert tuner.stats()['memory'] == 2 * buffer
+        # Sizing it again replaces its share of the budget
+        assert tuner.prepare(socket, '127.0.0.1') == buffer
+        self.assertRaises(TypeError, tuner.prepare, pyudt.Socket(), '127.0.0.1')
+
+# Test fixture for performance monitoring
+class PerfmonTest(unittest.TestCase):
+    def runTest(self):
+        self.layout()
+        self.unconnected()
+        self.snapshot()
+
+    def layout(self):
+        layout = pyudt.perfmon_layout()
+        assert 'msRTT' in layout['names']
+        assert len(layout['names']) == len(layout['offsets'])
+
+    def unconnected(self):
+        socket = pyudt.Socket()
+        self.assertRaises(TypeError, socket.perfmon)
+
+    def snapshot(self):
+        client, peer = connected_pair(5201)
+        client.send('word', 4)
+        perf = client.perfmon()
+        assert perf.pktSentTotal >= 0
+        assert client.perfmon(True).msTimeStamp >= perf.msTimeStamp
+
+        buf = bytearray(pyudt.perfmon_layout()['itemsize'])
+        client.perfmon_into(buf)
+        self.assertRaises(TypeError, client.perfmon_into, bytearray(4))
+
+# Test fixture for the telemetry sampler
+class SamplerTest(unittest.TestCase):
+    def runTest(self):
+        self.empty()
+        self.history()
+        self.replace()
+
+    def empty(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            sampler = pyudt.Sampler(path, 16, 10)
+            with ringfile.RingReader(path) as reader:
+                assert reader.capacity == 16
+                assert reader.written() == 0
+                assert 'msRTT' in reader.names
+                assert list(reader.records()) == []
+        finally:
+            os.remove(path)
+
+    def history(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            client, peer = connected_pair(5301)
+            sampler = pyudt.Sampler(path, 4, 10)
+            sampler.add(client)
+            sampler.start()
+            assert sampler.running()
+            time.sleep(0.2)
+            sampler.stop()
+
+            # The ring only keeps the last 4 records
+            assert sampler.written() > 4
+            with ringfile.RingReader(path) as reader:
+                records = list(reader.records())
+                assert len(records) == 4
+                assert records[-1]['descriptor'] == client.descriptor()
+                assert records[0]['timestamp_us'] <= records[-1]['timestamp_us']
+        finally:
+            os.remove(path)
+
+    def replace(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            sampler = pyudt.Sampler(path, 16, 10)
+            with ringfile.RingReader(path) as reader:
+                # A new, smaller ring replaces the file under the reader
+                sampler = pyudt.Sampler(path, 4, 10)
+                assert reader.capacity == 16
+                assert list(reader.records()) == []
+            with ringfile.RingReader(path) as reader:
+                assert reader.capacity == 4
+            assert not [f for f in os.listdir(os.path.dirname(path))
+                        if f.startswith(os.path.basename(path) + '.')]
+        finally:
+            os.remove(path)
+
+# Test fixture for the OpenMetrics exporter
+class MetricsExporterTest(unittest.TestCase):
+    def runTest(self):
+        self.counters()
+        self.render()
+        self.scrape()
+
+    def counters(self):
+        created = pyudt.counters()['sockets_created']
+        socket = pyudt.Socket()
+        assert pyudt.counters()['sockets_created'] == created + 1
+
+    def render(self):
+        client, peer = connected_pair(5401)
+        exporter = pyudt.MetricsExporter()
+        exporter.add(client)
+        text = exporter.render()
+        assert 'pyudt_socket_rtt_seconds{socket="%d"' % client.descriptor() in text
+        assert 'pyudt_peer_sockets{peer="127.0.0.1"} 1' in text
+        assert text.endswith('# EOF\n')
+
+        # The rates cover the time since the previous scrape
+        def send_rate(text):
+            prefix = 'pyudt_socket_send_rate_mbps{socket="%d"' % \
+                     client.descriptor()
+            for line in text.splitlines():
+                if line.startswith(prefix):
+                    return float(line.split()[-1])
+        data = os.urandom(1 << 20)
+        client.sendall(data)
+        assert recv_exactly(peer, len(data)) == data
+        assert send_rate(exporter.render()) > 0
+        time.sleep(0.1)
+        assert send_rate(exporter.render()) == 0
+
+    def scrape(self):
+        exporter = pyudt.MetricsExporter('127.0.0.1', 0)
+        exporter.start()
+        try:
+            conn = socklib.create_connection(('127.0.0.1', exporter.port()))
+            conn.sendall(b'GET /metrics HTTP/1.0\r\n\r\n')
+            response = b''
+            while True:
+                data = conn.recv(4096)
+                if not data:
+                    break
+                response += data
+            conn.close()
+            assert response.startswith(b'HTTP/1.0 200 OK')
+            assert b'pyudt_call_bytes_total{call="send"}' in response
+        finally:
+            exporter.stop()
+
+# Test fixture for the binding-overhead statistics
+class StatsTest(unittest.TestCase):
+    def runTest(self):
+        self.reset()
+        self.calls()
+        self.gil()
+
+    def reset(self):
+        pyudt.reset_stats()
+        stats = pyudt.stats()
+        for call in ('send', 'recv', 'accept', 'connect', 'epoll_wait'):
+            assert stats[call]['calls'] == 0
+
+    def calls(self):
+        pyudt.reset_stats()
+        client, peer = connected_pair(5501)
+        client.send('word', 4)
+        peer.recv(4)
+
+        stats = pyudt.stats()
+        assert stats['connect']['calls'] == 1
+        assert stats['accept']['calls'] == 1
+        assert stats['send']['bytes'] == 4
+        assert stats['recv']['bytes'] == 4
+
+        inside = stats['recv']['inside']
+        assert inside['count'] == 1
+        assert inside['p50'] <= inside['max'] + 1e-9
+
+    def gil(self):
+        client, peer = connected_pair(5502)
+        pyudt.set_gil_tracking(True, 0)
+        try:
+            assert pyudt.gil_tracking()
+            pyudt.reset_stats()
+            client.send('word', 4)
+            peer.recv(4)
+            stats = pyudt.stats()
+            assert stats['send']['gil']['count'] == 1
+            assert stats['recv']['gil']['count'] == 1
+            assert stats['recv']['gil_slow'] <= 1
+        finally:
+            pyudt.set_gil_tracking(False)
+
+        pyudt.reset_stats()
+        client.send('word', 4)
+        assert pyudt.stats()['send']['gil']['count'] == 0
+
+# Test fixture for message mode and its latency histograms
+class MessageTest(unittest.TestCase):
+    def runTest(self):
+        self.plain()
+        self.timestamped()
+
+    def plain(self):
+        client, peer = connected_pair(5601, pyudt.SOCK_DGRAM)
+        assert client.sendmsg(b'hello') == 5
+        assert peer.recvmsg(64) == b'hello'
+        assert peer.latency()['count'] == 0
+
+    def timestamped(self):
+        client, peer = connected_pair(5602, pyudt.SOCK_DGRAM)
+        client.timestamping(True)
+        peer.timestamping(True)
+        for i in range(10):
+            assert client.sendmsg(b'hello', -1, True) == 5
+            assert peer.recvmsg(64) == b'hello'
+
+        latency = peer.latency()
+        assert latency['count'] == 10
+        assert latency['p99'] <= latency['max'] + 1e-9
+        peer.reset_latency()
+        assert peer.latency()['count'] == 0
+
+        # An unstamped message is returned whole, and counted apart
+        client.timestamping(False)
+        client.sendmsg(b'x' * 64, -1, True)
+        assert peer.recvmsg(64) == b'x' * 64
+        assert peer.latency()['count'] == 0
+        assert peer.latency()['unstamped'] == 1
+
+# Test fixture for the preallocated UDT exceptions
+class ErrorsTest(unittest.TestCase):
+    def runTest(self):
+        self.hierarchy()
+        self.routine()
+
+    def hierarchy(self):
+        assert issubclass(pyudt.UDTError, TypeError)
+        assert issubclass(pyudt.WouldBlockError, pyudt.UDTError)
+        assert issubclass(pyudt.UDTTimeoutError, pyudt.UDTError)
+
+    def routine(self):
+        client, peer = connected_pair(5801)
+        errors = pyudt.counters()['udt_errors']
+        would_block = pyudt.counters()['would_block']
+
+        peer.setsockopt(pyudt.UDT_RCVSYN, False)
+        try:
+            peer.recv(4)
+            assert False, 'recv should have raised WouldBlockError'
+        except pyudt.WouldBlockError as e:
+            assert e.args[0] == 6002 # EASYNCRCV
+
+        peer.setsockopt(pyudt.UDT_RCVSYN, True)
+        peer.setsockopt(pyudt.UDT_RCVTIMEO, 10)
+        self.assertRaises(pyudt.UDTTimeoutError, peer.recv, 4)
+
+        assert pyudt.counters()['udt_errors'] == errors + 1
+        assert pyudt.counters()['would_block'] == would_block + 1
+
+        # Other errors are UDTErrors carrying their code
+        try:
+            pyudt.Socket().send('ping', 4)
+            assert False, 'send should have raised UDTError'
+        except pyudt.UDTError as e:
+            assert e.args[0] == 2002 # ENOCONN
+
+# Test fixture for the non-blocking calls and deadlines
+class NonBlockingTest(unittest.TestCase):
+    def runTest(self):
+        self.modes()
+        self.try_calls()
+        self.deadlines()
+
+    def modes(self):
+        socket = pyudt.Socket()
+        socket.setblocking(False)
+        assert socket.getsockopt(pyudt.UDT_SNDSYN) == False
+        assert socket.getsockopt(pyudt.UDT_RCVSYN) == False
+        socket.settimeout(0.5)
+        assert socket.getsockopt(pyudt.UDT_RCVSYN) == True
+        assert socket.getsockopt(pyudt.UDT_RCVTIMEO) == 500
+        socket.settimeout(None)
+        assert socket.getsockopt(pyudt.UDT_SNDTIMEO) == -1
+        self.assertRaises(TypeError, socket.settimeout, -1)
+
+    def try_calls(self):
+        client, peer = connected_pair(5901)
+        buf = bytearray(16)
+        assert peer.try_recv_into(buf) == -1
+        assert client.try_send(b'hello') == 5
+
+        limit = time.time() + 1
+        received = -1
+        while received < 0 and time.time() < limit:
+            received = peer.try_recv_into(buf)
+        assert received == 5
+        assert bytes(buf[:5]) == b'hello'
+
+        # The mode of the socket is never changed
+        assert peer.getsockopt(pyudt.UDT_RCVSYN) == True
+        assert peer.try_recv_into(buf) == -1
+
+    def deadlines(self):
+        client, peer = connected_pair(5902)
+        buf = bytearray(16)
+        self.assertRaises(pyudt.UDTTimeoutError, peer.recv_into, buf, 0,
+                          pyudt.monotonic() + 0.05)
+        assert client.sendall(b'world', pyudt.monotonic() + 1) == 5
+        assert peer.recv_into(buf, 5, pyudt.monotonic() + 1) == 5
+        assert bytes(buf[:5]) == b'world'
+        assert peer.getsockopt(pyudt.UDT_RCVTIMEO) == -1
+
+        # A receive blocked on the socket does not hold up sendall()
+        replies = []
+        t = Thread(target = lambda: replies.append(client.recv(4)))
+        t.start()
+        time.sleep(0.1)
+        start = time.time()
+        assert client.sendall(b'ping', pyudt.monotonic() + 2) == 4
+        assert time.time() - start < 1
+        assert recv_exactly(peer, 4) == b'ping'
+        peer.send('pong', 4)
+        t.join()
+        assert replies == [b'pong']
+
+        # Non-blocking socket: sendall() still sends everything
+        client.setblocking(False)
+        data = os.urandom(1 << 20)
+        assert client.sendall(data) == len(data)
+        assert client.getsockopt(pyudt.UDT_SNDSYN) == False
+
+# Test fixture for the binary event trace
+class TraceTest(unittest.TestCase):
+    def runTest(self):
+        self.disabled()
+        self.calls()
+        self.exited_threads()
+
+    def disabled(self):
+        assert not pyudt.tracing()
+
+    def calls(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            pyudt.set_tracing(True, 1024)
+            assert pyudt.tracing()
+            client, peer = connected_pair(5701)
+            client.send('word', 4)
+            peer.recv(4)
+            pyudt.set_tracing(False)
+
+            assert pyudt.dump_trace(path) > 0
+            trace = trace2json.Trace(path)
+            events = [e for _, _, thread in trace.threads for e in thread]
+            kinds = set((e[1], e[2]) for e in events if e[1] == 'call_end')
+            assert ('call_end', 'send') in kinds
+            assert ('call_end', 'recv') in kinds
+            assert 'socket_accept' in [e[1] for e in events]
+
+            json_events = trace2json.to_events(trace)
+            assert any(e['ph'] == 'B' and e['name'] == 'send'
+                       for e in json_events)
+
+            pyudt.clear_trace()
+            assert pyudt.dump_trace(path) == 0
+        finally:
+            pyudt.set_tracing(False)
+            os.remove(path)
+
+    def exited_threads(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+
+        def tids():
+            pyudt.dump_trace(path)
+            return set(tid for tid, _, _ in trace2json.Trace(path).threads)
+
+        try:
+            pyudt.set_tracing(True, 1024)
+            pyudt.Socket().close()
+            before = tids()
+
+            worker = Thread(target = lambda: pyudt.Socket().close())
+            worker.start()
+            worker.join()
+            time.sleep(0.1)
+
+            # The ring of the exited thread is dumped once, then freed
+            exited = tids() - before
+            assert len(exited) == 1
+            assert not tids() & exited
+        finally:
+            pyudt.set_tracing(False)
+            os.remove(path)
+
+# Test fixture for the static USDT probes
+class ProbesTest(unittest.TestCase):
+    probes = ('send_entry', 'send_return', 'recv_entry', 'recv_return',
+              'accept_entry', 'accept_return', 'connect_entry',
+              'connect_return', 'close_entry', 'close_return',
+              'epoll_wait_entry', 'epoll_wait_return')
+
+    def runTest(self):
+        if not pyudt.HAVE_PROBES:
+            self.skipTest('udt4_ext was built without sys/sdt.h')
+        try:
+            notes = subprocess.check_output(
+                ['readelf', '-n', pyudt.udt4_ext.__file__])
+        except OSError:
+            self.skipTest('readelf is not available')
+        self.notes(notes.decode('ascii', 'replace'))
+
+    def notes(self, notes):
+        # Every probe is described by a stapsdt note of the module
+        found = [probe for probe in self.probes
+                 if ('Provider: pyudt' in notes
+                     and ('Name: %s\n' % probe) in notes)]
+        assert found, 'no pyudt probe in %s' % pyudt.udt4_ext.__file__
+        missing = [probe for probe in self.probes if probe not in found]
+        assert not missing, missing
+
+# Test fixture for the logging controls
+class LoggerTest(unittest.TestCase):
+    def runTest(self):
+        self.level()
+        self.asynchronous()
+
+    def level(self):
+        previous = pyudt.Logger.level()
+        pyudt.Logger.set_level('ERROR')
+        assert pyudt.Logger.level() == 'ERROR'
+        self.assertRaises(TypeError, pyudt.Logger.set_level, 'VERBOSE')
+        assert pyudt.Logger.level() == 'ERROR'
+        pyudt.Logger.set_level(previous)
+        assert pyudt.Logger.level() == previous
+
+    def asynchronous(self):
+        pyudt.Logger.set_async(True)
+        assert pyudt.Logger.is_async()
+        pyudt.Logger.set_async(False)
+        assert not pyudt.Logger.is_async()
+        assert pyudt.Logger.dropped() >= 0
+
+# Test fixture for the impairment proxy
+class ImpairmentProxyTest(unittest.TestCase):
+    def runTest(self):
+        self.configure()
+        self.relay()
+
+    def configure(self):
+        proxy = pyudt.ImpairmentProxy('127.0.0.1', 6001)
+        proxy.configure({ 'delay_ms': 10, 'loss': 0.1 }, 'forward')
+        assert proxy.impairment('forward')['delay_ms'] == 10
+        assert proxy.impairment('forward')['loss'] == 0.1
+        assert proxy.impairment('reverse')['delay_ms'] == 0
+        self.assertRaises(TypeError, proxy.configure, { 'unknown': 1 })
+        self.assertRaises(TypeError, proxy.configure, { 'loss': 2 })
+        self.assertRaises(TypeError, proxy.configure, {}, 'sideways')
+
+    def relay(self):
+        proxy = pyudt.ImpairmentProxy('127.0.0.1', 6002)
+        proxy.configure({ 'delay_ms': 20 })
+        proxy.start()
+        try:
+            client, peer = connected_pair(6002, via = proxy.port())
+
+            # Round trip through both delayed directions
+            start = time.time()
+            client.send('ping', 4)
+            assert peer.recv(4) == b'ping'
+            peer.send('pong', 4)
+            assert client.recv(4) == b'pong'
+            assert time.time() - start >= 0.04
+
+            # UDT recovers the lost packets
+            proxy.configure({ 'loss': 0.05 }, 'forward')
+            data = os.urandom(256 << 10)
+            client.sendall(data)
+            assert recv_exactly(peer, len(data)) == data
+
+            stats = proxy.stats()
+            assert stats['forward']['lost'] > 0
+            assert stats['reverse']['sent'] > 0
+
+            client.close()
+            peer.close()
+        finally:
+            proxy.stop()
+
+class CongestionControlTest(unittest.TestCase):
+    def runTest(self):
+        self.algorithms()
+        self.select()
+        self.scavenger()
+
+    def algorithms(self):
+        algorithms = pyudt.congestion_controls()
+        for name in ('udt', 'fixed_rate', 'bbr', 'ledbat'):
+            assert name in algorithms
+        assert algorithms['fixed_rate']['params']['rate_mbps'] > 0
+
+        socket = new_socket()
+        self.assertRaises(TypeError, socket.set_congestion_control, 'unknown')
+        self.assertRaises(TypeError, socket.set_congestion_control,
+                          'bbr', { 'unknown': 1 })
+        for name, params in (('fixed_rate', { 'rate_mbps': 0 }),
+                             ('bbr', { 'cwnd_gain': -1 }),
+                             ('ledbat', { 'max_cwnd_pkts': -2 }),
+                             ('ledbat', { 'target_ms': float('nan') })):
+            self.assertRaises(ValueError, socket.set_congestion_control,
+                              name, params)
+        socket.set_congestion_control('ledbat', { 'max_cwnd_pkts': 0 })
+        socket.close()
+
+    def select(self):
+        def setup(server, client):
+            server.set_congestion_control('fixed_rate', { 'rate_mbps': 200 })
+            client.set_congestion_control('bbr')
+        client, peer = connected_pair(6101, setup = setup)
+
+        data = os.urandom(256 << 10)
+        client.sendall(data)
+        peer.sendall(data)
+        assert recv_exactly(client, len(data)) == data
+
+        state = peer.congestion_control()
+        assert state['algorithm'] == 'fixed_rate'
+        assert state['rate_mbps'] == 200
+        state = client.congestion_control()
+        assert state['algorithm'] == 'bbr'
+        assert state['mode'] in ('startup', 'drain', 'probe_bw', 'probe_rtt')
+
+        # Too late once connected
+        self.assertRaises(Exception, client.set_congestion_control, 'udt')
+
+        client.close()
+        peer.close()
+
+    def scavenger(self):
+        def setup(server, client):
+            client.set_congestion_control('ledbat', { 'target_ms': 5 })
+        client, peer = connected_pair(6102, setup = setup)
+
+        data = os.urandom(256 << 10)
+        client.sendall(data)
+        assert recv_exactly(peer, len(data)) == data
+
+        state = client.congestion_control()
+        assert state['algorithm'] == 'ledbat'
+        assert state['target_us'] == 5000
+        assert state['mode'] in ('fill', 'yield')
+        assert state['cwnd_pkts'] >= 2
+
+        client.close()
+        peer.close()
+
+class ShaperTest(unittest.TestCase):
+    def runTest(self):
+        self.classes()
+        self.shape()
+        self.throughput()
+
+    def classes(self):
+        shaper = pyudt.Shaper()
+        shaper.add_class('link', 100)
+        shaper.add_class('a', 30, 100, 'link')
+        shaper.add_class('b', 70, 0, 'link', 2)
+        self.assertRaises(TypeError, shaper.add_class, 'a', 10)
+        self.assertRaises(TypeError, shaper.add_class, 'c', 10, 0, 'unknown')
+        self.assertRaises(TypeError, shaper.add_class, 'c', 10, 5)
+        self.assertRaises(TypeError, shaper.remove_class, 'link')
+
+        stats = shaper.stats()['classes']
+        assert stats['b']['ceil_mbps'] == 70
+        assert stats['link']['children'] == 2
+        shaper.remove_class('b')
+        assert 'b' not in shaper.stats()['classes']
+
+    def shape(self):
+        shaper = pyudt.Shaper(50)
+        shaper.add_class('link', 80)
+        shaper.add_class('bulk', 20, 80, 'link')
+        shaper.add_class('interactive', 60, 80, 'link')
+
+        client, peer = connected_pair(6201)
+        other, other_peer = connected_pair(6202)
+        self.assertRaises(TypeError, shaper.add, client, 'unknown')
+
+        # Both greedy: each class gets its rate
+        shaper.add(client, 'bulk')
+        shaper.add(other, 'interactive')
+        sockets = shaper.stats()['sockets']
+        assert abs(sockets[client.descriptor()]['allocated_mbps'] - 20) < 1e-6
+        assert abs(sockets[other.descriptor()]['allocated_mbps'] - 60) < 1e-6
+
+        # Alone, bulk borrows the unused capacity
+        shaper.remove(other)
+        stats = shaper.stats()
+        assert stats['classes']['bulk']['borrowed_mbps'] > 0
+        assert abs(stats['sockets'][client.descriptor()]['allocated_mbps']
+                   - 80) < 1e-6
+
+        shaper.start()
+        try:
+            data = os.urandom(256 << 10)
+            client.sendall(data)
+            assert recv_exactly(peer, len(data)) == data
+            time.sleep(0.2)
+            assert shaper.stats()['classes']['bulk']['sent_packets'] > 0
+        finally:
+            shaper.stop()
+
+        for sock in (client, peer, other, other_peer):
+            sock.close()
+
+    def throughput(self):
+        # A root class caps its sockets at its rate
+        shaper = pyudt.Shaper()
+        shaper.add_class('link', 16)
+
+        client, peer = connected_pair(6203)
+        shaper.add(client, 'link')
+        assert shaper.stats()['sockets'][client.descriptor()]['maxbw'] == 2000000
+
+        data = os.urandom(1 << 20)
+        start = time.time()
+        client.sendall(data)
+        assert recv_exactly(peer, len(data)) == data
+        elapsed = time.time() - start
+
+        # 8 Mb at 16 Mb/s: about 0.5 s, against milliseconds on loopback
+        assert len(data) * 8 / elapsed / 1e6 < 16 * 1.5
+
+        # Removing the socket lifts its limit
+        shaper.remove(client)
+        assert client.getsockopt(pyudt.UDT_MAXBW) == -1
+
+        client.close()
+        peer.close()
+
+class SchedulerTest(unittest.TestCase):
+    def runTest(self):
+        self.classes()
+        self.drain()
+        self.priority()
+        self.removal()
+
+    def classes(self):
+        scheduler = pyudt.Scheduler()
+        scheduler.add_class('interactive', 4, -1)
+        self.assertRaises(TypeError, scheduler.add_class, 'interactive')
+        self.assertRaises(TypeError, scheduler.add_class, 'bulk', 0)
+
+        socket = new_socket()
+        self.assertRaises(TypeError, scheduler.add, socket, 'unknown')
+        self.assertRaises(TypeError, scheduler.enqueue, socket, b'data')
+        socket.close()
+
+        classes = scheduler.stats()['classes']
+        assert classes['default']['weight'] == 1
+        assert classes['interactive']['priority'] == -1
+
+    def drain(self):
+        scheduler = pyudt.Scheduler(2)
+        scheduler.add_class('interactive', 1, 0)
+        scheduler.add_class('bulk', 1, 1)
+
+        client, peer = connected_pair(6301)
+        other, other_peer = connected_pair(6302)
+        scheduler.add(client, 'interactive')
+        scheduler.add(other, 'bulk', 2)
+
+        small = os.urandom(4 << 10)
+        large = os.urandom(256 << 10)
+        for i in range(4):
+            assert scheduler.enqueue(client, small[i << 10:(i + 1) << 10]) > 0
+        for i in range(4):
+            assert scheduler.enqueue(other, large[i << 16:(i + 1) << 16]) > 0
+
+        stats = scheduler.stats()
+        assert stats['queued_bytes'] == len(small) + len(large)
+        assert stats['classes']['bulk']['queued_buffers'] == 4
+
+        scheduler.start()
+        try:
+            assert scheduler.flush(5000)
+
+            for sock, data in ((peer, small), (other_peer, large)):
+                assert recv_exactly(sock, len(data)) == data
+
+            stats = scheduler.stats()
+            assert stats['classes']['interactive']['sent_bytes'] == len(small)
+            assert stats['classes']['bulk']['sent_bytes'] == len(large)
+            assert stats['sockets'][other.descriptor()]['queued_bytes'] == 0
+        finally:
+            scheduler.stop()
+
+        scheduler.remove(client)
+        scheduler.remove(other)
+        for sock in (client, peer, other, other_peer):
+            sock.close()
+
+    def priority(self):
+        # A single sender thread serves the levels strictly in order
+        scheduler = pyudt.Scheduler(1)
+        scheduler.add_class('interactive', 1, 0)
+        scheduler.add_class('bulk', 1, 1)
+
+        client, peer = connected_pair(6303)
+        other, other_peer = connected_pair(6304)
+        scheduler.add(client, 'interactive')
+        scheduler.add(other, 'bulk')
+
+        # The bulk data is queued first
+        small = os.urandom(1 << 20)
+        large = os.urandom(1 << 20)
+        for i in range(16):
+            assert scheduler.enqueue(other, large[i << 16:(i + 1) << 16]) > 0
+        for i in range(16):
+            assert scheduler.enqueue(client, small[i << 16:(i + 1) << 16]) > 0
+
+        scheduler.start()
+        try:
+            # No bulk byte may be sent before the interactive queue is empty
+            deadline = time.time() + 5
+            while time.time() < deadline:
+                classes = scheduler.stats()['classes']
+                if classes['bulk']['sent_bytes'] > 0:
+                    assert classes['interactive']['queued_bytes'] == 0
+                    assert classes['interactive']['sent_bytes'] == len(small)
+                if classes['bulk']['queued_bytes'] == 0:
+                    break
+            assert scheduler.flush(5000)
+
+            for sock, data in ((peer, small), (other_peer, large)):
+                assert recv_exactly(sock, len(data)) == data
+        finally:
+            scheduler.stop()
+
+        scheduler.remove(client)
+        scheduler.remove(other)
+        for sock in (client, peer, other, other_peer):
+            sock.close()
+
+    def removal(self):
+        scheduler = pyudt.Scheduler(1, 64 << 10, 64 << 20)
+        client, peer = connected_pair(6305)
+        client.setblocking(True)
+        scheduler.add(client)
+        assert client.getsockopt(pyudt.UDT_SNDSYN) == False
+
+        data = os.urandom(8 << 20)
+        scheduler.enqueue(client, data)
+        scheduler.enqueue(client, b'dropped')
+        scheduler.start()
+        try:
+            # Remove the socket in the middle of the first buffer
+            deadline = time.time() + 5
+            while time.time() < deadline:
+                sockets = scheduler.stats()['sockets']
+                if sockets[client.descriptor()]['sent_bytes'] > 0:
+                    break
+            scheduler.remove(client)
+        finally:
+            scheduler.stop()
+
+        # The first buffer is completed, and the blocking mode restored
+        assert client.getsockopt(pyudt.UDT_SNDSYN) == True
+        assert recv_exactly(peer, len(data)) == data
+        assert scheduler.stats()['queued_bytes'] == 0
+
+        client.close()
+        peer.close()
+
 # Run unit tests
 if __name__ == '__main__':
     unittest.main()